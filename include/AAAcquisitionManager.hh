@@ -24,6 +24,7 @@
 // Boost
 #ifndef __CINT__
 #include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
 
 #include "ADAQDigitizer.hh"
 #endif
@@ -32,6 +33,7 @@
 #include <vector>
 #include <list>
 #include <string>
+#include <cstdio>
 using namespace std;
 
 // ADAQ
@@ -43,6 +45,23 @@ using namespace std;
 #include "AATypes.hh"
 #include "AAInterface.hh"
 #include "AASettings.hh"
+#include "AAStorageWriter.hh"
+#include "AAWaveformPacking.hh"
+#include "AAEventSpool.hh"
+#include "AASnapshotWriter.hh"
+#include "AAHistogramPublisher.hh"
+
+// The readout manager (i.e. the ADAQ file) and trees of one file of
+// a run. With file rotation, the next file of the run is opened and
+// the previous file finalized while the current file is written
+struct ADAQFileStruct{
+  ADAQReadoutManager *ReadoutManager;
+  string FileName;
+  TTree *WaveformTree, *IndexTree, *TimeIndexTree, *ListModeTree;
+  vector<vector<TBranch *> > ChannelBranches;
+  AAEventSpool *Spool;
+};
+
 
 class AAAcquisitionManager : public TObject
 {
@@ -57,6 +76,9 @@ public:
   void PrepareAcquisition();
   void StartAcquisition();
   void StopAcquisition();
+
+  // Redraw the display; called by the display timer
+  void RefreshDisplay();
   
   void CreateADAQFile(string);
   void CloseADAQFile();
@@ -78,7 +100,7 @@ public:
   void SetAcquisitionTimerEnable(Bool_t ATE) {AcquisitionTimerEnable = ATE;}
   Bool_t GetAcquisitionTimerEnable() {return AcquisitionTimerEnable;}
   
-  Bool_t GetADAQFileIsOpen() {return TheReadoutManager->GetADAQFileOpen();}
+  Bool_t GetADAQFileIsOpen() {return (ADAQFileOpen or RawFile != NULL);}
   
   void SetAcquisitionTimeStart(Double_t  T) {AcquisitionTimeStart = T;}
   void SetAcquisitionTimeStop(Double_t  T) {AcquisitionTimeStop = T;}
@@ -87,21 +109,78 @@ public:
   void SetSettingsPointer(AASettings *TS) {TheSettings = TS;}
 
   TH1F *GetSpectrum(Int_t C) {return Spectrum_H[C];}
+  vector<TH1F *> &GetSpectra() {return Spectrum_H;}
   TGraph *GetCalibrationCurve(Int_t C) {return CalibrationCurves[C];}
 
   void SetupRateVector();
+
+  void BuildAnalysisPlan();
+  AnalysisPlanStruct GetAnalysisPlan() {return AnalysisPlan;}
   list<unsigned int> * GetRateList(Int_t C) {return Rate_C[C];}
 
   TH2F *GetPSDHistogram(Int_t C) {return PSDHistogram_H[C];}
+  vector<TH2F *> &GetPSDHistograms() {return PSDHistogram_H;}
+  
+  // In raw readout buffer mode the status reports the raw file
+  // write rate since buffers are written without the writer thread
+  StorageWriterStatusStruct GetStorageWriterStatus();
+  Bool_t GetStorageWriterActive() {return (StorageWriter->GetWriterThreadActive() or RawFile != NULL);}
+
+#ifndef __CINT__
+  // Called from the storage writer thread to write a queued event
+  // into the ADAQ file; returns the number of bytes filled
+  Int_t WriteStorageRecord(StorageRecord &);
+#endif
+  
+  // Arm the capture of events for the storage benchmark; events are
+  // captured during the following acquisition until enough are held
+  void ArmStorageBenchmark();
+  
+  // Write the captured events to a temporary file with each
+  // compression algorithm and waveform encoding and return the
+  // write rate/ratio of each
+  Bool_t BenchmarkStorage(vector<StorageBenchmarkStruct> &);
   
-  TString GetADAQFileComment() {return TheReadoutManager->GetFileComment();}
-  void SetADAQFileComment(TString AFC) {TheReadoutManager->SetFileComment(AFC);}
+  // The comment of the active ADAQ file, which the storage writer
+  // thread carries over to the next file when rotating files
+  TString GetADAQFileComment();
+  void SetADAQFileComment(TString);
   
   ClassDef(AAAcquisitionManager, 1);
   
 private:
   static AAAcquisitionManager *TheAcquisitionManager;
 
+  Int_t FillWaveformBranches(Int_t);
+#ifndef __CINT__
+  Int_t FillListModeEvent(StorageRecord &);
+#endif
+  Int_t FillListModeBlock();
+  Bool_t LocateZLEChannel(Int_t, uint32_t &, uint32_t &);
+  Bool_t DecodeZLEWaveform(Int_t);
+  void AnalyzeZLESegments(Int_t);
+  void CaptureBenchmarkEvent(Int_t);
+  void RefillStorageBudgets();
+  Bool_t StoreRawWaveform(Int_t);
+
+  void PrepareADAQFile(ADAQFileStruct &, Int_t);
+  void ActivateADAQFile(ADAQFileStruct &);
+  ADAQFileStruct GetActiveADAQFile();
+  void FinalizeADAQFile(ADAQFileStruct, Bool_t);
+  void PrepareNextADAQFile();
+  Bool_t RotationDue();
+  void RotateADAQFile();
+
+  void StartSpectrumSnapshots(string);
+  void TakeSpectrumSnapshot();
+
+  void UpdateHistogramSnapshots();
+
+  void FillRawFileHeader(RawFileHeaderStruct &);
+  Bool_t CreateRawFile(string);
+  void WriteRawBuffer();
+  void CloseRawFile();
+
   Bool_t AcquisitionEnable;
 
   // Objects for controlling timed acquisition periods
@@ -113,6 +192,10 @@ private:
   Bool_t UseSTDFirmware, UsePSDFirmware;
   Bool_t AnalyzePSDList, AnalyzePSDWaveform;
 
+  // The analysis stages whose output is consumed by the present
+  // acquisition mode, storage, and calibration settings
+  AnalysisPlanStruct AnalysisPlan;
+
 #ifndef __CINT__
 
   //////////////////////////////////
@@ -144,19 +227,38 @@ private:
   uint32_t ZLENumWordMask, ZLEControlMask;
 #endif
 
+  // Pulses extracted from each ZLE good-data segment of the current
+  // channel/event; values are in [ADC] and offsets in [sample] from
+  // the start of the record. Offsets are converted to time stamp
+  // units [ticks/sample] when each segment's entry is stored
+  Bool_t ZLEPulsePerSegment;
+  vector<Double_t> ZLEPulseBaseline, ZLEPulseHeight, ZLEPulseArea;
+  vector<Int_t> ZLEPulseOffset;
+  Double_t ZLETicksPerSample;
+
   vector<Int_t> WaveformLength;
   vector<Int_t> BaselineStart, BaselineStop, BaselineLength;
   vector<Double_t > BaselineValue;
+
+  // Integer accumulators for the sample loop analysis. Pulse
+  // quantities are accumulated in units of (ADC * BaselineLength),
+  // i.e. relative to the integer baseline sum, such that the only
+  // divisions occur once per event when converting to Double_t. The
+  // accumulators are 64-bit since (ADC * BaselineLength) exceeds the
+  // Int_t range for long baseline windows on high resolution boards
+  vector<Long64_t> BaselineSum;
   vector<Int_t> PSDTotalAbsStart, PSDTotalAbsStop;
   vector<Int_t> PSDTailAbsStart, PSDTailAbsStop;
   vector<Int_t> PeakPosition;
-  vector<Double_t > Polarity;
+  vector<Int_t> Polarity;
   
   ULong64_t EventCounter;
   Int_t LLD, ULD;
-  Double_t  SampleHeight, TriggerHeight;
+  Long64_t SampleHeight;
+  Double_t  TriggerHeight;
   Double_t  PulseHeight, PulseArea;
   Double_t  PSDTotal, PSDTail;
+  Long64_t PulseHeightSum, PulseAreaSum, PSDTotalSum, PSDTailSum;
   
   vector<ULong64_t> CorrectedTimeStamp;
 #ifndef __CINT__
@@ -184,6 +286,130 @@ private:
   TTree *WaveformTree;
   Bool_t FillWaveformTree;
 
+  // Each event fills only the TTree branches of its own channel. The
+  // index tree records the channel and per-channel branch entry of
+  // every stored event in acquisition order
+  vector<vector<TBranch *> > ChannelBranches;
+  vector<Long64_t> ChannelEntries;
+  TTree *IndexTree;
+  Int_t IndexChannel;
+  Long64_t IndexEntry;
+
+  // The sparse time index records the time stamp, branch entry, and
+  // index tree entry of every TimeIndexInterval'th event of each
+  // channel such that readers can seek directly to a time range
+  TTree *TimeIndexTree;
+  Int_t TimeIndexInterval;
+  ULong64_t TimeIndexTimeStamp;
+  Long64_t TimeIndexOrder;
+
+  // Events are written to the ADAQ file by a dedicated thread such
+  // that compression and disk I/O never stall digitizer readout
+  AAStorageWriter *StorageWriter;
+  Int_t StorageQueueCapacity;
+
+  // Per-channel raw waveform storage policies (see AASettings): the
+  // count of waveforms passing the threshold for the prescale and the
+  // remaining budget [bytes] of the rate cap, which is refilled once
+  // per readout with the time elapsed since StorageBudgetTime [ms]
+  vector<Long64_t> StoragePrescaleCount;
+  vector<Double_t> StorageBudget;
+  Long64_t StorageBudgetTime;
+
+  // ADAQ file compression (ROOT algorithm * 100 + level) and the
+  // auto-flush [events] and auto-save [bytes] intervals, which must
+  // be handled here since TTree::Fill() is never called
+  Int_t StorageCompression, StorageAutoFlush;
+  Long64_t StorageAutoSave, EventsSinceFlush, BytesSinceSave;
+
+  // Parallel basket compression with ROOT implicit multithreading,
+  // which compresses the baskets of all branches concurrently when
+  // the trees are flushed. The trees are flushed once the bytes
+  // filled since the last flush amount to a nearly full basket per
+  // enabled channel such that the flushed baskets are, on average,
+  // full; a basket that fills before then (a channel triggering
+  // much faster than the others) is compressed by TBranch::Fill()
+  Bool_t StorageIMT;
+  Long64_t StorageIMTFlushBytes, BytesSinceFlush;
+
+  // Compact list-mode storage of events without waveforms. Event
+  // data are accumulated column-wise (struct-of-arrays) and written
+  // as one entry of the "ListMode" tree per block of events
+  Bool_t ListModeStorage;
+  TTree *ListModeTree;
+  Int_t ListModeBlockSize, ListModeEvents;
+  vector<ULong64_t> ListModeTimeStamp;
+  vector<UChar_t> ListModeChannel;
+  vector<Float_t> ListModeBaseline, ListModePulseHeight, ListModePulseArea;
+  vector<Float_t> ListModePSDTotal, ListModePSDTail;
+
+  // ADAQ file rotation. The files of a run share the run ID and are
+  // numbered by the file sequence; the thresholds of the current
+  // file are in [bytes], [s], and [events] (0 = disabled)
+  Bool_t ADAQFileOpen;
+  Bool_t StorageRotate;
+  Long64_t StorageRotateBytes, StorageRotateEvents;
+  Double_t StorageRotateTime;
+  Long64_t RunID;
+  Int_t FileSequence;
+  Long64_t FileEvents;
+  Double_t FileTimeStart;
+  string ADAQFileName;
+  ADAQFileStruct NextADAQFile;
+  Bool_t NextADAQFileReady;
+#ifndef __CINT__
+  boost::thread *PrepareThread, *FinalizeThread;
+#endif
+
+  // The files of a run are prepared from copies of the settings and
+  // digitizer information taken when the first file is created such
+  // that the preparation thread never reads the settings or the
+  // digitizer while the GUI thread may be modifying them
+  AASettings *FileSettings;
+  RawFileHeaderStruct FileDGInfo;
+  string FileDGROCFWRevision, FileDGAMCFWRevision;
+
+  // The crash-safe event spool of the active ADAQ file (NULL when
+  // spooling is disabled). The sync period [ms], spool header, and
+  // serialized settings are common to all files of the run
+  Bool_t StorageSpool;
+  Int_t StorageSpoolSync;
+  AAEventSpool *EventSpool;
+  RawFileHeaderStruct SpoolHeader;
+  vector<char> SpoolSettings;
+
+  // Time-sliced spectrum (or PSD histogram) snapshots are taken from
+  // the acquisition loop every period [s] while an ADAQ file is open
+  // and written to the snapshot file by the snapshot writer
+  AASnapshotWriter *SnapshotWriter;
+  Double_t SnapshotPeriod, SnapshotTimeStart, NextSnapshotTime;
+  Int_t SnapshotSequence;
+
+  // The spectra or PSD histograms are published to the display as
+  // snapshots at the display frame rate such that the display never
+  // draws the histograms being filled; the snapshot histograms of
+  // the latest snapshot taken by the display are held by channel
+  AAHistogramPublisher *HistogramPublisher;
+  Long64_t PublishTime;
+  vector<TH1F *> SpectrumSnapshot_H;
+  vector<TH2F *> PSDHistogramSnapshot_H;
+
+#ifndef __CINT__
+  // The events captured for the storage benchmark while armed
+  vector<StorageRecord> BenchmarkEvents;
+#endif
+  ULong64_t BenchmarkEventCount;
+  Bool_t BenchmarkArmed;
+
+  // Raw readout buffer storage: the PC buffer of each digitizer
+  // readout is appended undecoded to the raw file (see AATypes.hh
+  // for the format) for offline conversion with ADAQRawConvert
+  FILE *RawFile;
+  vector<char> RawFileBuffer;
+  Long64_t RawTimeStart, RawBytesWritten, RawBytesAtLastStatus;
+  Double_t RawTimeAtLastStatus;
+  Bool_t RawWriteError;
+
   ADAQRootMeasParams *Parameters;
   TObjString *Comment;
   
@@ -197,15 +423,32 @@ private:
   
   ADAQReadoutManager *TheReadoutManager;
 #ifndef __CINT__
+  // Guards the active readout manager, which is swapped by the
+  // storage writer thread on rotation, against the GUI thread
+  boost::mutex ReadoutManagerMutex;
+  
   // Waveforms receives digitized waveform data during readout and is
   // used for on-the-fly waveform analysis and graphing
   vector<vector<uint16_t> > Waveforms;
   
   // Waveforms4Storage has its addressed tied to the ROOT TTree in the
-  // ADAQ file for persistently storing waveforms to disk
+  // ADAQ file for persistently storing waveforms to disk. It is only
+  // accessed by the storage writer thread while the file is open
   vector<vector<uint16_t> > Waveforms4Storage;
+
+  // With bit-packed or delta-encoded storage the waveform of each
+  // channel is encoded by the writer thread into
+  // PackedWaveforms4Storage, whose address is tied to the channel's
+  // packed waveform branch. The encoding is one of the values of the
+  // "WaveformEncoding" file parameter (see AAWaveformPacking.hh)
+  vector<vector<uint32_t> > PackedWaveforms4Storage;
+  Int_t WaveformEncoding;
 #endif
   vector<ADAQWaveformData *> WaveformData;
+
+  // WaveformData4Storage has its address tied to the ROOT TTree and,
+  // like Waveforms4Storage, belongs to the storage writer thread
+  vector<ADAQWaveformData *> WaveformData4Storage;
 };
 
 #endif
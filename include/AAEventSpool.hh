@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AAEventSpool_hh__
+#define __AAEventSpool_hh__ 1
+
+// ROOT
+#include <TObject.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/thread.hpp>
+#endif
+
+// C++
+#include <string>
+using namespace std;
+
+// ADAQAcquisition
+#include "AATypes.hh"
+#include "AAStorageWriter.hh"
+
+// A crash-safe, append-only copy of the events written into an ADAQ
+// file. The storage writer appends each event record to the
+// memory-mapped spool file before the event is filled into the ROOT
+// trees, whose baskets are only in memory until they are flushed. A
+// separate thread periodically msync()'s the newly appended records
+// such that at most one sync period of events is lost should the
+// program crash or the machine lose power. The spool is removed once
+// its ADAQ file is written; a leftover spool is rebuilt into an ADAQ
+// file with ADAQSpoolRecover (see AATypes.hh for the spool format)
+class AAEventSpool : public TObject
+{
+public:
+  AAEventSpool();
+  ~AAEventSpool();
+
+  // Create the spool file with the specified header, serialized
+  // settings, and msync() period [ms]
+  Bool_t Open(string, RawFileHeaderStruct, const char *, UInt_t, Int_t);
+
+  // Sync all records to disk and close the spool, removing the file
+  // if specified (i.e. once the ADAQ file has been written)
+  void Close(Bool_t);
+
+#ifndef __CINT__
+  // Append an event record; called only by the storage writer thread
+  void Append(StorageRecord &);
+#endif
+
+  // The checksum of a complete record (see AATypes.hh)
+  static UInt_t Checksum(const SpoolRecordHeaderStruct *);
+
+  Bool_t GetSpoolOpen() {return (SpoolMap != NULL);}
+  string GetFileName() {return FileName;}
+
+  ClassDef(AAEventSpool, 1);
+
+private:
+  Bool_t Reserve(Long64_t);
+  void RunSyncThread();
+
+  string FileName;
+  Int_t FileDescriptor;
+
+  // The complete address space of the spool is mapped once when the
+  // spool is opened such that the mapping never moves while the sync
+  // thread is working on it; the file itself is allocated in chunks
+  // as the spool grows
+  char *SpoolMap;
+  Long64_t MapSize, FileSize;
+
+  // Bytes of records appended and bytes of records synced to disk
+  Long64_t WrittenBytes, SyncedBytes;
+
+  Int_t SyncPeriod;
+  Bool_t SyncThreadEnable, SpoolError;
+
+#ifndef __CINT__
+  boost::thread *SyncThread;
+  boost::mutex SyncMutex;
+  boost::condition_variable SyncWake;
+#endif
+};
+
+#endif
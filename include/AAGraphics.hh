@@ -20,6 +20,7 @@
 #include <TCanvas.h>
 #include <TH1F.h>
 #include <TH2F.h>
+#include <TH2D.h>
 #include <TGraph.h>
 
 #include <vector>
@@ -50,6 +51,12 @@ public:
   void PlotWaveforms(vector<vector<uint16_t> > &,
 		     vector<Int_t> &);
 #endif
+#ifndef __CINT__
+  // Add a waveform to the persistence display density
+  void AccumulatePersistence(vector<uint16_t> &, Int_t);
+#endif
+  void PlotPersistence();
+  
   void DrawWaveformGraphics(vector<Double_t> &, 
 			    vector<Int_t> &,
 			    vector<Int_t> &,
@@ -65,6 +72,13 @@ public:
   
   void SetupPSDHistogramGraphics();
   void PlotPSDHistogram(TH2F *);
+
+  // Divide the canvas into one pad per enabled channel if the tiled
+  // display is set for the spectrum or PSD mode; otherwise, restore
+  // the single undivided pad
+  void SetupTiles();
+  void PlotSpectrumTiles(vector<TH1F *> &);
+  void PlotPSDHistogramTiles(vector<TH2F *> &);
   
   void PlotCalibration(int);
 
@@ -73,6 +87,14 @@ public:
 private:
   static AAGraphics *TheGraphicsManager;
 
+#ifndef __CINT__
+  void DecimateWaveform(Int_t, vector<uint16_t> &, Int_t);
+#endif
+
+  void DrawSpectrum(TH1F *, Int_t);
+  void DrawPSDHistogram(TH2F *, Int_t);
+  void PlotTiles(vector<TH1 *> &, Bool_t);
+
   TLegend * Waveform_LG;
   vector<TLine *> Trigger_L, ZLE_L;
 
@@ -91,8 +113,6 @@ private:
 
   AASettings *TheSettings;
 
-  vector<Int_t> Time;
-
   TGraph *RateGraph;
   TH1F *RateGraphAxes_H;
   vector<Double_t> timeR;
@@ -107,6 +127,33 @@ private:
   
   vector<TGraph *> WaveformGraphs;
   TH1F *WaveformGraphAxes_H;
+
+  // The persistence display density of all waveforms in (time bin,
+  // ADC value >> PersistenceShift) cells, stored time-major. The cell
+  // offset of the time bin of each sample is precomputed such that
+  // accumulating a waveform is one integer increment per sample; the
+  // density is copied into Persistence_H and then decayed once per
+  // frame. Cells hold counts in 16-bit fixed point such that the
+  // fractional counts left by the decay are kept
+  vector<ULong64_t> PersistenceDensity;
+  vector<Int_t> PersistenceOffset;
+  Int_t PersistenceTimeBins, PersistenceValueBins, PersistenceShift;
+  Long64_t PersistenceTime;
+  TH2D *Persistence_H;
+
+  // The pads of the tiled display, which are created once per
+  // acquisition, with each pad's channel and the number of entries
+  // of its histogram when last drawn. A pad is only redrawn when its
+  // histogram or the view settings (TileView) have changed; the pads
+  // left over once the redraw budget is spent are redrawn first on
+  // the next frame, starting from TileNext. Each pad draws its own
+  // copy (TileHistograms) of its histogram, titled with the channel
+  vector<TPad *> TilePads;
+  vector<TH1 *> TileHistograms;
+  vector<Int_t> TileChannel;
+  vector<Double_t> TileEntries, TileView;
+  Int_t TileNext;
+  Long64_t TileCost;
 };
 
 #endif
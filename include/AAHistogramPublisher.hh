@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AAHistogramPublisher_hh__
+#define __AAHistogramPublisher_hh__ 1
+
+// ROOT
+#include <TObject.h>
+#include <TH1.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/atomic.hpp>
+#endif
+
+// C++
+#include <vector>
+using namespace std;
+
+// Publishes snapshots of the spectra or PSD histograms being filled
+// by the acquisition loop to the display without either side ever
+// waiting on the other. The acquisition side copies the histograms
+// into its back buffer and atomically swaps it with the handoff
+// buffer; the display side atomically swaps its front buffer with the
+// handoff buffer only if a newer snapshot has been published since.
+// A snapshot that is published before the display has taken the
+// previous one replaces it, i.e. stale snapshots are dropped rather
+// than queued, and the display always draws a complete snapshot that
+// is never written while being drawn
+class AAHistogramPublisher : public TObject
+{
+public:
+  AAHistogramPublisher();
+  ~AAHistogramPublisher();
+
+  // Allocate the snapshot buffers as copies of the live histograms
+  // (one per channel); called before acquisition while neither side
+  // is publishing or reading snapshots
+  void Setup(vector<TH1 *> &);
+
+  // Acquisition side: copy the live histograms into the back buffer
+  // and publish it
+  void Publish();
+
+  // Display side: take the latest snapshot if one has been published
+  // since the last call, returning true if so
+  Bool_t Acquire();
+
+  // Display side: the channel's histogram of the taken snapshot
+  TH1 *GetSnapshot(Int_t C) {return Buffers[Front][C];}
+
+  ClassDef(AAHistogramPublisher, 1);
+
+private:
+  void Clear();
+
+  // The live histograms and the three snapshot buffers, which are
+  // owned by the acquisition side (Back), the display side (Front),
+  // and neither (the handoff buffer, whose index is in Handoff)
+  vector<TH1 *> Live;
+  vector<TH1 *> Buffers[3];
+  Int_t Back, Front;
+
+#ifndef __CINT__
+  // The handoff buffer index with the Fresh bit set when it holds a
+  // snapshot the display side has not taken
+  boost::atomic<Int_t> Handoff;
+#endif
+};
+
+#endif
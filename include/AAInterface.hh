@@ -19,6 +19,7 @@
 #include <TGFrame.h>
 #include <TGNumberEntry.h>
 #include <TGComboBox.h>
+#include <TGLabel.h>
 #include <TGTab.h>
 #include <TObject.h>
 #include <TRootEmbeddedCanvas.h>
@@ -30,6 +31,7 @@
 #include <TGTextView.h>
 #include <TGFileDialog.h>
 #include <TGProgressBar.h>
+#include <TTimer.h>
 
 #include <vector>
 #include <map>
@@ -46,6 +48,7 @@ class AASubtabSlots;
 class AATabSlots;
 class AAVMEManager;
 class AAAcquisitionManager;
+class AAPeakFitter;
 
 // Define the maximum number of digitizer channels supported by the
 // ADAQ framework
@@ -79,6 +82,7 @@ public:
   void UpdateAfterAQTimerStopped(bool);
   void UpdateAfterCalibrationPointAdded(int);
   void UpdateHVMonitors(int, int, int);
+  void UpdateAnalysisPlan(AnalysisPlanStruct);
   void UpdateChannelSettingsToChannelZero();
 
   string CreateFileDialog(const char *[], EFileDialogMode);
@@ -159,6 +163,14 @@ private:
   AASubtabSlots *SubtabSlots;
   AATabSlots *TabSlots;
 
+  // Background peak fitter for live spectra and the timer that
+  // periodically hands it spectrum snapshots
+  AAPeakFitter *PeakFitter;
+  TTimer *PeakFitTimer;
+  TTimer *StorageMonitorTimer;
+  TTimer *DisplayTimer;
+  TTimer *HVMonitorTimer;
+
   /////////////////////////////
   // ROOT GUI widget objects //
   /////////////////////////////
@@ -188,6 +200,24 @@ private:
 
   TGTextButton *VMEConnect_TB;
   TGTextView *ConnectionOutput_TV;
+
+  ADAQComboBoxWithLabel *StorageCompressionAlgorithm_CBL;
+  ADAQNumberEntryWithLabel *StorageCompressionLevel_NEL;
+  ADAQNumberEntryWithLabel *StorageThreads_NEL;
+  ADAQNumberEntryWithLabel *StorageBasketSize_NEL;
+  ADAQNumberEntryWithLabel *StorageAutoFlush_NEL;
+  ADAQNumberEntryWithLabel *StorageAutoSave_NEL;
+  TGCheckButton *StorageRotate_CB;
+  ADAQNumberEntryWithLabel *StorageRotateSize_NEL;
+  ADAQNumberEntryWithLabel *StorageRotateTime_NEL;
+  ADAQNumberEntryWithLabel *StorageRotateEvents_NEL;
+  TGCheckButton *StorageSpool_CB;
+  ADAQNumberEntryWithLabel *StorageSpoolSync_NEL;
+  TGCheckButton *SpectrumSnapshots_CB;
+  ADAQNumberEntryWithLabel *SpectrumSnapshotPeriod_NEL;
+  TGCheckButton *SpectrumSnapshotCumulative_CB;
+  TGTextButton *StorageBenchmark_TB;
+  TGTextView *StorageBenchmark_TV;
   vector<ADAQComboBoxWithLabel *> BoardType_CBL;
   vector<ADAQNumberEntryFieldWithLabel *> BoardAddress_NEF;
   vector<ADAQNumberEntryWithLabel *> BoardLinkNumber_NEL;
@@ -223,6 +253,7 @@ private:
   TGTextButton *HVChPower_TB[6];
 
   TGCheckButton *HVMonitorEnable_CB;
+  ADAQNumberEntryWithLabel *HVMonitorPeriod_NEL;
 
   //////////////////////
   // Scope frame widgets
@@ -237,6 +268,9 @@ private:
   TGRadioButton *DGChNegPolarity_RB[MAX_DG_CHANNELS];
   ADAQNumberEntryWithLabel *DGChDCOffset_NEL[MAX_DG_CHANNELS];
   ADAQNumberEntryWithLabel *DGChTriggerThreshold_NEL[MAX_DG_CHANNELS];
+  ADAQNumberEntryWithLabel *DGChStoragePrescale_NEL[MAX_DG_CHANNELS];
+  ADAQNumberEntryWithLabel *DGChStorageThreshold_NEL[MAX_DG_CHANNELS];
+  ADAQNumberEntryWithLabel *DGChStorageRateCap_NEL[MAX_DG_CHANNELS];
   
   // CAEN Standard firmware widgets
   
@@ -299,7 +333,9 @@ private:
 
   TGCheckButton *AQDataReductionEnable_CB;
   ADAQNumberEntryWithLabel *AQDataReductionFactor_NEL;
-  TGCheckButton *DGZLEEnable_CB;
+  TGCheckButton *DGZLEEnable_CB, *DGZLEPulsePerSegment_CB;
+  TGLabel *AQAnalysisPlan_L;
+  ADAQNumberEntryFieldWithLabel *AQAnalysisCost_NEFL;
   
   // Pulse spectra subtab
 
@@ -329,6 +365,14 @@ private:
   TGTextButton *SpectrumCalibrationLoad_TB;
   TGTextButton *SpectrumCalibrationWrite_TB;
 
+  TGCheckButton *SpectrumPeakFitEnable_CB;
+  ADAQNumberEntryWithLabel *SpectrumPeakFitMin_NEL, *SpectrumPeakFitMax_NEL;
+  ADAQNumberEntryWithLabel *SpectrumPeakFitPeriod_NEL;
+  ADAQNumberEntryFieldWithLabel *SpectrumPeakFitCentroid_NEFL;
+  ADAQNumberEntryFieldWithLabel *SpectrumPeakFitFWHM_NEFL;
+  ADAQNumberEntryFieldWithLabel *SpectrumPeakFitResolution_NEFL;
+  TGTextButton *SpectrumPeakFitToCalibration_TB;
+
   // Pulse discrimination subtab
   
   ADAQComboBoxWithLabel *PSDChannel_CBL;
@@ -349,6 +393,13 @@ private:
   TGCheckButton *WaveformStoreRaw_CB;
   TGCheckButton *WaveformStoreEnergyData_CB;
   TGCheckButton *WaveformStorePSDData_CB;
+  TGCheckButton *WaveformStoreReadoutBuffers_CB;
+  TGCheckButton *WaveformStoreListMode_CB;
+  TGCheckButton *WaveformStorePacked_CB;
+  TGCheckButton *WaveformStoreDeltaCoded_CB;
+  ADAQNumberEntryFieldWithLabel *WaveformStorageQueue_NEFL;
+  ADAQNumberEntryFieldWithLabel *WaveformStorageRate_NEFL;
+  ADAQNumberEntryFieldWithLabel *WaveformStorageBackpressure_NEFL;
 
   TGRadioButton *WaveformOutput_RB, *SpectrumOutput_RB, *PSDHistogramOutput_RB;
   ADAQComboBoxWithLabel *ObjectOutputChannel_CBL;
@@ -369,6 +420,8 @@ private:
   TGCheckButton *DisplayXAxisLog_CB, *DisplayYAxisLog_CB;
   
   TGRadioButton *DrawWaveformWithLine_RB, *DrawWaveformWithMarkers_RB, *DrawWaveformWithBoth_RB;
+  TGCheckButton *WaveformPersistence_CB;
+  ADAQNumberEntryWithLabel *WaveformPersistenceDecay_NEL;
   TGRadioButton *DrawSpectrumWithLine_RB, *DrawSpectrumWithMarkers_RB, *DrawSpectrumWithBars_RB;
   
   TGCheckButton *DisplayTitlesEnable_CB;
@@ -376,7 +429,9 @@ private:
   ADAQNumberEntryWithLabel *DisplayXTitleOffset_NEL, *DisplayXTitleSize_NEL;
   ADAQNumberEntryWithLabel *DisplayYTitleOffset_NEL, *DisplayYTitleSize_NEL;
 
-  ADAQNumberEntryWithLabel *SpectrumRefreshRate_NEL;
+  ADAQNumberEntryWithLabel *DisplayFrameRate_NEL;
+  TGCheckButton *DisplayTiled_CB;
+  ADAQNumberEntryWithLabel *DisplayTileBudget_NEL;
 
   ADAQComboBoxWithLabel *RateChannel_CBL;
   ADAQNumberEntryWithLabel *RatePlotDisp_NEL;
@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //      
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AAPeakFitter_hh__
+#define __AAPeakFitter_hh__ 1
+
+// ROOT
+#include <TObject.h>
+#include <TH1F.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/thread.hpp>
+#endif
+
+// C++
+#include <vector>
+using namespace std;
+
+// ADAQAcquisition
+#include "AATypes.hh"
+
+class AAPeakFitter : public TObject
+{
+public:
+  AAPeakFitter();
+  ~AAPeakFitter();
+
+  // Start and stop the background fitting thread
+  void StartFitThread();
+  void StopFitThread();
+
+  // Copy the region-of-interest (ROI) bins of a live spectrum into
+  // the fitter; the copy is cheap and the fit itself occurs in the
+  // background thread such that the caller is never blocked
+  Bool_t SubmitSnapshot(TH1F *, Int_t, Double_t, Double_t);
+
+  // Returns true (and fills the struct) only if a new fit result has
+  // become available since the last call
+  Bool_t GetLatestResult(PeakFitResultStruct &);
+
+  void Reset();
+
+  ClassDef(AAPeakFitter, 1);
+
+private:
+  void RunFitThread();
+  Bool_t FitGaussianPlusLine(vector<Double_t> &, vector<Double_t> &, Double_t *, Bool_t);
+  Double_t ComputeChiSquare(vector<Double_t> &, vector<Double_t> &, Double_t *);
+
+#ifndef __CINT__
+  boost::thread *FitThread;
+  boost::mutex FitMutex;
+  boost::condition_variable FitCondition;
+#endif
+  
+  Bool_t FitThreadEnable, SnapshotPending, ResultPending;
+
+  // Snapshot data handed from the GUI to the fitting thread
+  vector<Double_t> SnapshotX, SnapshotY;
+  Int_t SnapshotChannel;
+  Double_t SnapshotMin, SnapshotMax;
+
+  // Fit parameters are kept between fits and used as the starting
+  // point of the next fit of the same channel/ROI so that the fit is
+  // updated incrementally as counts accumulate in the spectrum
+  Double_t Parameters[5];
+  Bool_t ParametersValid;
+  Int_t FitChannel;
+  Double_t FitMin, FitMax, FitCounts;
+
+  PeakFitResultStruct FitResult;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AARawFile_hh__
+#define __AARawFile_hh__ 1
+
+// ROOT
+#include <TObject.h>
+#include <TTree.h>
+#include <TBranch.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/cstdint.hpp>
+#endif
+
+// C++
+#include <vector>
+#include <string>
+using namespace std;
+
+// ADAQ
+#include "ADAQReadoutManager.hh"
+#include "ADAQWaveformData.hh"
+
+// ADAQAcquisition
+#include "AATypes.hh"
+#include "AASettings.hh"
+
+// Methods shared by ADAQAcquisition and the offline tools for the
+// files that begin with the raw file header (see AATypes.hh), i.e.
+// raw readout buffer files and event spools. The settings block that
+// follows the header is an in-memory ROOT file holding the AASettings
+// object together with the StreamerInfo of its class version, such
+// that the settings written by one version of AASettings are read by
+// any later version through ROOT schema evolution.
+//
+// An instance writes the ADAQ file rebuilt from such a file by
+// ADAQRawConvert or ADAQSpoolRecover. As in ADAQAcquisition, each
+// event fills only its own channel's waveform branches and its
+// channel and branch entry are recorded in the waveform index tree
+class AARawFile : public TObject
+{
+public:
+  AARawFile();
+  ~AARawFile();
+
+  // Serialize the settings into the settings block
+  static Bool_t WriteSettings(AASettings *, vector<char> &);
+
+  // Recover the settings from the settings block, returning NULL if
+  // the block is not readable; the caller owns the settings
+  static AASettings *ReadSettings(vector<char> &);
+
+  // Create the ADAQ file, its waveform branches and index tree, and
+  // fill its readout information from the header and settings
+  void CreateADAQFile(string, RawFileHeaderStruct &, AASettings *);
+
+  // Fill the present waveform and waveform data of a channel
+  void FillEvent(Int_t);
+
+  // Write and close the ADAQ file
+  void CloseADAQFile();
+
+  vector<uint16_t> &GetWaveform(Int_t Channel) {return Waveforms[Channel];}
+  ADAQWaveformData *GetWaveformData(Int_t Channel) {return WaveformData[Channel];}
+  ADAQReadoutInformation *GetReadoutInformation() {return ReadoutManager->GetReadoutInformation();}
+
+  ClassDef(AARawFile, 1);
+
+private:
+  void FillReadoutInformation(RawFileHeaderStruct &, AASettings *);
+
+  ADAQReadoutManager *ReadoutManager;
+  TTree *WaveformTree, *IndexTree;
+
+  vector<vector<uint16_t> > Waveforms;
+  vector<ADAQWaveformData *> WaveformData;
+  vector<vector<TBranch *> > ChannelBranches;
+  vector<Long64_t> ChannelEntries;
+
+  Int_t IndexChannel;
+  Long64_t IndexEntry;
+};
+
+#endif
@@ -51,6 +51,9 @@ public:
     ChNegPolarity.resize(DGChannels);
     ChDCOffset.resize(DGChannels);
     ChTriggerThreshold.resize(DGChannels);
+    ChStoragePrescale.resize(DGChannels, 1);
+    ChStorageThreshold.resize(DGChannels, 0.);
+    ChStorageRateCap.resize(DGChannels, 0);
 
     // CAEN Standard firmware specific settings
     
@@ -85,6 +88,37 @@ public:
   string SettingsFileName;
   Bool_t AutoSaveSettings;
   Bool_t AutoLoadSettings;
+
+  // ADAQ file storage: compression algorithm (ROOT enumerator, 0 ==
+  // none), level [0-9], compression threads (0 == storage writer
+  // thread only), basket size [kB], auto-flush [events], and
+  // auto-save [MB]; auto-flush/save are disabled with 0
+  Int_t StorageCompressionAlgorithm;
+  Int_t StorageCompressionLevel;
+  Int_t StorageThreads;
+  Int_t StorageBasketSize;
+  Int_t StorageAutoFlush;
+  Int_t StorageAutoSave;
+
+  // ADAQ file rotation: when enabled a new file of the run is started
+  // once the current file exceeds any of the size [MB], time [min],
+  // or event thresholds; a threshold is disabled with 0
+  Bool_t StorageRotate;
+  Int_t StorageRotateSize;
+  Int_t StorageRotateTime;
+  Int_t StorageRotateEvents;
+
+  // Crash-safe event spool of each ADAQ file, synced to disk with the
+  // specified period [ms]
+  Bool_t StorageSpool;
+  Int_t StorageSpoolSync;
+
+  // Time-sliced snapshots of the spectra or PSD histograms written
+  // every period [s] while an ADAQ file is open, either cumulative
+  // or as the change since the previous snapshot
+  Bool_t SpectrumSnapshots;
+  Int_t SpectrumSnapshotPeriod;
+  Bool_t SpectrumSnapshotCumulative;
   
   /////////////////////////////////
   // VME connection widget settings
@@ -100,6 +134,9 @@ public:
 
   vector<Int_t> HVChVoltage;
   vector<Int_t> HVChCurrent;
+
+  // Period [ms] at which the HV channels are read while monitoring
+  Int_t HVMonitorPeriod;
   
   //////////////////////////
   // Channel widget settings
@@ -112,6 +149,13 @@ public:
   vector<Int_t>   ChDCOffset;
   vector<Int_t>   ChTriggerThreshold;
 
+  // Raw waveform storage policies: store every Nth waveform, only
+  // waveforms whose pulse height/area is above the threshold (0 =
+  // off), and at most the rate [kB/s] of waveform data (0 = off)
+  vector<Int_t>    ChStoragePrescale;
+  vector<Double_t> ChStorageThreshold;
+  vector<Int_t>    ChStorageRateCap;
+
   // CAEN Standard firmware specific settings
 
   vector<Int_t>   ChZLEThreshold;
@@ -178,6 +222,7 @@ public:
   Bool_t DataReductionEnable;
   Int_t DataReductionFactor;
   Bool_t ZeroSuppressionEnable;
+  Bool_t ZLEPulsePerSegment;
 
   
   ////////////////////////////////////
@@ -201,6 +246,11 @@ public:
   Bool_t SpectrumCalibrationUseSlider;
   string SpectrumCalibrationUnit;
 
+  // Live peak fitting
+  Bool_t SpectrumPeakFitEnable;
+  Double_t SpectrumPeakFitMin, SpectrumPeakFitMax;
+  Double_t SpectrumPeakFitPeriod;
+
   ////////////////////////////////////
   // Rate plot widget settings
   Int_t RateChannel;
@@ -228,6 +278,10 @@ public:
   Bool_t WaveformStoreRaw;
   Bool_t WaveformStoreEnergyData;
   Bool_t WaveformStorePSDData;
+  Bool_t WaveformStoreReadoutBuffers;
+  Bool_t WaveformStoreListMode;
+  Bool_t WaveformStorePacked;
+  Bool_t WaveformStoreDeltaCoded;
 
   Bool_t ObjectSaveWithTimeExtension;
   Bool_t CanvasSaveWithTimeExtension;
@@ -249,9 +303,21 @@ public:
   Bool_t DisplayXAxisInLog, DisplayYAxisInLog;
   
   Bool_t WaveformWithLine, WaveformWithMarkers, WaveformWithBoth;
+
+  // Waveform persistence display with the density decay time [s]
+  // (0 = infinite persistence)
+  Bool_t WaveformPersistence;
+  Double_t WaveformPersistenceDecay;
+  
   Bool_t SpectrumWithLine, SpectrumWithMarkers, SpectrumWithBars;
   
-  int SpectrumRefreshRate;
+  // Rate [frames/s] at which the display is redrawn in continuous mode
+  Int_t DisplayFrameRate;
+
+  // Tiled display of the spectra or PSD histograms of all enabled
+  // channels with the maximum redraw time [ms] per frame
+  Bool_t DisplayTiled;
+  Int_t DisplayTileBudget;
   
   Bool_t DisplayContinuous, DisplayUpdateable, DisplayNonUpdateable;
 
@@ -263,7 +329,7 @@ public:
   Int_t TriggerCoincidenceChannel1;
   Int_t TriggerCoincidenceChannel2;
   
-  ClassDef(AASettings, 1);
+  ClassDef(AASettings, 2);
 };
 
 #endif
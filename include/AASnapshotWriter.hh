@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AASnapshotWriter_hh__
+#define __AASnapshotWriter_hh__ 1
+
+// ROOT
+#include <TObject.h>
+#include <TH1.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/thread.hpp>
+#endif
+
+// C++
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+using namespace std;
+
+#ifndef __CINT__
+// The copies of the spectra or PSD histograms at one point in time,
+// which are owned by the snapshot writer once submitted
+struct SpectrumSnapshot{
+  Int_t Sequence;
+  Double_t Time;
+  vector<TH1 *> Histograms;
+};
+#endif
+
+// Writes time-sliced snapshots of the spectra or PSD histograms into
+// a ROOT file on a separate thread such that the acquisition loop,
+// which only copies the histograms, never waits on the file. Each
+// snapshot is written into its own directory ("Snapshot0000", ...)
+// with its time [s] since the first snapshot; the histograms are
+// either cumulative or the change since the previous snapshot
+class AASnapshotWriter : public TObject
+{
+public:
+  AASnapshotWriter();
+  ~AASnapshotWriter();
+
+  // Start the writer thread for the specified file with cumulative
+  // (true) or delta (false) snapshots
+  void StartWriterThread(string, Bool_t);
+
+  // Write all submitted snapshots, close the file, and stop the
+  // writer thread
+  void StopWriterThread();
+
+#ifndef __CINT__
+  // Queue a snapshot for writing; never blocks on the writer
+  void SubmitSnapshot(SpectrumSnapshot *);
+#endif
+
+  Bool_t GetWriterThreadActive() {return WriterThread != NULL;}
+
+  ClassDef(AASnapshotWriter, 1);
+
+private:
+  void RunWriterThread();
+
+  string FileName;
+  Bool_t Cumulative;
+  Bool_t WriterThreadEnable;
+
+#ifndef __CINT__
+  boost::thread *WriterThread;
+  boost::mutex QueueMutex;
+  boost::condition_variable SnapshotQueued;
+  deque<SpectrumSnapshot *> Snapshots;
+
+  // The cumulative histograms of the previous snapshot, by name,
+  // from which the delta snapshots are computed
+  map<string, TH1 *> Previous;
+#endif
+};
+
+#endif
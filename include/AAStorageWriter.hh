@@ -0,0 +1,98 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AAStorageWriter_hh__
+#define __AAStorageWriter_hh__ 1
+
+// ROOT
+#include <TObject.h>
+
+// Boost
+#ifndef __CINT__
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+#endif
+
+// C++
+#include <vector>
+using namespace std;
+
+// ADAQ
+#include "ADAQWaveformData.hh"
+
+// ADAQAcquisition
+#include "AATypes.hh"
+
+#ifndef __CINT__
+// A single event queued for storage: the channel, the (optional)
+// digitized waveform, and a copy of the analyzed waveform data
+struct StorageRecord{
+  Int_t Channel;
+  Bool_t StoreWaveform;
+  vector<uint16_t> Waveform;
+  ADAQWaveformData Data;
+};
+#endif
+
+class AAStorageWriter : public TObject
+{
+public:
+  AAStorageWriter();
+  ~AAStorageWriter();
+
+  // Start the writer thread with a queue of the specified number of
+  // event records, each preallocated for the specified record length
+  void StartWriterThread(Int_t, Int_t);
+
+  // Write all queued events and then stop the writer thread
+  void StopWriterThread();
+
+  // Block until all queued events have been written
+  void Drain();
+
+#ifndef __CINT__
+  // Copy an event into the next free record of the queue; if the
+  // queue is full the caller blocks until the writer frees a record
+  // (a "backpressure" event) such that no data is ever dropped
+  void SubmitEvent(Int_t, vector<uint16_t> *, ADAQWaveformData *);
+#endif
+
+  Bool_t GetWriterThreadActive() {return WriterThread != NULL;}
+
+  StorageWriterStatusStruct GetStatus();
+
+  ClassDef(AAStorageWriter, 1);
+
+private:
+  void RunWriterThread();
+
+#ifndef __CINT__
+  boost::thread *WriterThread;
+  boost::mutex QueueMutex;
+  boost::condition_variable RecordQueued, RecordWritten;
+
+  // Fixed ring of preallocated records. The acquisition loop is the
+  // only producer and the writer thread the only consumer, so the
+  // record at the tail (head) is owned by the producer (consumer)
+  // outside of the mutex until the queue count is updated
+  vector<StorageRecord> Records;
+#endif
+
+  Int_t QueueCapacity, QueueHead, QueueTail, QueueCount;
+  Bool_t WriterThreadEnable, WriterBusy;
+
+  Long64_t BackpressureEvents, EventsWritten;
+  Long64_t BytesWritten, BytesAtLastStatus;
+  Double_t TimeAtLastStatus;
+};
+
+#endif
@@ -29,6 +29,9 @@ public:
   void HandleNumberEntries();
   void HandleRadioButtons();
   void HandleTextButtons();
+  void HandlePeakFitTimer();
+  void HandleStorageMonitorTimer();
+  void HandleDisplayTimer();
 
   ClassDef(AASubtabSlots, 1);
   
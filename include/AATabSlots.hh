@@ -31,6 +31,8 @@ public:
 
   void HandleCheckButtons();
   void HandleRadioButtons();
+
+  void HandleHVMonitorTimer();
   
   ClassDef(AATabSlots, 1);
   
@@ -25,6 +25,22 @@ enum{
   SettingsFileName_TEL_ID,
   AutoSaveSettings_CB_ID,
   AutoLoadSettings_CB_ID,
+  StorageCompressionAlgorithm_CBL_ID,
+  StorageCompressionLevel_NEL_ID,
+  StorageThreads_NEL_ID,
+  StorageBasketSize_NEL_ID,
+  StorageAutoFlush_NEL_ID,
+  StorageAutoSave_NEL_ID,
+  StorageRotate_CB_ID,
+  StorageRotateSize_NEL_ID,
+  StorageRotateTime_NEL_ID,
+  StorageRotateEvents_NEL_ID,
+  StorageSpool_CB_ID,
+  StorageSpoolSync_NEL_ID,
+  SpectrumSnapshots_CB_ID,
+  SpectrumSnapshotPeriod_NEL_ID,
+  SpectrumSnapshotCumulative_CB_ID,
+  StorageBenchmark_TB_ID,
   
   
   ////////////////////
@@ -266,6 +282,7 @@ enum{
   AQDataReductionEnable_CB_ID,
   AQDataReductionFactor_NEL_ID,
   DGZLEEnable_CB_ID,
+  DGZLEPulsePerSegment_CB_ID,
 
   // Spectrum subtab
 
@@ -295,6 +312,12 @@ enum{
   SpectrumCalibrationLoad_TB_ID,
   SpectrumCalibrationWrite_TB_ID,
 
+  SpectrumPeakFitEnable_CB_ID,
+  SpectrumPeakFitMin_NEL_ID,
+  SpectrumPeakFitMax_NEL_ID,
+  SpectrumPeakFitPeriod_NEL_ID,
+  SpectrumPeakFitToCalibration_TB_ID,
+
   // Pulse discrimination
   
   PSDChannel_CBL_ID,
@@ -311,6 +334,10 @@ enum{
   WaveformStoreRaw_CB_ID,
   WaveformStoreEnergyData_CB_ID,
   WaveformStorePSDData_CB_ID,
+  WaveformStoreReadoutBuffers_CB_ID,
+  WaveformStoreListMode_CB_ID,
+  WaveformStorePacked_CB_ID,
+  WaveformStoreDeltaCoded_CB_ID,
   
   WaveformOutput_RB_ID,
   SpectrumOutput_RB_ID,
@@ -372,4 +399,109 @@ struct CalibrationDataStruct{
   vector<double> PulseUnit;
 };
 
+struct PeakFitResultStruct{
+  bool Valid;
+  int Channel;
+  double Centroid;
+  double FWHM;
+  double Resolution;
+  double Counts;
+  double ChiSquareNDF;
+};
+
+struct StorageWriterStatusStruct{
+  int QueueDepth;
+  int QueueCapacity;
+  double BytesPerSecond;
+  long long BackpressureEvents;
+  long long EventsWritten;
+};
+
+// One reading of a high voltage channel by the HV monitoring thread
+// with its time [s] since monitoring was started
+struct HVMonitorSampleStruct{
+  double Time;
+  int Voltage;
+  int Current;
+};
+
+struct StorageBenchmarkStruct{
+  int Encoding;
+  int Algorithm;
+  int Level;
+  double WriteRate;
+  double CompressionRatio;
+};
+
+struct AnalysisPlanStruct{
+  bool Baseline;
+  bool PulseAnalysis;
+  bool PSDIntegrals;
+  bool ZLESegments;
+  bool Calibration;
+  bool Display;
+  long Cost;
+};
+
+// The raw readout buffer file (".adaq.raw") begins with a fixed-size
+// header holding the digitizer information necessary to decode the
+// buffers, followed by the SettingsSize bytes of the settings block,
+// which holds the AASettings object and its StreamerInfo (see
+// AARawFile). Each PC buffer read out from the digitizer is then
+// appended as a block header followed by ReadSize bytes
+
+const char RawFileMagic[8] = {'A','D','A','Q','R','A','W','\0'};
+const unsigned int RawFileVersion = 2;
+const unsigned int RawBlockMagic = 0xADAB10C5;
+
+struct RawFileHeaderStruct{
+  char Magic[8];
+  unsigned int Version;
+  char DGModelName[32];
+  int DGSerialNumber;
+  int DGBoardID;
+  int DGNumChannels;
+  int DGBitDepth;
+  int DGSamplingRate;
+  int DGTimeStampSize;
+  int DGFirmwareType;
+  int ZeroSuppression;
+  long long CreationTime;
+  unsigned int SettingsSize;
+};
+
+struct RawBlockHeaderStruct{
+  unsigned int Magic;
+  unsigned int ReadSize;
+  long long Time;
+};
+
+// The event spool (".spool") begins with the raw file header (with
+// the spool magic) and the settings block, padded to 8 bytes.
+// Each event is then appended as a record header followed by the
+// NumSamples waveform samples, padded such that each record is Size
+// bytes and a multiple of 8 bytes. The record magic is written last
+// and the checksum covers the record following the checksum, such
+// that a partially written record at the end of the spool (e.g. on
+// power loss) is recognized and discarded on recovery
+
+const char SpoolFileMagic[8] = {'A','D','A','Q','S','P','L','\0'};
+const unsigned int SpoolFileVersion = 2;
+const unsigned int SpoolRecordMagic = 0xADA5B001;
+
+struct SpoolRecordHeaderStruct{
+  unsigned int Magic;
+  unsigned int Checksum;
+  unsigned int Size;
+  int Channel;
+  int BoardID;
+  int NumSamples;
+  unsigned long long TimeStamp;
+  double Baseline;
+  double PulseHeight;
+  double PulseArea;
+  double PSDTotal;
+  double PSDTail;
+};
+
 #endif
@@ -17,9 +17,13 @@
 
 #ifndef __CINT__
 #include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
 #endif
 
 #include <vector>
+#include <map>
+#include <string>
+using namespace std;
 
 class ADAQBridge;
 class ADAQDigitizer;
@@ -30,6 +34,7 @@ class ADAQHighVoltage;
 
 #include "AAInterface.hh"
 #include "AASettings.hh"
+#include "AATypes.hh"
 
 class AAVMEManager : public TObject
 {
@@ -45,6 +50,11 @@ public:
 
   bool ProgramDigitizers();
 
+  // Force the next ProgramDigitizers() to reset the digitizer and
+  // write all settings; must be called whenever the digitizer's
+  // registers are written other than by ProgramDigitizers()
+  void InvalidateDGShadow();
+
   void SafelyDisconnectVMEBoards();
 
 
@@ -107,8 +117,30 @@ public:
 
   // General purpose VME functions
 
-  void StartHVMonitoring(AAInterface *);
+  // Start or stop the thread that reads the voltage and current of
+  // all HV channels every period [ms] into the HV monitor history
+  void StartHVMonitoring(Int_t);
   void StopHVMonitoring();
+  Bool_t GetHVMonitorActive() {return HVMonitorThread != NULL;}
+
+  // The most recent sample of a channel (false if none yet) and the
+  // channel's samples in the history, oldest first
+  Bool_t GetHVMonitorSample(Int_t, HVMonitorSampleStruct &);
+  void GetHVMonitorHistory(Int_t, vector<HVMonitorSampleStruct> &);
+
+  // Suspend HV monitoring (the history is kept) while the digitizer
+  // is programmed and read out, which is done without the link mutex.
+  // The pause is independent of starting and stopping monitoring such
+  // that monitoring started during acquisition remains paused
+  void PauseHVMonitoring(Bool_t);
+
+#ifndef __CINT__
+  // Held by the HV monitoring thread while it reads the HV board. The
+  // V6534 shares the VME bridge and the DT5790 the digitizer's link
+  // with the other boards, so any other access to the HV board, the
+  // digitizer, or the bridge must hold it while monitoring
+  boost::mutex &GetHVLinkMutex() {return HVLinkMutex;}
+#endif
     
 
   ClassDef(AAVMEManager, 1);
@@ -135,13 +167,34 @@ private:
   Bool_t HVLinkOpen;
   
   Bool_t VMEConnectionEstablished;
-  Bool_t HVMonitorEnable;
+  Bool_t HVMonitorEnable, HVMonitorPaused;
 
   ADAQBridge *BRMgr;
   ADAQDigitizer *DGMgr;
   ADAQHighVoltage *HVMgr;
 
   AASettings *TheSettings;
+
+  Bool_t DGSettingChanged(string, Int_t, Long64_t);
+
+  void RunHVMonitoring();
+
+  // The shadow of the digitizer settings as last programmed, keyed by
+  // setting name (with "[channel]" for channel settings)
+  map<string, Long64_t> DGShadow;
+  Bool_t DGShadowValid;
+
+  // A fixed-size ring of HV monitor samples per channel, with the
+  // index of the next sample to be written and the number of samples
+  Int_t HVMonitorPeriod;
+  vector<vector<HVMonitorSampleStruct> > HVMonitorHistory;
+  vector<Int_t> HVMonitorNext, HVMonitorCount;
+
+#ifndef __CINT__
+  boost::thread *HVMonitorThread;
+  boost::mutex HVMonitorMutex, HVLinkMutex;
+  boost::condition_variable HVMonitorWake;
+#endif
 };
 
 #endif
@@ -0,0 +1,356 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// name: AAWaveformPacking.hh
+// date: 18 Oct 26
+//
+// desc: Bit-packed encoding of digitized waveforms. Samples of an
+//       N-bit digitizer (e.g. 12-bit V1720, 14-bit V1725/DT5730)
+//       are stored with N rather than 16 bits each. The packed
+//       waveform is a vector of 32-bit words: the first word is the
+//       number of samples, followed by the samples packed least
+//       significant bit first. The functions are header-only such
+//       that ADAQ file readers may unpack waveforms by including this
+//       file alone.
+//
+//       Samples are processed in blocks of 32, which pack into
+//       exactly N words. The block kernels are instantiated for each
+//       supported bit depth such that all shifts are compile-time
+//       constants and the fixed-length loops are fully unrolled;
+//       blocks are independent of one another.
+//
+//       The delta codec is a lossless variable-width encoding for
+//       waveforms, which are mostly flat baseline with small
+//       sample-to-sample differences. Each sample is replaced by its
+//       difference to the previous sample, zigzag mapped to an
+//       unsigned value (0,-1,1,-2,... -> 0,1,2,3,...), and each block
+//       of 32 values is bit packed with the width of its largest
+//       value. The encoded waveform is the number of samples, the
+//       widths of all blocks (four 8-bit widths per word), and then
+//       the packed blocks.
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AAWaveformPacking_hh__
+#define __AAWaveformPacking_hh__ 1
+
+#ifndef __CINT__
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// C++
+#include <vector>
+#include <cstring>
+using namespace std;
+
+
+namespace AAWaveformPacking{
+
+  // Values of the "WaveformEncoding" parameter of the ADAQ file: the
+  // bits per sample for unpacked (16) and bit packed (10, 12, 14)
+  // waveforms or DeltaEncoding for the delta codec
+  const int DeltaEncoding = 1;
+  const int UnpackedEncoding = 16;
+
+  
+  // Pack 32 values into Bits words
+  template<int Bits, typename T>
+  inline void PackBlock(const T *Samples, uint32_t *Words)
+  {
+    const uint64_t Mask = ((uint64_t)1 << Bits) - 1;
+    uint64_t Accumulator = 0;
+    int Filled = 0, Word = 0;
+
+    for(int s=0; s<32; s++){
+      Accumulator |= (Samples[s] & Mask) << Filled;
+      Filled += Bits;
+      if(Filled >= 32){
+	Words[Word++] = (uint32_t)Accumulator;
+	Accumulator >>= 32;
+	Filled -= 32;
+      }
+    }
+  }
+
+
+  // Unpack Bits words into 32 values
+  template<int Bits, typename T>
+  inline void UnpackBlock(const uint32_t *Words, T *Samples)
+  {
+    const uint64_t Mask = ((uint64_t)1 << Bits) - 1;
+    uint64_t Accumulator = 0;
+    int Filled = 0, Word = 0;
+
+    for(int s=0; s<32; s++){
+      if(Filled < Bits){
+	Accumulator |= (uint64_t)Words[Word++] << Filled;
+	Filled += 32;
+      }
+      Samples[s] = (T)(Accumulator & Mask);
+      Accumulator >>= Bits;
+      Filled -= Bits;
+    }
+  }
+
+
+  template<int Bits>
+  inline void Pack(const uint16_t *Samples, uint32_t NumSamples, uint32_t *Words)
+  {
+    uint32_t Blocks = NumSamples / 32;
+    for(uint32_t b=0; b<Blocks; b++)
+      PackBlock<Bits>(Samples + 32*b, Words + Bits*b);
+
+    // The final partial block is zero padded to a full block but only
+    // the words holding samples are kept
+    uint32_t Remainder = NumSamples - 32*Blocks;
+    if(Remainder > 0){
+      uint16_t Block[32] = {0};
+      uint32_t Packed[Bits];
+      memcpy(Block, Samples + 32*Blocks, Remainder * sizeof(uint16_t));
+      PackBlock<Bits>(Block, Packed);
+      memcpy(Words + Bits*Blocks, Packed, ((Remainder*Bits + 31) / 32) * sizeof(uint32_t));
+    }
+  }
+
+
+  template<int Bits>
+  inline void Unpack(const uint32_t *Words, uint32_t NumWords, uint32_t NumSamples, uint16_t *Samples)
+  {
+    uint32_t Blocks = NumSamples / 32;
+    for(uint32_t b=0; b<Blocks; b++)
+      UnpackBlock<Bits>(Words + Bits*b, Samples + 32*b);
+
+    uint32_t Remainder = NumSamples - 32*Blocks;
+    if(Remainder > 0){
+      uint32_t Packed[Bits] = {0};
+      uint16_t Block[32];
+      uint32_t RemainderWords = NumWords - Bits*Blocks;
+      if(RemainderWords > Bits)
+	RemainderWords = Bits;
+      memcpy(Packed, Words + Bits*Blocks, RemainderWords * sizeof(uint32_t));
+      UnpackBlock<Bits>(Packed, Block);
+      memcpy(Samples + 32*Blocks, Block, Remainder * sizeof(uint16_t));
+    }
+  }
+
+
+  // Returns true if waveforms of the bit depth can be packed
+  inline bool IsPackable(int Bits)
+  { return (Bits == 10 or Bits == 12 or Bits == 14); }
+
+
+  // Pack a waveform of the specified bit depth
+  inline bool PackWaveform(const vector<uint16_t> &Waveform, int Bits,
+			   vector<uint32_t> &Packed)
+  {
+    if(!IsPackable(Bits))
+      return false;
+
+    uint32_t NumSamples = Waveform.size();
+    Packed.resize(1 + (NumSamples*Bits + 31) / 32);
+    Packed[0] = NumSamples;
+
+    if(NumSamples == 0)
+      return true;
+
+    const uint16_t *Samples = &Waveform[0];
+    uint32_t *Words = &Packed[1];
+
+    switch(Bits){
+    case 10: Pack<10>(Samples, NumSamples, Words); break;
+    case 12: Pack<12>(Samples, NumSamples, Words); break;
+    case 14: Pack<14>(Samples, NumSamples, Words); break;
+    }
+    return true;
+  }
+
+
+  // Unpack a waveform that was packed with the specified bit depth
+  inline bool UnpackWaveform(const vector<uint32_t> &Packed, int Bits,
+			     vector<uint16_t> &Waveform)
+  {
+    if(!IsPackable(Bits) or Packed.empty())
+      return false;
+
+    uint32_t NumSamples = Packed[0];
+    uint32_t NumWords = Packed.size() - 1;
+    if(NumWords < (NumSamples*Bits + 31) / 32)
+      return false;
+
+    Waveform.resize(NumSamples);
+
+    if(NumSamples == 0)
+      return true;
+
+    const uint32_t *Words = &Packed[1];
+    uint16_t *Samples = &Waveform[0];
+
+    switch(Bits){
+    case 10: Unpack<10>(Words, NumWords, NumSamples, Samples); break;
+    case 12: Unpack<12>(Words, NumWords, NumSamples, Samples); break;
+    case 14: Unpack<14>(Words, NumWords, NumSamples, Samples); break;
+    }
+    return true;
+  }
+
+
+  // The zigzag-mapped difference of two 16-bit samples requires at
+  // most 17 bits
+  const int MaxDeltaWidth = 17;
+
+  
+  inline void PackDeltaBlock(int Width, const uint32_t *Values, uint32_t *Words)
+  {
+    switch(Width){
+    case 0: break;
+    case 1: PackBlock<1>(Values, Words); break;
+    case 2: PackBlock<2>(Values, Words); break;
+    case 3: PackBlock<3>(Values, Words); break;
+    case 4: PackBlock<4>(Values, Words); break;
+    case 5: PackBlock<5>(Values, Words); break;
+    case 6: PackBlock<6>(Values, Words); break;
+    case 7: PackBlock<7>(Values, Words); break;
+    case 8: PackBlock<8>(Values, Words); break;
+    case 9: PackBlock<9>(Values, Words); break;
+    case 10: PackBlock<10>(Values, Words); break;
+    case 11: PackBlock<11>(Values, Words); break;
+    case 12: PackBlock<12>(Values, Words); break;
+    case 13: PackBlock<13>(Values, Words); break;
+    case 14: PackBlock<14>(Values, Words); break;
+    case 15: PackBlock<15>(Values, Words); break;
+    case 16: PackBlock<16>(Values, Words); break;
+    case 17: PackBlock<17>(Values, Words); break;
+    }
+  }
+
+
+  inline void UnpackDeltaBlock(int Width, const uint32_t *Words, uint32_t *Values)
+  {
+    switch(Width){
+    case 0: memset(Values, 0, 32 * sizeof(uint32_t)); break;
+    case 1: UnpackBlock<1>(Words, Values); break;
+    case 2: UnpackBlock<2>(Words, Values); break;
+    case 3: UnpackBlock<3>(Words, Values); break;
+    case 4: UnpackBlock<4>(Words, Values); break;
+    case 5: UnpackBlock<5>(Words, Values); break;
+    case 6: UnpackBlock<6>(Words, Values); break;
+    case 7: UnpackBlock<7>(Words, Values); break;
+    case 8: UnpackBlock<8>(Words, Values); break;
+    case 9: UnpackBlock<9>(Words, Values); break;
+    case 10: UnpackBlock<10>(Words, Values); break;
+    case 11: UnpackBlock<11>(Words, Values); break;
+    case 12: UnpackBlock<12>(Words, Values); break;
+    case 13: UnpackBlock<13>(Words, Values); break;
+    case 14: UnpackBlock<14>(Words, Values); break;
+    case 15: UnpackBlock<15>(Words, Values); break;
+    case 16: UnpackBlock<16>(Words, Values); break;
+    case 17: UnpackBlock<17>(Words, Values); break;
+    }
+  }
+
+  
+  // Encode a waveform with the delta codec
+  inline void EncodeWaveform(const vector<uint16_t> &Waveform, vector<uint32_t> &Encoded)
+  {
+    uint32_t NumSamples = Waveform.size();
+    uint32_t NumBlocks = (NumSamples + 31) / 32;
+    uint32_t WidthWords = (NumBlocks + 3) / 4;
+
+    // Size for the worst case and trim to the encoded size at the end
+    Encoded.assign(1 + WidthWords + MaxDeltaWidth*NumBlocks, 0);
+    Encoded[0] = NumSamples;
+
+    if(NumSamples == 0)
+      return;
+    
+    const uint16_t *Samples = &Waveform[0];
+    uint32_t *Words = &Encoded[1 + WidthWords];
+    uint32_t Values[32];
+    
+    for(uint32_t b=0; b<NumBlocks; b++){
+      uint32_t First = 32*b;
+      uint32_t Length = (NumSamples - First < 32) ? NumSamples - First : 32;
+
+      // The differences only depend on the input such that the loop
+      // has no carried dependency; the final partial block is zero
+      // padded, which costs no additional width
+      uint32_t Combined = 0;
+      for(uint32_t s=0; s<32; s++){
+	int32_t Delta = 0;
+	if(s < Length){
+	  uint32_t i = First + s;
+	  Delta = (int32_t)Samples[i] - ((i == 0) ? 0 : (int32_t)Samples[i-1]);
+	}
+	Values[s] = ((uint32_t)Delta << 1) ^ (uint32_t)(Delta >> 31);
+	Combined |= Values[s];
+      }
+
+      int Width = 0;
+      while(Combined >> Width)
+	Width++;
+
+      Encoded[1 + b/4] |= (uint32_t)Width << (8 * (b%4));
+
+      PackDeltaBlock(Width, Values, Words);
+      Words += Width;
+    }
+
+    Encoded.resize(Words - &Encoded[0]);
+  }
+
+
+  // Decode a waveform encoded with the delta codec
+  inline bool DecodeWaveform(const vector<uint32_t> &Encoded, vector<uint16_t> &Waveform)
+  {
+    if(Encoded.empty())
+      return false;
+    
+    uint32_t NumSamples = Encoded[0];
+    uint32_t NumBlocks = (NumSamples + 31) / 32;
+    uint32_t WidthWords = (NumBlocks + 3) / 4;
+
+    if(Encoded.size() < 1 + WidthWords)
+      return false;
+
+    Waveform.resize(NumSamples);
+
+    const uint32_t *Words = &Encoded[1 + WidthWords];
+    const uint32_t *End = &Encoded[0] + Encoded.size();
+    uint32_t Values[32];
+    int32_t Previous = 0;
+    
+    for(uint32_t b=0; b<NumBlocks; b++){
+      int Width = (Encoded[1 + b/4] >> (8 * (b%4))) & 0xff;
+      if(Width > MaxDeltaWidth or Words + Width > End)
+	return false;
+
+      UnpackDeltaBlock(Width, Words, Values);
+      Words += Width;
+
+      uint32_t First = 32*b;
+      uint32_t Length = (NumSamples - First < 32) ? NumSamples - First : 32;
+      for(uint32_t s=0; s<Length; s++){
+	Previous += (int32_t)(Values[s] >> 1) ^ -(int32_t)(Values[s] & 1);
+	Waveform[First + s] = (uint16_t)Previous;
+      }
+    }
+    
+    return true;
+  }
+}
+
+#endif
+
+#endif
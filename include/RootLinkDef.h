@@ -39,6 +39,12 @@
 #pragma link C++ class AATabSlots+;
 #pragma link C++ class AAVMEManager+;
 #pragma link C++ class AAEditor+;
+#pragma link C++ class AAPeakFitter+;
+#pragma link C++ class AAStorageWriter+;
+#pragma link C++ class AAEventSpool+;
+#pragma link C++ class AASnapshotWriter+;
+#pragma link C++ class AAHistogramPublisher+;
+#pragma link C++ class AARawFile+;
 
 // Create a special vector of uint16_t's. This type is used for
 // storing digitized waveform information and is necessary to define
@@ -46,6 +52,10 @@
 // (otherwise, we could simply have used the ROOT vector<Short_t> type)
 #pragma link C++ class std::vector<uint16_t>+;
 
+// Bit-packed waveforms (see AAWaveformPacking.hh) are stored as
+// vectors of 32-bit words
+#pragma link C++ class std::vector<uint32_t>+;
+
 // ADAQ classes
 #pragma link C++ class ADAQRootMeasParams+;
 
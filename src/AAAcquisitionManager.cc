@@ -11,6 +11,10 @@
 /////////////////////////////////////////////////////////////////////////////////
 
 #include <TSystem.h>
+#include <TROOT.h>
+#include <TBranch.h>
+#include <TStopwatch.h>
+#include <TParameter.h>
 
 #include <iostream>
 #include <sstream>
@@ -19,10 +23,15 @@
 #include <bitset>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <boost/predef/other/endian.h>
 
 #include "AAAcquisitionManager.hh"
 #include "AAVMEManager.hh"
 #include "AAGraphics.hh"
+#include "AARawFile.hh"
 
 
 AAAcquisitionManager *AAAcquisitionManager::TheAcquisitionManager = 0;
@@ -41,14 +50,36 @@ AAAcquisitionManager::AAAcquisitionManager()
     EventPointer(NULL), EventWaveform(NULL), Buffer(NULL),
     BufferSize(0), ReadSize(0), FPGAEvents(0), PCEvents(0),
     ReadoutType(0), ReadoutTypeBit(24), ReadoutTypeMask(0b1 << ReadoutTypeBit),
-    ZLEEventSizeMask(0x0fffffff), ZLEEventSize(0),
+    ZLEDataWords(NULL), ZLEEventSizeMask(0x0fffffff), ZLEEventSize(0),
     ZLESampleAMask(0x0000ffff), ZLESampleBMask(0xffff0000), 
     ZLENumWordMask(0x000fffff), ZLEControlMask(0xc0000000),
+    ZLEPulsePerSegment(false),
     EventCounter(0),
-    LLD(0), ULD(0), SampleHeight(0.), TriggerHeight(0.),
-    PulseHeight(0.), PulseArea(0.), PSDTotal(0.), PSDTail(0.), PeakPosition(0),
+    LLD(0), ULD(0), SampleHeight(0), TriggerHeight(0.),
+    PulseHeight(0.), PulseArea(0.), PSDTotal(0.), PSDTail(0.),
+    PulseHeightSum(0), PulseAreaSum(0), PSDTotalSum(0), PSDTailSum(0),
+    PeakPosition(0),
     RawTimeStamp(0), RateAccum(0),
-    FillWaveformTree(false), TheReadoutManager(new ADAQReadoutManager)
+    WaveformTree(NULL), FillWaveformTree(false),
+    IndexTree(NULL), IndexChannel(0), IndexEntry(0),
+    TimeIndexTree(NULL), TimeIndexInterval(1000), TimeIndexTimeStamp(0), TimeIndexOrder(0),
+    StorageWriter(new AAStorageWriter), StorageQueueCapacity(4096),
+    StorageBudgetTime(0),
+    StorageCompression(0), StorageAutoFlush(0), StorageAutoSave(0),
+    EventsSinceFlush(0), BytesSinceSave(0),
+    StorageIMT(false), StorageIMTFlushBytes(0), BytesSinceFlush(0),
+    ListModeStorage(false), ListModeTree(NULL), ListModeBlockSize(65536), ListModeEvents(0),
+    WaveformEncoding(AAWaveformPacking::UnpackedEncoding), ADAQFileOpen(false), StorageRotate(false), StorageRotateBytes(0), StorageRotateEvents(0),
+    StorageRotateTime(0.), RunID(0), FileSequence(0), FileEvents(0), FileTimeStart(0.),
+    NextADAQFileReady(false), PrepareThread(NULL), FinalizeThread(NULL), FileSettings(NULL),
+    StorageSpool(false), StorageSpoolSync(1000), EventSpool(NULL),
+    SnapshotWriter(new AASnapshotWriter), SnapshotPeriod(0.), SnapshotTimeStart(0.),
+    NextSnapshotTime(0.), SnapshotSequence(0),
+    HistogramPublisher(new AAHistogramPublisher), PublishTime(0),
+    BenchmarkEventCount(0), BenchmarkArmed(false),
+    RawFile(NULL), RawTimeStart(0), RawBytesWritten(0), RawBytesAtLastStatus(0),
+    RawTimeAtLastStatus(0.), RawWriteError(false),
+    TheReadoutManager(new ADAQReadoutManager)
 {
   if(TheAcquisitionManager)
     cout << "\nError! The AcquisitionManager was constructed twice!\n" << endl;
@@ -59,7 +90,11 @@ AAAcquisitionManager::AAAcquisitionManager()
 AAAcquisitionManager::~AAAcquisitionManager()
 {
   delete TheAcquisitionManager;
+  delete StorageWriter;
+  delete SnapshotWriter;
+  delete HistogramPublisher;
   delete TheReadoutManager;
+  delete FileSettings;
 }
 
 
@@ -79,8 +114,9 @@ void AAAcquisitionManager::Initialize()
     BaselineStop.push_back(0);
     BaselineLength.push_back(0);
     BaselineValue.push_back(0);
+    BaselineSum.push_back(0);
     
-    Polarity.push_back(0.);
+    Polarity.push_back(0);
 
     PeakPosition.push_back(0);
     PSDTotalAbsStart.push_back(0);
@@ -110,6 +146,9 @@ void AAAcquisitionManager::Initialize()
     PrevTimeStamp.push_back(0);
     PrevCorTimeStamp.push_back(0);
     TimeStampRollovers.push_back(0);
+
+    StoragePrescaleCount.push_back(0);
+    StorageBudget.push_back(0.);
   }
 }
 
@@ -138,6 +177,17 @@ void AAAcquisitionManager::PrepareAcquisition()
   AcquisitionTimeNow = 0;
   AcquisitionTimePrev = 0;
 
+  /////////////////////////
+  // Storage policy state
+
+  // The rate cap budgets start full such that each channel may
+  // store up to one second of waveform data immediately
+  for(Int_t ch=0; ch<NumDGChannels; ch++){
+    StoragePrescaleCount[ch] = 0;
+    StorageBudget[ch] = TheSettings->ChStorageRateCap[ch] * 1024.;
+  }
+  StorageBudgetTime = (Long64_t)gSystem->Now();
+
   ///////////////////////
   // Baseline calculation
 
@@ -202,11 +252,16 @@ void AAAcquisitionManager::PrepareAcquisition()
       BaselineLength[ch] = BaselineSamples;
       BaselineValue[ch] = 0.;
     }
+
+    // Guard against a zero-length baseline region since the baseline
+    // length is used as the normalization of the integer sums
+    if(BaselineLength[ch] < 1)
+      BaselineLength[ch] = 1;
     
     if(TheSettings->ChPosPolarity[ch])
-      Polarity[ch] = 1.;
+      Polarity[ch] = 1;
     else
-      Polarity[ch] = -1.;
+      Polarity[ch] = -1;
   }
 
 
@@ -227,16 +282,21 @@ void AAAcquisitionManager::PrepareAcquisition()
   // Waveform readout
   
   // Zero suppression waveforms: All channels (outer vector) are
-  // preallocated; the waveform vector (inner vector) memory is *not
-  // preallocated* since length of the waveform is unknown a priori
+  // preallocated; the waveform vector (inner vector) length is
+  // unknown a priori but cannot exceed the record length, which is
+  // therefore reserved such that decoding never reallocates
   if(TheSettings->ZeroSuppressionEnable){
     Waveforms.clear();
     Waveforms.resize(NumDGChannels);
 
     Waveforms4Storage.clear();
     Waveforms4Storage.resize(NumDGChannels);
+
+    for(Int_t ch=0; ch<NumDGChannels; ch++)
+      if(TheSettings->ChEnable[ch])
+	Waveforms[ch].reserve(TheSettings->RecordLength);
   }
-  
+
   // Raw and data reduction waveforms : All digitizer channels (outer
   // vector) are preallocated; the waveform vector (inner vector)
   // memory *is preallocated* since each channel has fixed size
@@ -267,9 +327,36 @@ void AAAcquisitionManager::PrepareAcquisition()
     }
   }
 
+  // Per-segment pulse analysis is only possible for STD firmware ZLE
+  // waveforms since the control words must be walked in the PC
+  // buffer; the segment vectors are reserved once here such that no
+  // allocation occurs inside the acquisition loop
+  ZLEPulsePerSegment = (TheSettings->ZeroSuppressionEnable and
+			TheSettings->ZLEPulsePerSegment and
+			UseSTDFirmware);
+  
+  ZLEPulseBaseline.clear();
+  ZLEPulseHeight.clear();
+  ZLEPulseArea.clear();
+  ZLEPulseOffset.clear();
+
+  // The sampling rate is in [MHz] and the time stamp unit in [ns]
+  ZLETicksPerSample = 1000. / (DGManager->GetSamplingRate() * DGManager->GetTimeStampUnit());
+  
+  if(ZLEPulsePerSegment){
+    Int_t MaxSegments = TheSettings->RecordLength/2 + 1;
+    ZLEPulseBaseline.reserve(MaxSegments);
+    ZLEPulseHeight.reserve(MaxSegments);
+    ZLEPulseArea.reserve(MaxSegments);
+    ZLEPulseOffset.reserve(MaxSegments);
+  }
+
   WaveformData.clear();
-  for(Int_t ch=0; ch<NumDGChannels; ch++)
+  WaveformData4Storage.clear();
+  for(Int_t ch=0; ch<NumDGChannels; ch++){
     WaveformData.push_back(new ADAQWaveformData);
+    WaveformData4Storage.push_back(new ADAQWaveformData);
+  }
 
 
   /////////////////////////
@@ -320,6 +407,20 @@ void AAAcquisitionManager::PrepareAcquisition()
     }
 
   }
+
+  // Setup the snapshots of the histograms being filled for display
+
+  if(TheSettings->SpectrumMode or TheSettings->PSDMode){
+    vector<TH1 *> Histograms;
+    if(TheSettings->SpectrumMode)
+      Histograms.assign(Spectrum_H.begin(), Spectrum_H.end());
+    else
+      Histograms.assign(PSDHistogram_H.begin(), PSDHistogram_H.end());
+    
+    HistogramPublisher->Setup(Histograms);
+    UpdateHistogramSnapshots();
+  }
+  PublishTime = (Long64_t)gSystem->Now();
   
   
   // GraphicsManager settings
@@ -328,6 +429,8 @@ void AAAcquisitionManager::PrepareAcquisition()
   // object settings that only need to be set a single time are
   // called once from this pre-acquisition method
   
+  AAGraphics::GetInstance()->SetupTiles();
+  
   if(TheSettings->WaveformMode)
     AAGraphics::GetInstance()->SetupWaveformGraphics(WaveformLength);
   else if(TheSettings->SpectrumMode)
@@ -379,6 +482,9 @@ void AAAcquisitionManager::PrepareAcquisition()
     DGManager->MallocDPPWaveforms(&PSDWaveforms, &PSDWaveformSize);
   }
   
+  // Determine which waveform analysis stages are required
+  BuildAnalysisPlan();
+  
   // Get the acquisition control setting
   Int_t AcqControl = TheSettings->AcquisitionControl;
   
@@ -398,7 +504,6 @@ void AAAcquisitionManager::StartAcquisition()
 {
   unsigned int hys = 0;
   ADAQDigitizer *DGManager = AAVMEManager::GetInstance()->GetDGManager();
-  
   AAGraphics *TheGraphicsManager = AAGraphics::GetInstance();
 
   // Prepare variables and the digitizer for data acquisitio
@@ -464,6 +569,16 @@ void AAAcquisitionManager::StartAcquisition()
       DGManager->GetDPPEvents(Buffer, ReadSize, PSDEvents, &NumPSDEvents[0]);
     }
 
+    // When storing raw readout buffers the entire PC buffer is
+    // appended to disk as read out; the events are decoded below for
+    // display and analysis only and are never stored individually
+    
+    if(RawFile and TheSettings->WaveformStorageEnable and ReadSize > 0)
+      WriteRawBuffer();
+
+    if(TheSettings->WaveformStorageEnable and !RawFile)
+      RefillStorageBudgets();
+
     //////////////////////////////
     // Event data readout loops //
     //////////////////////////////
@@ -502,16 +617,21 @@ void AAAcquisitionManager::StartAcquisition()
 	for(It = Waveforms[ch].begin(); It != Waveforms[ch].end(); It++)
 	  (*It) = 0;
 	
-	// Initialize enabled channel's waveforms to zero
-	for(It = Waveforms4Storage[ch].begin(); It != Waveforms4Storage[ch].end(); It++)
-	  (*It) = 0;
-	
 	// Initialize enabled channel's waveform data to zero
 	WaveformData[ch]->Initialize();
 
+	// The last event of each channel is the one drawn by the
+	// waveform display, which requires its baseline and peak
+	// position even if the analysis plan otherwise skips them
+	Bool_t DisplayEvent = (AnalysisPlan.Display and evt == PCEvents-1);
+	Bool_t AnalyzeBaseline = (AnalysisPlan.Baseline or DisplayEvent);
+	Bool_t AnalyzePulse = (AnalysisPlan.PulseAnalysis or DisplayEvent);
+
 	// Initialize local enabled channel's aggregators to zero
 	BaselineValue[ch] = PulseHeight = PulseArea = 0.;
 	PSDTotal = PSDTail = 0.;
+	BaselineSum[ch] = PulseHeightSum = 0;
+	PulseAreaSum = PSDTotalSum = PSDTailSum = 0;
 	
 	if(AcquisitionTimerEnable){
 	  
@@ -580,19 +700,25 @@ void AAAcquisitionManager::StartAcquisition()
 	
 	else{
 
-	  // Use ADAQDigitizer method to readout ZLE waveform directly
-	  // from the PC buffer into the Waveforms data member
-	  Bool_t ZLESuccess = DGManager->GetZLEWaveform(Buffer, evt, Waveforms);
+	  // Fill the EventInfo structure in order to obtain the
+	  // trigger time stamp and the pointer to the start of the
+	  // event in the PC buffer, from which the ZLE waveform of the
+	  // present channel is decoded directly
+	  EventPointer = NULL;
+	  DGManager->GetEventInfo(Buffer, ReadSize, evt, &EventInfo, &EventPointer);
 	  
-	  if(ZLESuccess != 0){
-	    cout << "\nAAAcquisitionManager::StartAcquisition() : You've encountered a serious error!\n"
-		 <<   "  There was an error reading out Event[" << evt << "] when using ZLE mode!\n"
-		 <<   "  This issue is likely due to using a RecordLength > 4030. This setting causes\n"
-		 <<   "  -- CAEN_DGTZ_GetNumEvents() to incorrectly return a '1'\n"
-		 <<   "  -- The readout PC buffer is not correctly filled causing algorithm to segfault\n"
-		 <<   "  CAEN has been contacted regarding this bug. ZSH (16 Oct 14)\n"
+	  // Segmentation fault protection
+	  if(EventPointer == NULL)
+	    continue;
+
+	  // The decoder is bounds-checked against the event size and
+	  // the readout size; it therefore also handles the
+	  // RecordLength > 4030 case that previously segfaulted
+	  // inside ADAQDigitizer::GetZLEWaveform()
+	  if(!DecodeZLEWaveform(ch)){
+	    cout << "\nAAAcquisitionManager::StartAcquisition() : Error! Could not decode the ZLE\n"
+		 <<   "  waveform of Channel[" << ch << "] in Event[" << evt << "]. Skipping!\n"
 		 << endl;
-	    
 	    continue;
 	  }
 	  //DGManager->PrintZLEEventInfo(Buffer, evt);
@@ -642,33 +768,44 @@ void AAAcquisitionManager::StartAcquisition()
 	      }
 	    }
 	    
-	    if(!TheSettings->DisplayNonUpdateable){
+	    if(AnalyzeBaseline){
 	      
-	      // Calculate the baseline by taking the average of all
-	      // samples that fall within the baseline calculation region
+	      // Sum all samples that fall within the baseline
+	      // calculation region; the average is not taken here in
+	      // order to keep the sample loop in integer arithmetic
 	      if(sample > BaselineStart[ch] and sample <= BaselineStop[ch])
-		BaselineValue[ch] += Waveforms[ch][sample] * 1.0 / BaselineLength[ch]; // [ADC]
+		BaselineSum[ch] += Waveforms[ch][sample]; // [ADC * samples]
 	      
 	      // Analyze the pulses to obtain pulse spectra
-	      else if(sample >= BaselineStop[ch]){
+	      else if(AnalyzePulse and sample >= BaselineStop[ch]){
 		
-		// Calculate the waveform sample distance from the baseline
-		SampleHeight = Polarity[ch] * (Waveforms[ch][sample] - BaselineValue[ch]);
+		// Calculate the waveform sample distance from the
+		// baseline. Scaling the sample by the baseline length
+		// (rather than dividing the baseline sum) keeps the
+		// result exact in integer units of [ADC * BaselineLength]
+		SampleHeight = Polarity[ch] * ((Long64_t)Waveforms[ch][sample] * BaselineLength[ch] - BaselineSum[ch]);
 		
 		// Simple algorithm to determine the pulse height [ADC]
 		// and peak position [sample] by looping over all samples
-		if(SampleHeight > PulseHeight){
-		  PulseHeight = SampleHeight;
+		if(SampleHeight > PulseHeightSum){
+		  PulseHeightSum = SampleHeight;
 		  PeakPosition[ch] = sample;
 		}
 		
 		// Integrate the "area under the pulse" by summing the
 		// all samples in the waveform. Note that the assumption
 		// is made that + and - noise will cancel
-		PulseArea += SampleHeight;
+		PulseAreaSum += SampleHeight;
 	      }
 	    }
 	  }// End sample loop
+
+	  // Convert the integer accumulators into the floating point
+	  // baseline [ADC], pulse height [ADC] and pulse area [ADC]
+	  // used for persistent storage and histogramming
+	  BaselineValue[ch] = BaselineSum[ch] * 1.0 / BaselineLength[ch];
+	  PulseHeight = PulseHeightSum * 1.0 / BaselineLength[ch];
+	  PulseArea = PulseAreaSum * 1.0 / BaselineLength[ch];
 	  
 	  // Computation of PSD integrals
 	  
@@ -687,17 +824,20 @@ void AAAcquisitionManager::StartAcquisition()
 	  }
 	  
 	  // Only take the time to compute PSD integrals if necessary
-	  if(TheSettings->PSDMode or TheSettings->WaveformStorePSDData){	    
+	  if(AnalysisPlan.PSDIntegrals){
 	    
 	    // The total PSD integral
 	    Int_t sample = PSDTotalAbsStart[ch];
 	    for(; sample<PSDTotalAbsStop[ch]; sample++)
-	      PSDTotal += Polarity[ch] * (Waveforms[ch][sample] - BaselineValue[ch]);
+	      PSDTotalSum += Polarity[ch] * ((Long64_t)Waveforms[ch][sample] * BaselineLength[ch] - BaselineSum[ch]);
 	    
 	    // The tail PSD integral
 	    sample = PSDTailAbsStart[ch];
 	    for(; sample<PSDTailAbsStop[ch]; sample++)
-	      PSDTail += Polarity[ch] * (Waveforms[ch][sample] - BaselineValue[ch]);
+	      PSDTailSum += Polarity[ch] * ((Long64_t)Waveforms[ch][sample] * BaselineLength[ch] - BaselineSum[ch]);
+
+	    PSDTotal = PSDTotalSum * 1.0 / BaselineLength[ch];
+	    PSDTail = PSDTailSum * 1.0 / BaselineLength[ch];
 
 	    // If running CAEN's DPP-PSD firmware and analyzing full
 	    // waveforms then convert CAEN's "short integral" (the
@@ -708,6 +848,11 @@ void AAAcquisitionManager::StartAcquisition()
 	    if(UsePSDFirmware)
 	      PSDTail = PSDTotal - PSDTail;
 	  }
+
+	  // Extract one pulse from each good-data segment of the ZLE
+	  // waveform in addition to the whole-waveform values above
+	  if(AnalysisPlan.ZLESegments)
+	    AnalyzeZLESegments(ch);
 	} // End STD or PSD waveform analysis
 	
 	// Analyze PSD list mode data
@@ -821,7 +966,7 @@ void AAAcquisitionManager::StartAcquisition()
 	  // class. This ensures that uncalibrated energy data is
 	  // written to the ADAQ file for later processing.
 
-	  if(CalibrationEnable[ch]){
+	  if(AnalysisPlan.Calibration and CalibrationEnable[ch]){
 	    if(TheSettings->SpectrumPulseHeight)
 	      PulseHeight = CalibrationCurves[ch]->Eval(PulseHeight);
 	    else
@@ -831,7 +976,32 @@ void AAAcquisitionManager::StartAcquisition()
 	  /////////////////////////////////////////
 	  // Post-readout graphical object handling
 	  
-	  if(TheSettings->SpectrumMode){
+	  if(TheSettings->SpectrumMode and ZLEPulsePerSegment){
+
+	    // Bin one pulse per ZLE segment. The segment values are
+	    // kept uncalibrated for storage so calibrate a copy here
+	    
+	    for(size_t seg=0; seg<ZLEPulseHeight.size(); seg++){
+	      
+	      Double_t Value = (TheSettings->SpectrumPulseHeight ?
+				ZLEPulseHeight[seg] : ZLEPulseArea[seg]);
+	      
+	      if(AnalysisPlan.Calibration and CalibrationEnable[ch])
+		Value = CalibrationCurves[ch]->Eval(Value);
+	      
+	      if(TheSettings->LDEnable){
+		if(Value > LLD and Value < ULD)
+		  Spectrum_H[ch]->Fill(Value);
+	      }
+	      else
+		Spectrum_H[ch]->Fill(Value);
+	    }
+	    
+	    if(TheSettings->LDTrigger and ch == TheSettings->LDChannel)
+	      FillWaveformTree = true;
+	  }
+	  
+	  else if(TheSettings->SpectrumMode){
 	    
 	    // Pulse height spectrum
 	    if(TheSettings->SpectrumPulseHeight){
@@ -939,10 +1109,25 @@ void AAAcquisitionManager::StartAcquisition()
 	  }
 	}
 	
+	// The persistence display accumulates every waveform rather
+	// than only drawing the last waveform of each readout; this is
+	// only done while it is continuously drawn (never in the
+	// updateable or ultra rate modes)
+	if(TheSettings->WaveformMode and TheSettings->WaveformPersistence and
+	   TheSettings->DisplayContinuous and
+	   (UseSTDFirmware or (UsePSDFirmware and AnalyzePSDWaveform)))
+	  TheGraphicsManager->AccumulatePersistence(Waveforms[ch], WaveformLength[ch]);
+	
+	// Keep a copy of the first event of each readout for the ADAQ
+	// file storage benchmark while capture is armed (see
+	// ArmStorageBenchmark() and BenchmarkStorage())
+	if(BenchmarkArmed and evt == 0)
+	  CaptureBenchmarkEvent(ch);
+	
 	///////////////////////////////////////
 	// Post-readout data persistent storage
 	
-	if(TheSettings->WaveformStorageEnable){
+	if(TheSettings->WaveformStorageEnable and !RawFile){
 	  
 	  // Skip this waveform if the pulse area/height does not fall
 	  // within the discrimnator window (LLD to ULD). 
@@ -955,73 +1140,56 @@ void AAAcquisitionManager::StartAcquisition()
 	    if(PulseArea > pow(2,16)-2)
 	      continue;
 
-	  // If storing raw waveforms to disk then copy the read out
-	  // waveforms vector ("Waveforms") to the vector whose
-	  // address is assigned to the waveforms branch in the ROOT
-	  // TTree in the ADAQ file ("Waveforms4Storage"). For this
-	  // for the presnet channel only.
+	  // If storing raw waveforms to disk then the read out
+	  // waveform ("Waveforms") is handed to the storage writer
+	  // along with the analyzed waveform data; the writer copies
+	  // both into the queue such that the readout loop may
+	  // immediately proceed to the next event. The channel's
+	  // storage policies are applied first such that a rejected
+	  // waveform is never copied while its event data is stored
 	  
-	  if(TheSettings->WaveformStoreRaw)
-	    Waveforms4Storage[ch] = Waveforms[ch];
+	  vector<uint16_t> *StoredWaveform = NULL;
+	  if(TheSettings->WaveformStoreRaw and StoreRawWaveform(ch))
+	    StoredWaveform = &Waveforms[ch];
 	  
 	  // If the user has specified to store ANY data at all then
-	  // fill the waveform tree via the readout manager
+	  // queue the event for the present channel's branches
+
+	  // When analyzing each ZLE segment as a pulse, one entry is
+	  // queued per segment holding that segment's energy data and
+	  // time stamped at the event time stamp plus the segment's
+	  // offset into the record; the raw waveform is only attached
+	  // to the first entry
+	  
+	  if(ZLEPulsePerSegment and 
+	     TheSettings->WaveformStoreEnergyData and
+	     !ZLEPulseHeight.empty()){
+	    
+	    for(size_t seg=0; seg<ZLEPulseHeight.size(); seg++){
+	      ULong64_t OffsetTicks = (ULong64_t)(ZLEPulseOffset[seg] * ZLETicksPerSample + 0.5);
+	      
+	      WaveformData[ch]->SetTimeStamp(CorrectedTimeStamp[ch] + OffsetTicks);
+	      WaveformData[ch]->SetBaseline(ZLEPulseBaseline[seg]);
+	      WaveformData[ch]->SetPulseHeight(ZLEPulseHeight[seg]);
+	      WaveformData[ch]->SetPulseArea(ZLEPulseArea[seg]);
+	      
+	      StorageWriter->SubmitEvent(ch, StoredWaveform, WaveformData[ch]);
+	      
+	      StoredWaveform = NULL;
+	    }
+	  }
 
-	  if(TheSettings->WaveformStoreRaw or
-	     TheSettings->WaveformStoreEnergyData or 
-	     TheSettings->WaveformStorePSDData)
-	    TheReadoutManager->GetWaveformTree()->Fill();
+	  else if(TheSettings->WaveformStoreRaw or
+		  TheSettings->WaveformStoreEnergyData or 
+		  TheSettings->WaveformStorePSDData)
+	    StorageWriter->SubmitEvent(ch, StoredWaveform, WaveformData[ch]);
 
 	  // Reset the bool used to determine if the LLD/ULD window
 	  // should be used as the "trigger" for writing waveforms
 
 	  FillWaveformTree = false;
-
-	  // **IMPORTANT**
-	  //
-	  // Presently, the entire TTree holding waveforms is filled
-	  // every event; this will add entries to all branches not
-	  // just the present channel. Thus, we must ensure that all
-	  // channel branches for waveforms and waveform data are zero
-	  // unless they have been filled above. To do this given the
-	  // present readout loop, we must re-initialize the present
-	  // waveform storage vector to zero. In the future, it would
-	  // be ideal to overhaul readout such that channel *branches*
-	  // are filled at each event and not the entire TTree.
-	  //
-	  // ZSH (27 Apr 24)
-
-	  Waveforms4Storage[ch].clear();
-	  WaveformData[ch]->Initialize();
 	}
 	
-	/////////////////////////////////
-	// Post-readout waveform plotting
-	
-	// Plot the waveform under specific criterion to minimize CPU
-	// intensity. Only plot the waveforms in continuous data
-	// acquisition mode and only plot the first waveform event in
-	// the case of many events in a single readout.
-	
-	if(TheSettings->WaveformMode){
-	  
-	  if(TheSettings->DisplayContinuous and evt == 0){
-
-	    if(UseSTDFirmware or (UsePSDFirmware and AnalyzePSDWaveform)){
-	      
-	      // Draw the digitized waveform
-	      TheGraphicsManager->PlotWaveforms(Waveforms, WaveformLength);
-	      
-	      // Draw graphical objects associated with the waveform
-	      TheGraphicsManager->DrawWaveformGraphics(BaselineValue,
-						       PeakPosition,
-						       PSDTotalAbsStart,
-						       PSDTotalAbsStop,
-						       PSDTailAbsStart,
-						       PSDTailAbsStop);
-	    }
-	  }
-	}
 	EventCounter++;
       } // End of the data readout loop over events
       
@@ -1039,36 +1207,107 @@ void AAAcquisitionManager::StartAcquisition()
     }// End of the data readout loop over channels
 
 
-    /////////////////////////////////////
-    // Post-data readout loop plotting //
-    /////////////////////////////////////
-
-    // Plot spectra or PSD histograms at certain event points if the
-    // display is set to "continuous mode"; if in "updateable mode",
-    // the "Update display" text button must be clicked for plotting
+    // Copy the spectra or PSD histograms for the snapshot writer
+    // once per snapshot period while an ADAQ file is open
+    
+    if(SnapshotWriter->GetWriterThreadActive() and
+       (Long64_t)gSystem->Now() / 1000. >= NextSnapshotTime)
+      TakeSpectrumSnapshot();
 
-    if(TheSettings->DisplayContinuous){
-      Int_t Rate = TheSettings->SpectrumRefreshRate;
-      
-      if(TheSettings->SpectrumMode){
-        if(EventCounter % Rate == 0)
-          TheGraphicsManager->PlotSpectrum(Spectrum_H[TheSettings->SpectrumChannel]);
+    // The display is drawn by the display timer at a fixed frame rate
+    // rather than here (see RefreshDisplay()) from the snapshots of
+    // the histograms, which are published at the same rate
+    
+    if(TheSettings->DisplayContinuous and
+       (TheSettings->SpectrumMode or TheSettings->PSDMode)){
+      Long64_t Now = (Long64_t)gSystem->Now();
+      if(Now - PublishTime >= 1000 / TheSettings->DisplayFrameRate){
+	HistogramPublisher->Publish();
+	PublishTime = Now;
       }
+    }
+    
+  } // End of the acquisition loop
+}
 
-      else if(TheSettings->RateMode){
-        if(EventCounter % Rate == 0 && RateAccum>1){ // Only plot after 2 points have been accumulated to avoid partial plots
-          TheGraphicsManager->PlotRate(Rate_Lead[TheSettings->RateChannel]);
-          RateAccum = 0;
-        }
-      }
+
+// Redraw the display from the latest acquisition data if the display
+// is set to "continuous mode"; if in "updateable mode", the "Update
+// display" text button must be clicked for plotting. This is called
+// by the display timer, which only fires from gSystem->ProcessEvents()
+// at the top of the acquisition loop, i.e. between readouts, such that
+// the waveforms (the last event of each channel) are never drawn while
+// being filled. The spectra and PSD histograms are drawn from the
+// latest published snapshot, which is never written while drawn
+void AAAcquisitionManager::RefreshDisplay()
+{
+  if(!AcquisitionEnable or !TheSettings->DisplayContinuous)
+    return;
+  
+  AAGraphics *TheGraphicsManager = AAGraphics::GetInstance();
+  
+  if((TheSettings->SpectrumMode or TheSettings->PSDMode) and
+     HistogramPublisher->Acquire())
+    UpdateHistogramSnapshots();
+  
+  if(TheSettings->WaveformMode){
+    
+    if(UseSTDFirmware or (UsePSDFirmware and AnalyzePSDWaveform)){
       
-      else if(TheSettings->PSDMode){
-        if(EventCounter % Rate == 0){
-          TheGraphicsManager->PlotPSDHistogram(PSDHistogram_H[TheSettings->PSDChannel]);
-        }
-      }
+      // Draw the persistence density of all waveforms or the
+      // digitized waveform
+      if(TheSettings->WaveformPersistence)
+	TheGraphicsManager->PlotPersistence();
+      else
+	TheGraphicsManager->PlotWaveforms(Waveforms, WaveformLength);
+      
+      // Draw graphical objects associated with the waveform
+      TheGraphicsManager->DrawWaveformGraphics(BaselineValue,
+					       PeakPosition,
+					       PSDTotalAbsStart,
+					       PSDTotalAbsStop,
+					       PSDTailAbsStart,
+					       PSDTailAbsStop);
     }
-  } // End of the acquisition loop
+  }
+  
+  else if(TheSettings->SpectrumMode){
+    if(TheSettings->DisplayTiled)
+      TheGraphicsManager->PlotSpectrumTiles(SpectrumSnapshot_H);
+    else
+      TheGraphicsManager->PlotSpectrum(SpectrumSnapshot_H[TheSettings->SpectrumChannel]);
+  }
+  
+  // Only plot after 2 points have been accumulated to avoid partial plots
+  else if(TheSettings->RateMode){
+    if(RateAccum > 1){
+      TheGraphicsManager->PlotRate(Rate_Lead[TheSettings->RateChannel]);
+      RateAccum = 0;
+    }
+  }
+  
+  else if(TheSettings->PSDMode){
+    if(TheSettings->DisplayTiled)
+      TheGraphicsManager->PlotPSDHistogramTiles(PSDHistogramSnapshot_H);
+    else
+      TheGraphicsManager->PlotPSDHistogram(PSDHistogramSnapshot_H[TheSettings->PSDChannel]);
+  }
+}
+
+
+// Point the display histograms at those of the snapshot most recently
+// taken from the histogram publisher
+void AAAcquisitionManager::UpdateHistogramSnapshots()
+{
+  SpectrumSnapshot_H.assign(Spectrum_H.size(), (TH1F *)NULL);
+  PSDHistogramSnapshot_H.assign(PSDHistogram_H.size(), (TH2F *)NULL);
+  
+  for(size_t ch=0; ch<Spectrum_H.size(); ch++){
+    if(TheSettings->SpectrumMode)
+      SpectrumSnapshot_H[ch] = (TH1F *)HistogramPublisher->GetSnapshot(ch);
+    else if(TheSettings->PSDMode)
+      PSDHistogramSnapshot_H[ch] = (TH2F *)HistogramPublisher->GetSnapshot(ch);
+  }
 }
 
 
@@ -1095,6 +1334,12 @@ void AAAcquisitionManager::StopAcquisition()
     DGManager->FreeDPPWaveforms(PSDWaveforms);
   }
 
+  // Write all events still queued for storage such that the storage
+  // writer thread no longer fills (or rotates) the active ADAQ file
+  // when its readout information is set below
+  if(ADAQFileOpen)
+    StorageWriter->StopWriterThread();
+  
   if(AcquisitionTimerEnable){
     
     // Set the information in the ADAQ file to signal that the
@@ -1109,11 +1354,14 @@ void AAAcquisitionManager::StopAcquisition()
     ARI->SetAcquisitionTime(TheSettings->AcquisitionTime);
     
     AcquisitionTimerEnable = false;
-    TheInterface->UpdateAfterAQTimerStopped(TheReadoutManager->GetADAQFileOpen());
+    TheInterface->UpdateAfterAQTimerStopped(GetADAQFileIsOpen());
   }
 
-  if(TheReadoutManager->GetADAQFileOpen())
+  if(GetADAQFileIsOpen())
     CloseADAQFile();
+
+  // Resume the HV monitoring paused for the acquisition
+  AAVMEManager::GetInstance()->PauseHVMonitoring(false);
 }
 
 
@@ -1279,6 +1527,9 @@ Bool_t AAAcquisitionManager::EnableCalibration(Int_t Channel)
     // the result into the channel's spectrum
     CalibrationEnable[Channel] = true;
 
+    if(AcquisitionEnable)
+      BuildAnalysisPlan();
+
     return true;
   }
   else
@@ -1302,6 +1553,9 @@ Bool_t AAAcquisitionManager::ResetCalibration(Int_t Channel)
   // indicating that the calibration manager will NOT be used within
   // the acquisition loop
   CalibrationEnable[Channel] = false;
+
+  if(AcquisitionEnable)
+    BuildAnalysisPlan();
   
   return true;
 }
@@ -1360,68 +1614,351 @@ Bool_t AAAcquisitionManager::WriteCalibration(Int_t Channel, string FileName)
 
 void AAAcquisitionManager::CreateADAQFile(string FileName)
 {
-  if(TheReadoutManager->GetADAQFileOpen())
+  if(GetADAQFileIsOpen())
     return;
+
+  if(TheSettings->SpectrumSnapshots)
+    StartSpectrumSnapshots(FileName);
   
-  // Create a new ADAQ file via the readout manager
-  TheReadoutManager->CreateFile(FileName);
+  if(TheSettings->WaveformStoreReadoutBuffers){
+    CreateRawFile(FileName);
+    return;
+  }
 
   ADAQDigitizer *DGManager = AAVMEManager::GetInstance()->GetDGManager();
-  
   Int_t DGChannels = DGManager->GetNumChannels();
-  for(Int_t ch=0; ch<DGChannels; ch++){
+  
+  // Set the storage settings common to all files of the run
+
+  StorageCompression = 0;
+  if(TheSettings->StorageCompressionAlgorithm > 0 and TheSettings->StorageCompressionLevel > 0)
+    StorageCompression = (TheSettings->StorageCompressionAlgorithm * 100 +
+			  TheSettings->StorageCompressionLevel);
+  
+  StorageAutoFlush = TheSettings->StorageAutoFlush;
+  StorageAutoSave = (Long64_t)TheSettings->StorageAutoSave * 1000000;
+
+  // Compress baskets on a pool of threads using ROOT's implicit
+  // multithreading, which is enabled for the duration of the run
+  StorageIMT = false;
+  if(TheSettings->StorageThreads > 0 and StorageCompression > 0){
+#ifdef R__USE_IMT
+    ROOT::EnableImplicitMT(TheSettings->StorageThreads);
+    StorageIMT = ROOT::IsImplicitMTEnabled();
+    
+    Int_t BasketSize = TheSettings->StorageBasketSize * 1024;
+    if(BasketSize < 1024)
+      BasketSize = 32000;
+
+    Int_t EnabledChannels = 0;
+    for(Int_t ch=0; ch<DGChannels; ch++)
+      if(TheSettings->ChEnable[ch])
+	EnabledChannels++;
+    if(EnabledChannels == 0)
+      EnabledChannels = 1;
+    
+    StorageIMTFlushBytes = (Long64_t)BasketSize * 3 / 4 * EnabledChannels;
+#else
+    cout << "\nAAAcquisitionManager::CreateADAQFile() : ROOT was built without implicit\n"
+	 <<   "  multithreading; baskets will be compressed by the storage writer thread.\n"
+	 << endl;
+#endif
+  }
+
+  // Compact list-mode storage is only possible when no waveforms are
+  // stored, e.g. DPP-PSD list mode or energy/PSD data only
+  ListModeStorage = (TheSettings->WaveformStoreListMode and 
+		     !TheSettings->WaveformStoreRaw);
+
+  // Raw waveforms are delta encoded or bit packed at the digitizer
+  // bit depth, if enabled and supported, into per-channel branches
+  // that (like the list-mode columns) are allocated once per run. The
+  // lossless delta codec takes precedence over bit packing
+  WaveformEncoding = AAWaveformPacking::UnpackedEncoding;
+  if(TheSettings->WaveformStoreRaw and !ListModeStorage){
+    if(TheSettings->WaveformStoreDeltaCoded)
+      WaveformEncoding = AAWaveformPacking::DeltaEncoding;
+    else if(TheSettings->WaveformStorePacked){
+      if(AAWaveformPacking::IsPackable(DGManager->GetNumADCBits()))
+	WaveformEncoding = DGManager->GetNumADCBits();
+      else
+	cout << "\nAAAcquisitionManager::CreateADAQFile() : Waveforms of the " << DGManager->GetNumADCBits() << "-bit digitizer\n"
+	     <<   "  cannot be bit packed and will be stored unpacked.\n"
+	     << endl;
+    }
+
+    if(WaveformEncoding != AAWaveformPacking::UnpackedEncoding){
+      PackedWaveforms4Storage.clear();
+      PackedWaveforms4Storage.resize(DGChannels);
+    }
+  }
+
+  // The list-mode columns are allocated once per run since the
+  // branches of every file of the run are bound to them
+  if(ListModeStorage){
+    ListModeEvents = 0;
+    ListModeTimeStamp.assign(ListModeBlockSize, 0);
+    ListModeChannel.assign(ListModeBlockSize, 0);
+    ListModeBaseline.assign(ListModeBlockSize, 0.);
+    ListModePulseHeight.assign(ListModeBlockSize, 0.);
+    ListModePulseArea.assign(ListModeBlockSize, 0.);
+    ListModePSDTotal.assign(ListModeBlockSize, 0.);
+    ListModePSDTail.assign(ListModeBlockSize, 0.);
+  }
+
+  // All files of a run share the run ID (the run start time) and are
+  // numbered sequentially from zero
+  
+  StorageRotate = (TheSettings->StorageRotate and 
+		   (TheSettings->StorageRotateSize > 0 or 
+		    TheSettings->StorageRotateTime > 0 or
+		    TheSettings->StorageRotateEvents > 0));
+  StorageRotateBytes = (Long64_t)TheSettings->StorageRotateSize * 1000000;
+  StorageRotateTime = TheSettings->StorageRotateTime * 60.;
+  StorageRotateEvents = TheSettings->StorageRotateEvents;
+  
+  RunID = time(NULL);
+  FileSequence = 0;
+  ADAQFileName = FileName;
+
+  // The spool header and settings are prepared once such that the
+  // spool of each file is created without touching the settings
+  StorageSpool = TheSettings->StorageSpool;
+  StorageSpoolSync = TheSettings->StorageSpoolSync;
+  if(StorageSpool){
+    FillRawFileHeader(SpoolHeader);
+    if(!AARawFile::WriteSettings(TheSettings, SpoolSettings)){
+      cout << "\nError! AAAcquisitionManager::CreateADAQFile() could not serialize\n"
+	   <<   "       the settings for the event spool. Acquiring without a spool!\n"
+	   << endl;
+      StorageSpool = false;
+    }
+  }
+  
+  // Copy the settings and digitizer information for the files of
+  // the run, which are opened ahead of time on a separate thread
+  if(FileSettings)
+    delete FileSettings;
+  FileSettings = new AASettings(*TheSettings);
+  
+  FillRawFileHeader(FileDGInfo);
+  FileDGROCFWRevision = DGManager->GetBoardROCFirmwareRevision();
+  FileDGAMCFWRevision = DGManager->GetBoardAMCFirmwareRevision();
+  
+  ADAQFileStruct First;
+  First.ReadoutManager = TheReadoutManager;
+  PrepareADAQFile(First, FileSequence);
+  ActivateADAQFile(First);
+  
+  ADAQFileOpen = TheReadoutManager->GetADAQFileOpen();
+  
+  // Start the storage writer thread with queue records preallocated
+  // to the longest waveform that can be read out
+  Int_t MaxRecordLength = TheSettings->RecordLength;
+  if(TheSettings->PSDFirmware)
+    for(Int_t ch=0; ch<DGChannels; ch++)
+      if(TheSettings->ChRecordLength[ch] > MaxRecordLength)
+	MaxRecordLength = TheSettings->ChRecordLength[ch];
+  
+  StorageWriter->StartWriterThread(StorageQueueCapacity, MaxRecordLength);
+
+  // Open the next file of the run in the background such that it is
+  // ready the moment the rotation threshold is reached
+  if(StorageRotate)
+    PrepareThread = new boost::thread(&AAAcquisitionManager::PrepareNextADAQFile, this);
+}
+
+
+void AAAcquisitionManager::PrepareADAQFile(ADAQFileStruct &File, Int_t Sequence)
+{
+  // Only the copies of the settings and digitizer information are
+  // read here since this is called on the preparation thread
+  Int_t DGChannels = FileDGInfo.DGNumChannels;
+
+  // Without rotation the file has exactly the user-specified name;
+  // with rotation the sequence number is appended to the name of
+  // every file, e.g. "Data_0000.adaq.root", "Data_0001.adaq.root"
+
+  File.FileName = ADAQFileName;
+  if(StorageRotate){
+    stringstream SS;
+    SS << "_" << setw(4) << setfill('0') << Sequence;
+
+    size_t Found = File.FileName.rfind(".adaq.root");
+    if(Found == string::npos)
+      Found = File.FileName.rfind(".root");
+    if(Found == string::npos)
+      Found = File.FileName.size();
+    File.FileName.insert(Found, SS.str());
+  }
+  
+  // Create a new ADAQ file via the readout manager
+  File.ReadoutManager->CreateFile(File.FileName);
+
+  // The file's event spool is named after the file, e.g.
+  // "Data.adaq.root.spool"; acquisition proceeds without a spool
+  // should it not be possible to create one
+  File.Spool = NULL;
+  if(StorageSpool){
+    File.Spool = new AAEventSpool;
+    if(!File.Spool->Open(File.FileName + ".spool", SpoolHeader,
+			 &SpoolSettings[0], SpoolSettings.size(),
+			 StorageSpoolSync)){
+      delete File.Spool;
+      File.Spool = NULL;
+    }
+  }
+
+  File.WaveformTree = File.ReadoutManager->GetWaveformTree();
+  File.IndexTree = NULL;
+  File.TimeIndexTree = NULL;
+  File.ListModeTree = NULL;
+
+  // Apply the compression settings to the file before creating the
+  // branches since ROOT branches take the file settings on creation
+  File.WaveformTree->GetCurrentFile()->SetCompressionSettings(StorageCompression);
+
+  File.ChannelBranches.clear();
+  File.ChannelBranches.resize(DGChannels);
+  
+  for(Int_t ch=0; ch<DGChannels and !ListModeStorage; ch++){
 
     // For each digitizer channel, create the two mandatory TTree branches:
     // -A branch to store the channel's digitized waveform
     // -A branch to store analyzed waveform data in 
+
+    Int_t FirstBranch = File.WaveformTree->GetListOfBranches()->GetEntriesFast();
+    
+    File.ReadoutManager->CreateWaveformTreeBranches(ch, 
+						    &Waveforms4Storage[ch],
+						    WaveformData4Storage[ch]);
+
+    // The standard waveform branch remains (empty) for compatibility
+    // with ADAQ file readers; the encoded waveform has its own branch
+    if(WaveformEncoding != AAWaveformPacking::UnpackedEncoding){
+      stringstream SS;
+      SS << "PackedWaveformCh" << ch;
+      File.WaveformTree->Branch(SS.str().c_str(), &PackedWaveforms4Storage[ch]);
+    }
+
+    // Keep the branches just created for this channel such that
+    // only they are filled for the channel's events
+    TObjArray *Branches = File.WaveformTree->GetListOfBranches();
+    for(Int_t b=FirstBranch; b<Branches->GetEntriesFast(); b++){
+      TBranch *Branch = (TBranch *)Branches->At(b);
+      Branch->SetCompressionSettings(StorageCompression);
+      File.ChannelBranches[ch].push_back(Branch);
+    }
+  }
+
+  // Apply the basket size to all waveform branches (and sub-branches)
+  if(FileSettings->StorageBasketSize > 0)
+    File.WaveformTree->SetBasketSize("*", FileSettings->StorageBasketSize * 1024);
+
+  // Create the index tree in the same directory (the ADAQ file) as
+  // the waveform tree such that it is written along with it
+  if(!ListModeStorage){
+    File.IndexTree = new TTree("WaveformIndex", "Channel and branch entry of each stored event");
+    File.IndexTree->SetDirectory(File.WaveformTree->GetDirectory());
+    File.IndexTree->Branch("Channel", &IndexChannel, "Channel/I");
+    File.IndexTree->Branch("Entry", &IndexEntry, "Entry/L");
+
+    // The time index shares the channel and entry of the index tree;
+    // "Order" is the entry of the event in the index tree. The time
+    // stamps of each channel increase monotonically
+    File.TimeIndexTree = new TTree("TimeIndex", "Time stamp and entry of every N'th event of each channel");
+    File.TimeIndexTree->SetDirectory(File.WaveformTree->GetDirectory());
+    File.TimeIndexTree->Branch("Channel", &IndexChannel, "Channel/I");
+    File.TimeIndexTree->Branch("TimeStamp", &TimeIndexTimeStamp, "TimeStamp/l");
+    File.TimeIndexTree->Branch("Entry", &IndexEntry, "Entry/L");
+    File.TimeIndexTree->Branch("Order", &TimeIndexOrder, "Order/L");
+  }
+
+  // In list mode each tree entry is a block of events with one
+  // fixed-width array branch (column) per stored quantity; the
+  // channel is stored in every event in place of the index tree
+  else{
+    TTree *ListModeTree = new TTree("ListMode", "Column-wise blocks of stored event data");
+    ListModeTree->SetDirectory(File.WaveformTree->GetDirectory());
+    ListModeTree->Branch("NumEvents", &ListModeEvents, "NumEvents/I");
+    ListModeTree->Branch("TimeStamp", &ListModeTimeStamp[0], "TimeStamp[NumEvents]/l");
+    ListModeTree->Branch("Channel", &ListModeChannel[0], "Channel[NumEvents]/b");
+    
+    if(FileSettings->WaveformStoreEnergyData){
+      ListModeTree->Branch("Baseline", &ListModeBaseline[0], "Baseline[NumEvents]/F");
+      ListModeTree->Branch("PulseHeight", &ListModePulseHeight[0], "PulseHeight[NumEvents]/F");
+      ListModeTree->Branch("PulseArea", &ListModePulseArea[0], "PulseArea[NumEvents]/F");
+    }
     
-    TheReadoutManager->CreateWaveformTreeBranches(ch, 
-						  &Waveforms4Storage[ch],
-						  WaveformData[ch]);
+    if(FileSettings->WaveformStorePSDData){
+      ListModeTree->Branch("PSDTotal", &ListModePSDTotal[0], "PSDTotal[NumEvents]/F");
+      ListModeTree->Branch("PSDTail", &ListModePSDTail[0], "PSDTail[NumEvents]/F");
+    }
+
+    File.ListModeTree = ListModeTree;
   }
+
+  // The run ID and file sequence number identify the files of a run
+  // and their order; they are written alongside the readout
+  // information since the ADAQReadoutInformation class (part of the
+  // ADAQ libraries) has no corresponding members
+  
+  TParameter<Long64_t> RunID_P("RunID", RunID);
+  TParameter<Int_t> FileSequence_P("FileSequence", Sequence);
+  File.WaveformTree->GetDirectory()->WriteTObject(&RunID_P);
+  File.WaveformTree->GetDirectory()->WriteTObject(&FileSequence_P);
+
+  // Likewise the waveform encoding: the bits per sample of unpacked
+  // or packed waveforms or the delta codec (see AAWaveformPacking.hh)
+  TParameter<Int_t> WaveformEncoding_P("WaveformEncoding", WaveformEncoding);
+  File.WaveformTree->GetDirectory()->WriteTObject(&WaveformEncoding_P);
+
+  // And the number of events of a channel between time index entries
+  TParameter<Int_t> TimeIndexInterval_P("TimeIndexInterval", TimeIndexInterval);
+  File.WaveformTree->GetDirectory()->WriteTObject(&TimeIndexInterval_P);
   
   // Get the pointer to the ADAQ readout information and fill with all
   // relevent information via the ADAQReadoutInformation::Set*() methods
   
-  ADAQReadoutInformation *ARI = TheReadoutManager->GetReadoutInformation();
+  ADAQReadoutInformation *ARI = File.ReadoutManager->GetReadoutInformation();
   
   // Set physical information about the digitizer device
 
-  ARI->SetDGModelName      (DGManager->GetBoardModelName());
-  ARI->SetDGSerialNumber   (DGManager->GetBoardSerialNumber());
-  ARI->SetDGNumChannels    (DGManager->GetNumChannels());
-  ARI->SetDGBitDepth       (DGManager->GetNumADCBits());
-  ARI->SetDGSamplingRate   (DGManager->GetSamplingRate());
-  ARI->SetDGROCFWRevision  (DGManager->GetBoardROCFirmwareRevision());
-  ARI->SetDGAMCFWRevision  (DGManager->GetBoardAMCFirmwareRevision());
-  if(TheSettings->STDFirmware)
+  ARI->SetDGModelName      (FileDGInfo.DGModelName);
+  ARI->SetDGSerialNumber   (FileDGInfo.DGSerialNumber);
+  ARI->SetDGNumChannels    (FileDGInfo.DGNumChannels);
+  ARI->SetDGBitDepth       (FileDGInfo.DGBitDepth);
+  ARI->SetDGSamplingRate   (FileDGInfo.DGSamplingRate);
+  ARI->SetDGROCFWRevision  (FileDGROCFWRevision);
+  ARI->SetDGAMCFWRevision  (FileDGAMCFWRevision);
+  if(FileSettings->STDFirmware)
     ARI->SetDGFWType       ("Standard");
-  else if(TheSettings->PSDFirmware)
+  else if(FileSettings->PSDFirmware)
     ARI->SetDGFWType       ("DPP-PSD");
 
   // Fill global acquisition settings
 
-  ARI->SetTriggerType          (TheSettings->TriggerTypeName);
-  ARI->SetTriggerEdge          (TheSettings->TriggerEdgeName);
-  ARI->SetAcquisitionType      (TheSettings->AcquisitionControlName);
-  ARI->SetDataReductionMode    (TheSettings->DataReductionEnable);
-  ARI->SetZeroSuppressionMode  (TheSettings->ZeroSuppressionEnable);
-  ARI->SetCoincidenceLevel     (TheSettings->TriggerCoincidenceLevel);
+  ARI->SetTriggerType          (FileSettings->TriggerTypeName);
+  ARI->SetTriggerEdge          (FileSettings->TriggerEdgeName);
+  ARI->SetAcquisitionType      (FileSettings->AcquisitionControlName);
+  ARI->SetDataReductionMode    (FileSettings->DataReductionEnable);
+  ARI->SetZeroSuppressionMode  (FileSettings->ZeroSuppressionEnable);
+  ARI->SetCoincidenceLevel     (FileSettings->TriggerCoincidenceLevel);
 
   // Fill firmware-agnostic channel-specific settings
 
-  ARI->SetChannelEnable    (TheSettings->ChEnable);
-  ARI->SetDCOffset         (TheSettings->ChDCOffset);
-  ARI->SetTrigger          (TheSettings->ChTriggerThreshold);
+  ARI->SetChannelEnable    (FileSettings->ChEnable);
+  ARI->SetDCOffset         (FileSettings->ChDCOffset);
+  ARI->SetTrigger          (FileSettings->ChTriggerThreshold);
   ARI->SetBaselineCalcMin  (BaselineStart);
   ARI->SetBaselineCalcMax  (BaselineStop);
-  if(TheSettings->STDFirmware){
-    ARI->SetPSDTotalStart    (TheSettings->ChPSDTotalStart);
-    ARI->SetPSDTotalStop     (TheSettings->ChPSDTotalStop);
-    ARI->SetPSDTailStart     (TheSettings->ChPSDTailStart);
-    ARI->SetPSDTailStop      (TheSettings->ChPSDTailStop);
+  if(FileSettings->STDFirmware){
+    ARI->SetPSDTotalStart    (FileSettings->ChPSDTotalStart);
+    ARI->SetPSDTotalStop     (FileSettings->ChPSDTotalStop);
+    ARI->SetPSDTailStart     (FileSettings->ChPSDTailStart);
+    ARI->SetPSDTailStop      (FileSettings->ChPSDTailStop);
   }
-  else if(TheSettings->PSDFirmware){
+  else if(FileSettings->PSDFirmware){
     ARI->SetPSDTotalStart    (PSDTotalAbsStart);
     ARI->SetPSDTotalStop     (PSDTotalAbsStop);
     ARI->SetPSDTailStart     (PSDTailAbsStart);
@@ -1430,45 +1967,1074 @@ void AAAcquisitionManager::CreateADAQFile(string FileName)
   
   // Fill CAEN standard firmware specific settings
   
-  if(TheSettings->STDFirmware){
-    ARI->SetRecordLength     (TheSettings->RecordLength);
-    ARI->SetPostTrigger      (TheSettings->PostTrigger);
+  if(FileSettings->STDFirmware){
+    ARI->SetRecordLength     (FileSettings->RecordLength);
+    ARI->SetPostTrigger      (FileSettings->PostTrigger);
     
-    ARI->SetZLEFwd           (TheSettings->ChZLEForward);
-    ARI->SetZLEBck           (TheSettings->ChZLEBackward);
-    ARI->SetZLEThreshold     (TheSettings->ChZLEThreshold);
+    ARI->SetZLEFwd           (FileSettings->ChZLEForward);
+    ARI->SetZLEBck           (FileSettings->ChZLEBackward);
+    ARI->SetZLEThreshold     (FileSettings->ChZLEThreshold);
   }
   
   // Fill CAEN DPP-PSD firmware specific settings
   
-  else if(TheSettings->PSDFirmware){
-    ARI->SetChRecordLength       (TheSettings->ChRecordLength);
-    ARI->SetChChargeSensitivity  (TheSettings->ChChargeSensitivity);
-    ARI->SetChPSDCut             (TheSettings->ChPSDCut);
-    ARI->SetChTriggerConfig      (TheSettings->ChTriggerConfig);
-    ARI->SetChTriggerValidation  (TheSettings->ChTriggerValidation);
-    ARI->SetChShortGate          (TheSettings->ChShortGate);
-    ARI->SetChLongGate           (TheSettings->ChLongGate);
-    ARI->SetChPreTrigger         (TheSettings->ChPreTrigger);
-    ARI->SetChGateOffset         (TheSettings->ChGateOffset);
+  else if(FileSettings->PSDFirmware){
+    ARI->SetChRecordLength       (FileSettings->ChRecordLength);
+    ARI->SetChChargeSensitivity  (FileSettings->ChChargeSensitivity);
+    ARI->SetChPSDCut             (FileSettings->ChPSDCut);
+    ARI->SetChTriggerConfig      (FileSettings->ChTriggerConfig);
+    ARI->SetChTriggerValidation  (FileSettings->ChTriggerValidation);
+    ARI->SetChShortGate          (FileSettings->ChShortGate);
+    ARI->SetChLongGate           (FileSettings->ChLongGate);
+    ARI->SetChPreTrigger         (FileSettings->ChPreTrigger);
+    ARI->SetChGateOffset         (FileSettings->ChGateOffset);
   }
     
   // Fill information regarding waveform acquisition
 
-  ARI->SetStoreRawWaveforms  (TheSettings->WaveformStoreRaw);
-  ARI->SetStoreEnergyData    (TheSettings->WaveformStoreEnergyData);
-  ARI->SetStorePSDData       (TheSettings->WaveformStorePSDData);
+  ARI->SetStoreRawWaveforms  (FileSettings->WaveformStoreRaw);
+  ARI->SetStoreEnergyData    (FileSettings->WaveformStoreEnergyData);
+  ARI->SetStorePSDData       (FileSettings->WaveformStorePSDData);
 }
 
 
 void AAAcquisitionManager::CloseADAQFile()
 {
-  if(!TheReadoutManager->GetADAQFileOpen())
+  // The final snapshot covers the time since the previous snapshot
+  if(SnapshotWriter->GetWriterThreadActive()){
+    TakeSpectrumSnapshot();
+    SnapshotWriter->StopWriterThread();
+  }
+  
+  if(RawFile){
+    CloseRawFile();
+    return;
+  }
+  
+  if(!ADAQFileOpen)
+    return;
+
+  // Write all events still queued for storage (e.g. the tail of a
+  // run stopped by the acquisition timer) before closing the file
+  StorageWriter->StopWriterThread();
+
+  // A next file of the run that was opened ahead of time but never
+  // used is closed and removed
+  if(PrepareThread){
+    PrepareThread->join();
+    delete PrepareThread;
+    PrepareThread = NULL;
+  }
+
+  if(NextADAQFileReady){
+    NextADAQFile.ReadoutManager->WriteFile();
+    gSystem->Unlink(NextADAQFile.FileName.c_str());
+    delete NextADAQFile.ReadoutManager;
+    if(NextADAQFile.Spool){
+      NextADAQFile.Spool->Close(true);
+      delete NextADAQFile.Spool;
+    }
+    NextADAQFileReady = false;
+  }
+
+  // The previous file of the run may still be being finalized
+  if(FinalizeThread){
+    FinalizeThread->join();
+    delete FinalizeThread;
+    FinalizeThread = NULL;
+  }
+
+  // Write the final, partially filled list-mode block
+  if(ListModeTree)
+    FillListModeBlock();
+  
+  FinalizeADAQFile(GetActiveADAQFile(), false);
+
+  // The file owns (and has deleted) the trees on closing
+  WaveformTree = NULL;
+  IndexTree = NULL;
+  TimeIndexTree = NULL;
+  ListModeTree = NULL;
+  ListModeStorage = false;
+  ChannelBranches.clear();
+  EventSpool = NULL;
+
+#ifdef R__USE_IMT
+  if(StorageIMT)
+    ROOT::DisableImplicitMT();
+#endif
+  StorageIMT = false;
+
+  ADAQFileOpen = false;
+}
+
+
+void AAAcquisitionManager::ActivateADAQFile(ADAQFileStruct &File)
+{
+  TheReadoutManager = File.ReadoutManager;
+  WaveformTree = File.WaveformTree;
+  IndexTree = File.IndexTree;
+  TimeIndexTree = File.TimeIndexTree;
+  ListModeTree = File.ListModeTree;
+  ChannelBranches = File.ChannelBranches;
+  EventSpool = File.Spool;
+  
+  ChannelEntries.assign(ChannelBranches.size(), 0);
+  EventsSinceFlush = BytesSinceFlush = BytesSinceSave = 0;
+
+#ifdef R__USE_IMT
+  if(StorageIMT){
+    if(WaveformTree) WaveformTree->SetImplicitMT(true);
+    if(IndexTree) IndexTree->SetImplicitMT(true);
+    if(TimeIndexTree) TimeIndexTree->SetImplicitMT(true);
+    if(ListModeTree) ListModeTree->SetImplicitMT(true);
+  }
+#endif
+
+  FileEvents = 0;
+  FileTimeStart = (Long64_t)gSystem->Now() / 1000.;
+}
+
+
+ADAQFileStruct AAAcquisitionManager::GetActiveADAQFile()
+{
+  ADAQFileStruct File;
+  File.ReadoutManager = TheReadoutManager;
+  File.WaveformTree = WaveformTree;
+  File.IndexTree = IndexTree;
+  File.TimeIndexTree = TimeIndexTree;
+  File.ListModeTree = ListModeTree;
+  File.ChannelBranches = ChannelBranches;
+  File.Spool = EventSpool;
+  return File;
+}
+
+
+void AAAcquisitionManager::FinalizeADAQFile(ADAQFileStruct File, Bool_t Delete)
+{
+  // Branches were filled individually so the waveform tree entry
+  // count must be set explicitly; this is the largest number of
+  // entries of any channel with the per-channel count given by the
+  // channel's branches and the event order by the index tree
+  if(File.WaveformTree)
+    File.WaveformTree->SetEntries(-1);
+
+  if(File.IndexTree)
+    File.IndexTree->Write("", TObject::kOverwrite);
+
+  if(File.TimeIndexTree)
+    File.TimeIndexTree->Write("", TObject::kOverwrite);
+
+  if(File.ListModeTree)
+    File.ListModeTree->Write("", TObject::kOverwrite);
+  
+  File.ReadoutManager->WriteFile();
+
+  // The spool is no longer needed once the file is on disk
+  if(File.Spool){
+    File.Spool->Close(true);
+    delete File.Spool;
+  }
+
+  if(Delete)
+    delete File.ReadoutManager;
+}
+
+
+TString AAAcquisitionManager::GetADAQFileComment()
+{
+  boost::lock_guard<boost::mutex> Lock(ReadoutManagerMutex);
+  return TheReadoutManager->GetFileComment();
+}
+
+
+void AAAcquisitionManager::SetADAQFileComment(TString AFC)
+{
+  boost::lock_guard<boost::mutex> Lock(ReadoutManagerMutex);
+  TheReadoutManager->SetFileComment(AFC);
+}
+
+
+void AAAcquisitionManager::PrepareNextADAQFile()
+{
+  NextADAQFile.ReadoutManager = new ADAQReadoutManager;
+  PrepareADAQFile(NextADAQFile, FileSequence + 1);
+  NextADAQFileReady = true;
+}
+
+
+Bool_t AAAcquisitionManager::RotationDue()
+{
+  if(StorageRotateEvents > 0 and FileEvents >= StorageRotateEvents)
+    return true;
+  
+  // The file size is the extent of the data flushed to disk
+  if(StorageRotateBytes > 0 and 
+     WaveformTree->GetCurrentFile()->GetEND() >= StorageRotateBytes)
+    return true;
+
+  if(StorageRotateTime > 0 and 
+     (Long64_t)gSystem->Now() / 1000. - FileTimeStart >= StorageRotateTime)
+    return true;
+  
+  return false;
+}
+
+
+void AAAcquisitionManager::RotateADAQFile()
+{
+  // The next file is normally opened well before it is needed; the
+  // writer thread only waits here if the thresholds are very small
+  if(PrepareThread){
+    PrepareThread->join();
+    delete PrepareThread;
+    PrepareThread = NULL;
+  }
+  
+  if(!NextADAQFileReady)
     return;
+
+  // Complete the current list-mode block in the file being closed
+  if(ListModeTree)
+    FillListModeBlock();
+
+  ADAQFileStruct PreviousFile = GetActiveADAQFile();
+
+  // The GUI thread accesses the file comment via the active readout
+  // manager, which is swapped here
+  {
+    boost::lock_guard<boost::mutex> Lock(ReadoutManagerMutex);
+    NextADAQFile.ReadoutManager->SetFileComment(TheReadoutManager->GetFileComment());
+    ActivateADAQFile(NextADAQFile);
+  }
+  NextADAQFileReady = false;
+  FileSequence++;
+  
+  // Writing the previous file (the final baskets, the tree headers,
+  // and the readout information) is performed on a separate thread
+  // such that the writer immediately continues with the next file
   
-  TheReadoutManager->WriteFile();
+  if(FinalizeThread){
+    FinalizeThread->join();
+    delete FinalizeThread;
+  }
+  FinalizeThread = new boost::thread(&AAAcquisitionManager::FinalizeADAQFile, this, PreviousFile, true);
+
+  PrepareThread = new boost::thread(&AAAcquisitionManager::PrepareNextADAQFile, this);
 }
 
+
+Bool_t AAAcquisitionManager::CreateRawFile(string FileName)
+{
+  // The raw file takes the name of the ADAQ file with the ".root"
+  // extension replaced by ".raw", e.g. "Data.adaq.raw"
+  
+  size_t Found = FileName.rfind(".root");
+  if(Found != string::npos and Found + 5 == FileName.size())
+    FileName.replace(Found, 5, ".raw");
+  else
+    FileName += ".raw";
+  
+  RawFile = fopen(FileName.c_str(), "wb");
+  if(RawFile == NULL){
+    cout << "\nError! AAAcquisitionManager::CreateRawFile() could not open\n"
+	 <<   "       the raw file '" << FileName << "' for writing!\n"
+	 << endl;
+    return false;
+  }
+
+  // A readout buffer may be several MB; a large stream buffer keeps
+  // the number of write system calls per buffer to a minimum
+  RawFileBuffer.resize(16 * 1024 * 1024);
+  setvbuf(RawFile, &RawFileBuffer[0], _IOFBF, RawFileBuffer.size());
+  
+  RawFileHeaderStruct Header;
+  FillRawFileHeader(Header);
+  memcpy(Header.Magic, RawFileMagic, sizeof(Header.Magic));
+  Header.Version = RawFileVersion;
+
+  // The settings are written with their StreamerInfo such that the
+  // converter recovers the complete acquisition configuration even
+  // if the AASettings class has since been changed
+  vector<char> SettingsBlock;
+  if(!AARawFile::WriteSettings(TheSettings, SettingsBlock)){
+    cout << "\nError! AAAcquisitionManager::CreateRawFile() could not serialize\n"
+	 <<   "       the settings into the raw file '" << FileName << "'!\n"
+	 << endl;
+    fclose(RawFile);
+    RawFile = NULL;
+    return false;
+  }
+  Header.SettingsSize = SettingsBlock.size();
+  
+  fwrite(&Header, sizeof(Header), 1, RawFile);
+  fwrite(&SettingsBlock[0], 1, SettingsBlock.size(), RawFile);
+
+  RawTimeStart = (Long64_t)gSystem->Now();
+  RawBytesWritten = RawBytesAtLastStatus = 0;
+  RawTimeAtLastStatus = RawTimeStart / 1000.;
+  RawWriteError = false;
+  
+  return true;
+}
+
+
+void AAAcquisitionManager::StartSpectrumSnapshots(string FileName)
+{
+  // The snapshots are written to a file named after the ADAQ file
+  // with the ".root" extension replaced, e.g. "Data.adaq.snapshots.root"
+  
+  size_t Found = FileName.rfind(".root");
+  if(Found != string::npos and Found + 5 == FileName.size())
+    FileName.replace(Found, 5, ".snapshots.root");
+  else
+    FileName += ".snapshots.root";
+
+  SnapshotPeriod = TheSettings->SpectrumSnapshotPeriod;
+  if(SnapshotPeriod < 1.)
+    SnapshotPeriod = 1.;
+  
+  SnapshotTimeStart = (Long64_t)gSystem->Now() / 1000.;
+  NextSnapshotTime = SnapshotTimeStart + SnapshotPeriod;
+  SnapshotSequence = 0;
+  
+  SnapshotWriter->StartWriterThread(FileName, TheSettings->SpectrumSnapshotCumulative);
+}
+
+
+void AAAcquisitionManager::TakeSpectrumSnapshot()
+{
+  Double_t Now = (Long64_t)gSystem->Now() / 1000.;
+  
+  // Snapshots remain aligned to the period even if the acquisition
+  // loop was delayed past one or more snapshot times
+  while(NextSnapshotTime <= Now)
+    NextSnapshotTime += SnapshotPeriod;
+
+  // Only the histograms being filled, i.e. the spectra in spectrum
+  // mode or the PSD histograms in PSD mode, of enabled channels are
+  // copied; the copies are owned by the snapshot writer
+  
+  SpectrumSnapshot *Snapshot = new SpectrumSnapshot;
+  Snapshot->Sequence = SnapshotSequence++;
+  Snapshot->Time = Now - SnapshotTimeStart;
+
+  for(size_t ch=0; ch<Spectrum_H.size(); ch++){
+    if(!TheSettings->ChEnable[ch])
+      continue;
+    
+    TH1 *Copy = NULL;
+    if(TheSettings->SpectrumMode and SpectrumExists[ch])
+      Copy = new TH1F(*Spectrum_H[ch]);
+    else if(TheSettings->PSDMode and PSDHistogramExists[ch])
+      Copy = new TH2F(*PSDHistogram_H[ch]);
+    
+    if(Copy){
+      Copy->SetDirectory(0);
+      Snapshot->Histograms.push_back(Copy);
+    }
+  }
+
+  SnapshotWriter->SubmitSnapshot(Snapshot);
+}
+
+
+void AAAcquisitionManager::FillRawFileHeader(RawFileHeaderStruct &Header)
+{
+  // The digitizer information necessary to decode the raw readout
+  // buffers, which is also the header of the event spool
+  
+  ADAQDigitizer *DGManager = AAVMEManager::GetInstance()->GetDGManager();
+  
+  memset(&Header, 0, sizeof(Header));
+  
+  string ModelName = DGManager->GetBoardModelName();
+  strncpy(Header.DGModelName, ModelName.c_str(), sizeof(Header.DGModelName)-1);
+  
+  Header.DGSerialNumber = DGManager->GetBoardSerialNumber();
+  Header.DGBoardID = DGManager->GetBoardID();
+  Header.DGNumChannels = DGManager->GetNumChannels();
+  Header.DGBitDepth = DGManager->GetNumADCBits();
+  Header.DGSamplingRate = DGManager->GetSamplingRate();
+  Header.DGTimeStampSize = DGManager->GetTimeStampSize();
+  Header.DGFirmwareType = (TheSettings->PSDFirmware) ? 1 : 0;
+  Header.ZeroSuppression = TheSettings->ZeroSuppressionEnable;
+  Header.CreationTime = time(NULL);
+}
+
+
+void AAAcquisitionManager::WriteRawBuffer()
+{
+  RawBlockHeaderStruct Block;
+  Block.Magic = RawBlockMagic;
+  Block.ReadSize = ReadSize;
+  Block.Time = (Long64_t)gSystem->Now() - RawTimeStart;
+  
+  if(fwrite(&Block, sizeof(Block), 1, RawFile) != 1 or
+     fwrite(Buffer, 1, ReadSize, RawFile) != ReadSize){
+    
+    // Report only the first failure (e.g. a full disk) rather than
+    // one per readout for the remainder of the run
+    if(!RawWriteError)
+      cout << "\nError! AAAcquisitionManager::WriteRawBuffer() failed to write a readout\n"
+	   <<   "       buffer to the raw file! Subsequent buffers may be lost.\n"
+	   << endl;
+    RawWriteError = true;
+    return;
+  }
+  
+  RawBytesWritten += sizeof(Block) + ReadSize;
+}
+
+
+void AAAcquisitionManager::CloseRawFile()
+{
+  if(RawFile == NULL)
+    return;
+  
+  fclose(RawFile);
+  RawFile = NULL;
+
+  // Release the stream buffer only after the stream is closed
+  vector<char>().swap(RawFileBuffer);
+}
+
+
+StorageWriterStatusStruct AAAcquisitionManager::GetStorageWriterStatus()
+{
+  if(RawFile == NULL)
+    return StorageWriter->GetStatus();
+  
+  StorageWriterStatusStruct Status = {0, 0, 0., 0, 0};
+
+  Double_t Now = (Long64_t)gSystem->Now() / 1000.;
+  Double_t Period = Now - RawTimeAtLastStatus;
+  Long64_t Bytes = RawBytesWritten;
+  
+  Status.BytesPerSecond = (Period > 0.) ? (Bytes - RawBytesAtLastStatus) / Period : 0.;
+  
+  RawBytesAtLastStatus = Bytes;
+  RawTimeAtLastStatus = Now;
+  
+  return Status;
+}
+
+Int_t AAAcquisitionManager::WriteStorageRecord(StorageRecord &Record)
+{
+  Int_t Bytes = 0;
+
+  // The event is safely spooled before it enters the ROOT baskets
+  if(EventSpool)
+    EventSpool->Append(Record);
+  
+  if(ListModeStorage)
+    Bytes = FillListModeEvent(Record);
+  
+  else{
+    Int_t Channel = Record.Channel;
+
+    if(WaveformEncoding != AAWaveformPacking::UnpackedEncoding){
+      Waveforms4Storage[Channel].clear();
+      if(!Record.StoreWaveform)
+	PackedWaveforms4Storage[Channel].clear();
+      else if(WaveformEncoding == AAWaveformPacking::DeltaEncoding)
+	AAWaveformPacking::EncodeWaveform(Record.Waveform, PackedWaveforms4Storage[Channel]);
+      else
+	AAWaveformPacking::PackWaveform(Record.Waveform, WaveformEncoding, PackedWaveforms4Storage[Channel]);
+    }
+    else if(Record.StoreWaveform)
+      Waveforms4Storage[Channel].assign(Record.Waveform.begin(), Record.Waveform.end());
+    else
+      Waveforms4Storage[Channel].clear();
+    
+    *WaveformData4Storage[Channel] = Record.Data;
+    
+    Bytes = FillWaveformBranches(Channel);
+  }
+
+  // Files are rotated between events on the writer thread such that
+  // no event is lost or split across files
+  if(StorageRotate){
+    FileEvents++;
+    if(RotationDue())
+      RotateADAQFile();
+  }
+  
+  return Bytes;
+}
+
+
+Int_t AAAcquisitionManager::FillWaveformBranches(Int_t Channel)
+{
+  Int_t Bytes = 0;
+  for(size_t b=0; b<ChannelBranches[Channel].size(); b++)
+    Bytes += ChannelBranches[Channel][b]->Fill();
+  BytesSinceFlush += Bytes;
+
+  IndexChannel = Channel;
+  IndexEntry = ChannelEntries[Channel]++;
+  Bytes += IndexTree->Fill();
+
+  if(IndexEntry % TimeIndexInterval == 0){
+    TimeIndexTimeStamp = WaveformData4Storage[Channel]->GetTimeStamp();
+    TimeIndexOrder = IndexTree->GetEntries() - 1;
+    TimeIndexTree->Fill();
+  }
+
+  // Branches are filled individually rather than via TTree::Fill()
+  // so the trees' auto-flush and auto-save are performed here
+  
+  EventsSinceFlush++;
+  BytesSinceSave += Bytes;
+  
+  Bool_t FlushDue = (StorageAutoFlush > 0 and EventsSinceFlush >= StorageAutoFlush);
+  if(StorageIMT and BytesSinceFlush >= StorageIMTFlushBytes)
+    FlushDue = true;
+  
+  if(FlushDue){
+    WaveformTree->FlushBaskets();
+    IndexTree->FlushBaskets();
+    TimeIndexTree->FlushBaskets();
+    EventsSinceFlush = BytesSinceFlush = 0;
+  }
+  
+  if(StorageAutoSave > 0 and BytesSinceSave >= StorageAutoSave){
+    WaveformTree->SetEntries(-1);
+    WaveformTree->AutoSave("SaveSelf");
+    IndexTree->AutoSave("SaveSelf");
+    TimeIndexTree->AutoSave("SaveSelf");
+    BytesSinceSave = 0;
+  }
+
+  return Bytes;
+}
+
+
+Int_t AAAcquisitionManager::FillListModeEvent(StorageRecord &Record)
+{
+  Int_t Event = ListModeEvents++;
+
+  ListModeTimeStamp[Event] = Record.Data.GetTimeStamp();
+  ListModeChannel[Event] = Record.Channel;
+
+  if(TheSettings->WaveformStoreEnergyData){
+    ListModeBaseline[Event] = Record.Data.GetBaseline();
+    ListModePulseHeight[Event] = Record.Data.GetPulseHeight();
+    ListModePulseArea[Event] = Record.Data.GetPulseArea();
+  }
+
+  if(TheSettings->WaveformStorePSDData){
+    ListModePSDTotal[Event] = Record.Data.GetPSDTotalIntegral();
+    ListModePSDTail[Event] = Record.Data.GetPSDTailIntegral();
+  }
+
+  if(ListModeEvents < ListModeBlockSize)
+    return 0;
+
+  return FillListModeBlock();
+}
+
+
+Int_t AAAcquisitionManager::FillListModeBlock()
+{
+  if(ListModeEvents == 0)
+    return 0;
+
+  // Each column is written as a single array of NumEvents values
+  Int_t Bytes = ListModeTree->Fill();
+  ListModeEvents = 0;
+
+  return Bytes;
+}
+
+
+void AAAcquisitionManager::ArmStorageBenchmark()
+{
+  BenchmarkEvents.clear();
+  BenchmarkEventCount = 0;
+  BenchmarkArmed = true;
+}
+
+
+void AAAcquisitionManager::CaptureBenchmarkEvent(Int_t Channel)
+{
+  const ULong64_t MaxEvents = 256;
+  
+  BenchmarkEvents.push_back(StorageRecord());
+  
+  StorageRecord &Record = BenchmarkEvents.back();
+  Record.Channel = Channel;
+  Record.StoreWaveform = true;
+  Record.Waveform.assign(Waveforms[Channel].begin(), Waveforms[Channel].end());
+  Record.Data = *WaveformData[Channel];
+  
+  // Capture disarms itself once enough events are held such that
+  // the readout loop only pays for the copies once per benchmark
+  if(++BenchmarkEventCount >= MaxEvents)
+    BenchmarkArmed = false;
+}
+
+
+void AAAcquisitionManager::RefillStorageBudgets()
+{
+  Long64_t Now = (Long64_t)gSystem->Now();
+  Double_t Elapsed = (Now - StorageBudgetTime) / 1000.; // [s]
+  StorageBudgetTime = Now;
+
+  // Each budget holds at most one second of the capped rate such that
+  // an idle channel cannot accumulate an arbitrarily large burst
+  for(size_t ch=0; ch<StorageBudget.size(); ch++){
+    Double_t Cap = TheSettings->ChStorageRateCap[ch] * 1024.; // [bytes/s]
+    if(Cap > 0.){
+      StorageBudget[ch] += Cap * Elapsed;
+      if(StorageBudget[ch] > Cap)
+	StorageBudget[ch] = Cap;
+    }
+  }
+}
+
+
+// Apply the channel's raw waveform storage policies to the present
+// event, returning true if its waveform should be stored. The energy
+// threshold is compared to the pulse height or area (whichever is
+// binned in the spectrum) of the whole waveform, which is in [ADC]
+// unless the channel's spectrum is being calibrated in spectrum
+// mode. The analysis plan computes these for every channel with a
+// threshold set; should the threshold be set before the plan is
+// rebuilt the policy is not applied. The prescale then counts only
+// waveforms above threshold and the rate cap is charged only for
+// waveforms that are actually stored
+Bool_t AAAcquisitionManager::StoreRawWaveform(Int_t Channel)
+{
+  Double_t Threshold = TheSettings->ChStorageThreshold[Channel];
+  if(Threshold > 0. and AnalysisPlan.PulseAnalysis){
+    Double_t Energy = (TheSettings->SpectrumPulseHeight ? PulseHeight : PulseArea);
+    if(Energy < Threshold)
+      return false;
+  }
+
+  Int_t Prescale = TheSettings->ChStoragePrescale[Channel];
+  if(Prescale > 1 and (StoragePrescaleCount[Channel]++ % Prescale) != 0)
+    return false;
+
+  if(TheSettings->ChStorageRateCap[Channel] > 0){
+    Double_t Bytes = Waveforms[Channel].size() * sizeof(uint16_t);
+    if(StorageBudget[Channel] < Bytes)
+      return false;
+    StorageBudget[Channel] -= Bytes;
+  }
+
+  return true;
+}
+
+
+Bool_t AAAcquisitionManager::BenchmarkStorage(vector<StorageBenchmarkStruct> &Results)
+{
+  Results.clear();
+  
+  if(BenchmarkEvents.empty())
+    return false;
+
+  // Benchmark whatever was captured if acquisition was stopped
+  // before the ring was filled
+  BenchmarkArmed = false;
+
+  ADAQDigitizer *DGManager = AAVMEManager::GetInstance()->GetDGManager();
+  
+  Int_t Level = TheSettings->StorageCompressionLevel;
+  if(Level < 1)
+    Level = 1;
+
+  Int_t BasketSize = TheSettings->StorageBasketSize * 1024;
+  if(BasketSize < 1024)
+    BasketSize = 32000;
+  
+  // The captured events are written repeatedly up to a fixed
+  // uncompressed volume such that the timing is not dominated by
+  // opening and closing the file
+  const Long64_t TargetBytes = 8 * 1024 * 1024;
+  
+  // Unencoded waveforms are written with each ROOT compression
+  // algorithm; bit-packed (if supported by the digitizer) and
+  // delta-encoded waveforms are encoded on the writing thread as
+  // during acquisition and written uncompressed or with LZ4
+  vector<pair<Int_t, Int_t> > Configurations;
+  
+  const Int_t NumAlgorithms = 5;
+  const Int_t Algorithms[NumAlgorithms] = {0, 1, 2, 4, 5};
+  for(Int_t a=0; a<NumAlgorithms; a++)
+    Configurations.push_back(make_pair(AAWaveformPacking::UnpackedEncoding, Algorithms[a]));
+
+  if(AAWaveformPacking::IsPackable(DGManager->GetNumADCBits()))
+    Configurations.push_back(make_pair(DGManager->GetNumADCBits(), 0));
+  
+  Configurations.push_back(make_pair(AAWaveformPacking::DeltaEncoding, 0));
+  Configurations.push_back(make_pair(AAWaveformPacking::DeltaEncoding, 4));
+  
+  string FileName = string(gSystem->TempDirectory()) + "/ADAQStorageBenchmark.root";
+
+  TDirectory *PrevDirectory = gDirectory;
+  
+  for(size_t c=0; c<Configurations.size(); c++){
+
+    Int_t Encoding = Configurations[c].first;
+    Int_t Algorithm = Configurations[c].second;
+    Int_t Compression = (Algorithm == 0) ? 0 : Algorithm * 100 + Level;
+    
+    vector<uint16_t> *Waveform = new vector<uint16_t>;
+    vector<uint32_t> *PackedWaveform = new vector<uint32_t>;
+    ADAQWaveformData *Data = new ADAQWaveformData;
+
+    TStopwatch Timer;
+    Timer.Start();
+
+    TFile *BenchmarkFile = new TFile(FileName.c_str(), "recreate", "", Compression);
+    TTree *BenchmarkTree = new TTree("WaveformTree", "ADAQ file storage benchmark");
+    if(Encoding == AAWaveformPacking::UnpackedEncoding)
+      BenchmarkTree->Branch("Waveform", &Waveform, BasketSize);
+    else
+      BenchmarkTree->Branch("PackedWaveform", &PackedWaveform, BasketSize);
+    BenchmarkTree->Branch("WaveformData", "ADAQWaveformData", &Data, BasketSize);
+
+    // The volume is counted as unencoded bytes, i.e. the bytes that
+    // are filled plus the bytes saved by the waveform encoding, such
+    // that the rates and ratios of all configurations are comparable
+    Long64_t Bytes = 0;
+    for(size_t e=0; Bytes<TargetBytes; e++){
+      StorageRecord &Record = BenchmarkEvents[e % BenchmarkEvents.size()];
+      
+      if(Encoding == AAWaveformPacking::UnpackedEncoding)
+	*Waveform = Record.Waveform;
+      else{
+	if(Encoding == AAWaveformPacking::DeltaEncoding)
+	  AAWaveformPacking::EncodeWaveform(Record.Waveform, *PackedWaveform);
+	else
+	  AAWaveformPacking::PackWaveform(Record.Waveform, Encoding, *PackedWaveform);
+	
+	Bytes += (Long64_t)(Record.Waveform.size() * sizeof(uint16_t))
+	  - (Long64_t)(PackedWaveform->size() * sizeof(uint32_t));
+      }
+      *Data = Record.Data;
+      Bytes += BenchmarkTree->Fill();
+    }
+    
+    BenchmarkTree->Write();
+    
+    Double_t ZipBytes = BenchmarkTree->GetZipBytes();
+    
+    BenchmarkFile->Close();
+    Timer.Stop();
+    
+    delete BenchmarkFile;
+    delete Waveform;
+    delete PackedWaveform;
+    delete Data;
+    
+    StorageBenchmarkStruct Result;
+    Result.Encoding = Encoding;
+    Result.Algorithm = Algorithm;
+    Result.Level = (Algorithm == 0) ? 0 : Level;
+    Result.WriteRate = (Timer.RealTime() > 0.) ? Bytes / 1.e6 / Timer.RealTime() : 0.;
+    Result.CompressionRatio = (ZipBytes > 0.) ? Bytes / ZipBytes : 1.;
+    Results.push_back(Result);
+  }
+  
+  gSystem->Unlink(FileName.c_str());
+
+  if(PrevDirectory)
+    PrevDirectory->cd();
+
+  return true;
+}
+
+
+Bool_t AAAcquisitionManager::LocateZLEChannel(Int_t Channel,
+					       uint32_t &Start,
+					       uint32_t &Stop)
+{
+  if(EventPointer == NULL)
+    return false;
+  
+  // The ZLE event in the PC buffer is composed of a 4-word header
+  // followed by one data block per enabled channel in ascending
+  // order. Each channel block begins with its size in words
+  // (including the size word) followed by a sequence of control
+  // words. Each control word flags the next segment as either
+  // skipped (no data words follow) or good (data words follow),
+  // with the number of 32-bit words (2 samples each) in the segment
+
+  ZLEDataWords = (uint32_t *)EventPointer;
+  ZLEEventSize = ZLEDataWords[0] & ZLEEventSizeMask;
+
+  // Never trust the event size beyond what was actually read out
+  uint32_t BufferWords = (Buffer + ReadSize - EventPointer) / sizeof(uint32_t);
+  if(ZLEEventSize > BufferWords)
+    ZLEEventSize = BufferWords;
+
+  if(ZLEEventSize < 4)
+    return false;
+  
+  // Channels 0-7 are flagged in the low byte of header word 1 and
+  // channels 8-15 in the high byte of header word 2
+  uint32_t ChannelMask = (ZLEDataWords[1] & 0xff)
+    | (((ZLEDataWords[2] >> 24) & 0xff) << 8);
+  if(!(ChannelMask & (1 << Channel)))
+    return false;
+  
+  // Skip over the data blocks of the preceding enabled channels
+  uint32_t Index = 4;
+  for(Int_t c=0; c<Channel and Index<ZLEEventSize; c++)
+    if(ChannelMask & (1 << c))
+      Index += ZLEDataWords[Index] & ZLEEventSizeMask;
+  
+  if(Index >= ZLEEventSize)
+    return false;
+  
+  Stop = Index + (ZLEDataWords[Index] & ZLEEventSizeMask);
+  if(Stop > ZLEEventSize)
+    Stop = ZLEEventSize;
+  Start = Index + 1;
+  
+  return true;
+}
+
+
+Bool_t AAAcquisitionManager::DecodeZLEWaveform(Int_t Channel)
+{
+  vector<uint16_t> &Waveform = Waveforms[Channel];
+  
+  uint32_t Start = 0, Stop = 0;
+  if(!LocateZLEChannel(Channel, Start, Stop)){
+    Waveform.clear();
+    return false;
+  }
+
+  // First pass over the control words only to size the waveform;
+  // the inner vector capacity was reserved to the record length in
+  // PrepareAcquisition() so this does not reallocate
+  
+  uint32_t NumSamples = 0;
+  for(uint32_t Index=Start; Index<Stop;){
+    uint32_t Control = ZLEDataWords[Index++];
+    if(!((Control & ZLEControlMask) >> 31))
+      continue;
+
+    uint32_t NumWords = Control & ZLENumWordMask;
+    if(Index + NumWords > Stop)
+      NumWords = Stop - Index;
+    
+    NumSamples += 2*NumWords;
+    Index += NumWords;
+  }
+  
+  Waveform.resize(NumSamples);
+  if(NumSamples == 0)
+    return true;
+
+  // Second pass unpacks the good-data segments contiguously. Sample
+  // A occupies the low and sample B the high 16 bits of each word
+  // such that, on little-endian hosts, the packed words already have
+  // the memory layout of the unpacked samples and a block copy
+  // (vectorized by the C library) replaces the per-sample unpacking
+  
+  uint16_t *Samples = &Waveform[0];
+  
+  for(uint32_t Index=Start; Index<Stop;){
+    uint32_t Control = ZLEDataWords[Index++];
+    if(!((Control & ZLEControlMask) >> 31))
+      continue;
+    
+    uint32_t NumWords = Control & ZLENumWordMask;
+    if(Index + NumWords > Stop)
+      NumWords = Stop - Index;
+    
+    uint32_t *Words = ZLEDataWords + Index;
+
+#if BOOST_ENDIAN_LITTLE_BYTE
+    memcpy(Samples, Words, NumWords * sizeof(uint32_t));
+#else
+    for(uint32_t w=0; w<NumWords; w++){
+      Samples[2*w] = (Words[w] & ZLESampleAMask);
+      Samples[2*w+1] = (Words[w] & ZLESampleBMask) >> 16;
+    }
+#endif
+    
+    Samples += 2*NumWords;
+    Index += NumWords;
+  }
+
+  return true;
+}
+
+
+void AAAcquisitionManager::AnalyzeZLESegments(Int_t Channel)
+{
+  ZLEPulseBaseline.clear();
+  ZLEPulseHeight.clear();
+  ZLEPulseArea.clear();
+  ZLEPulseOffset.clear();
+
+  uint32_t Index = 0, ChannelStop = 0;
+  if(!LocateZLEChannel(Channel, Index, ChannelStop))
+    return;
+
+  uint32_t *Words = ZLEDataWords;
+  Int_t Offset = 0;
+  
+  while(Index < ChannelStop){
+    
+    uint32_t Control = Words[Index++];
+    uint32_t NumWords = Control & ZLENumWordMask;
+    
+    // Bit 31 of the control word flags a good (stored) segment;
+    // skipped segments only advance the position in the waveform
+    if(!((Control & ZLEControlMask) >> 31)){
+      Offset += 2*NumWords;
+      continue;
+    }
+    
+    if(Index + NumWords > ChannelStop)
+      NumWords = ChannelStop - Index;
+    
+    Int_t NumSamples = 2*NumWords;
+    if(NumSamples == 0)
+      continue;
+    
+    // The baseline is taken from the look-back samples preceding
+    // the threshold crossing, limited to half of the segment
+    Int_t Length = TheSettings->ChZLEBackward[Channel];
+    if(Length > NumSamples/2)
+      Length = NumSamples/2;
+    if(Length < 1)
+      Length = 1;
+    
+    // Use the same integer accumulation as the full waveform
+    // analysis in units of [ADC * Length]
+    Int_t Sum = 0, HeightSum = 0;
+    Long64_t AreaSum = 0;
+    
+    for(Int_t sample=0; sample<NumSamples; sample++){
+      uint32_t Word = Words[Index + sample/2];
+      Int_t Value = (sample % 2 == 0) ? 
+	(Word & ZLESampleAMask) : ((Word & ZLESampleBMask) >> 16);
+      
+      if(sample < Length)
+	Sum += Value;
+      else{
+	Int_t Height = Polarity[Channel] * (Value * Length - Sum);
+	if(Height > HeightSum)
+	  HeightSum = Height;
+	AreaSum += Height;
+      }
+    }
+    
+    ZLEPulseBaseline.push_back(Sum * 1.0 / Length);
+    ZLEPulseHeight.push_back(HeightSum * 1.0 / Length);
+    ZLEPulseArea.push_back(AreaSum * 1.0 / Length);
+    ZLEPulseOffset.push_back(Offset);
+    
+    Index += NumWords;
+    Offset += NumSamples;
+  }
+}
+
+
+void AAAcquisitionManager::BuildAnalysisPlan()
+{
+  ADAQDigitizer *DGManager = AAVMEManager::GetInstance()->GetDGManager();
+
+  AnalysisPlanStruct Plan = {false, false, false, false, false, false, 0};
+  
+  // Waveform analysis is only possible when waveforms are read out
+  // and, except as required by the raw waveform storage policies, is
+  // never performed in the nonupdateable (ultra rate) mode
+  
+  Bool_t AnalyzeWaveforms = (UseSTDFirmware or (UsePSDFirmware and AnalyzePSDWaveform));
+  
+  if(AnalyzeWaveforms and !TheSettings->DisplayNonUpdateable){
+
+    // Raw readout buffers are stored undecoded and analyzed offline
+    Bool_t Storage = (TheSettings->WaveformStorageEnable and
+		      !TheSettings->WaveformStoreReadoutBuffers);
+    Bool_t StoreEnergy = Storage and TheSettings->WaveformStoreEnergyData;
+    Bool_t StorePSD = Storage and TheSettings->WaveformStorePSDData;
+
+    // PSD integrals are consumed by the PSD histogram and storage
+    Plan.PSDIntegrals = TheSettings->PSDMode or StorePSD;
+    
+    // Pulse height/area are consumed by the spectrum, by storage, and
+    // by the level discriminator gating storage; STD firmware PSD
+    // integrals are positioned relative to the peak found here
+    Plan.PulseAnalysis = (TheSettings->SpectrumMode or StoreEnergy or 
+			  (Storage and TheSettings->LDEnable) or
+			  (Plan.PSDIntegrals and UseSTDFirmware));
+
+    // The baseline is always written to storage and underlies the
+    // pulse and PSD analysis
+    Plan.Baseline = (Plan.PulseAnalysis or Plan.PSDIntegrals or Storage);
+
+    // The waveform display draws the trigger line and baseline box
+    // relative to the baseline and the PSD limits relative to the
+    // peak position of the last event of each channel per readout;
+    // the baseline and pulse stages are run for that event only
+    Plan.Display = TheSettings->WaveformMode;
+    
+    Plan.ZLESegments = ZLEPulsePerSegment and (TheSettings->SpectrumMode or StoreEnergy);
+    
+    // Calibration is only applied to binned spectrum values
+    if(TheSettings->SpectrumMode)
+      for(Int_t ch=0; ch<DGManager->GetNumChannels(); ch++)
+	if(CalibrationEnable[ch])
+	  Plan.Calibration = true;
+  }
+
+  // The raw waveform energy threshold policy compares the pulse
+  // height/area of every waveform of a channel with a threshold set
+  // against it, and so requires the pulse analysis in all display
+  // modes (including the ultra rate mode)
+  if(AnalyzeWaveforms and TheSettings->WaveformStorageEnable and
+     TheSettings->WaveformStoreRaw and !TheSettings->WaveformStoreReadoutBuffers)
+    for(Int_t ch=0; ch<DGManager->GetNumChannels(); ch++)
+      if(TheSettings->ChEnable[ch] and TheSettings->ChStorageThreshold[ch] > 0.)
+	Plan.Baseline = Plan.PulseAnalysis = true;
+  
+  // Estimate the number of per-sample operations of each stage
+  // summed over enabled channels. Baseline samples cost a single
+  // addition; pulse and PSD samples a multiply, subtraction,
+  // comparison and addition; calibration a TGraph interpolation. The
+  // display stage runs once per channel per readout rather than per
+  // event and so is not included
+  
+  for(Int_t ch=0; ch<DGManager->GetNumChannels(); ch++){
+    if(!TheSettings->ChEnable[ch])
+      continue;
+    
+    Long64_t Samples = (UseSTDFirmware ? 
+			TheSettings->RecordLength : TheSettings->ChRecordLength[ch]);
+    
+    if(Plan.Baseline)
+      Plan.Cost += BaselineLength[ch];
+    
+    if(Plan.PulseAnalysis and Samples > BaselineStop[ch])
+      Plan.Cost += 4 * (Samples - BaselineStop[ch]);
+    
+    if(Plan.PSDIntegrals)
+      Plan.Cost += 4 * ((TheSettings->ChPSDTotalStop[ch] - TheSettings->ChPSDTotalStart[ch]) +
+			(TheSettings->ChPSDTailStop[ch] - TheSettings->ChPSDTailStart[ch]));
+    
+    if(Plan.ZLESegments)
+      Plan.Cost += 4 * Samples;
+    
+    if(Plan.Calibration and CalibrationEnable[ch])
+      Plan.Cost += 10;
+  }
+  
+  AnalysisPlan = Plan;
+  
+  TheInterface->UpdateAnalysisPlan(AnalysisPlan);
+}
+
+
 void AAAcquisitionManager::SetupRateVector()
 {
   TheSettings->RateNumPeriods = (int)(TheSettings->RateDisplayPeriod/TheSettings->RateIntegrationPeriod);
@@ -15,6 +15,7 @@
 #include "AAChannelSlots.hh"
 #include "AAInterface.hh"
 #include "AAVMEManager.hh"
+#include "AAAcquisitionManager.hh"
 
 AAChannelSlots::AAChannelSlots(AAInterface *TheInterface)
   : TI(TheInterface)
@@ -60,6 +61,12 @@ void AAChannelSlots::HandleNumberEntries()
 
   TI->SaveSettings();
 
+  // Channel settings such as the raw waveform storage threshold may
+  // be changed during acquisition and determine the analysis stages
+  AAAcquisitionManager *TheACQManager = AAAcquisitionManager::GetInstance();
+  if(TheACQManager->GetAcquisitionEnable())
+    TheACQManager->BuildAnalysisPlan();
+
   AAVMEManager *TheVMEManager = AAVMEManager::GetInstance();
 
   // x720 + DPP-PSD specific settings
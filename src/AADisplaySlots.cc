@@ -73,15 +73,26 @@ void AADisplaySlots::HandleTextButtons()
       
       TI->SetAcquisitionWidgetState(false, kButtonDisabled);
 
+      // HV monitoring is paused until acquisition is stopped since the
+      // HV board shares the link used to program and read out the
+      // digitizer (see AAAcquisitionManager::StopAcquisition())
+      TheVMEManager->PauseHVMonitoring(true);
+      
       // Program the digitizers with the current settings
       bool DGProgramSuccess = TheVMEManager->ProgramDigitizers();
       
       bool DGChannelEnableSuccess = TheVMEManager->GetDGManager()->CheckForEnabledChannels();
       
-      if(DGProgramSuccess and DGChannelEnableSuccess)
+      // The display timer must be started before acquisition since
+      // the acquisition loop does not return until it is stopped
+      if(DGProgramSuccess and DGChannelEnableSuccess){
+	TI->DisplayTimer->Start(1000 / TI->TheSettings->DisplayFrameRate, kFALSE);
         TheACQManager->StartAcquisition();
-      else
+      }
+      else{
         TI->SetAcquisitionWidgetState(true, kButtonUp);
+        TheVMEManager->PauseHVMonitoring(false);
+      }
       break;
     }
     break;
@@ -102,6 +113,12 @@ void AADisplaySlots::HandleTextButtons()
         // Possibly implement future ability to update waveform manually
       }
       
+      else if(TI->TheSettings->SpectrumMode and TI->TheSettings->DisplayTiled)
+        AAGraphics::GetInstance()->PlotSpectrumTiles(TheACQManager->GetSpectra());
+      
+      else if(TI->TheSettings->PSDMode and TI->TheSettings->DisplayTiled)
+        AAGraphics::GetInstance()->PlotPSDHistogramTiles(TheACQManager->GetPSDHistograms());
+      
       else if(TI->TheSettings->SpectrumMode and !TI->TheSettings->DisplayNonUpdateable){
         int Channel = TI->TheSettings->SpectrumChannel;
         TH1F *Spectrum_H = TheACQManager->GetSpectrum(Channel);
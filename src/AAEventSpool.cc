@@ -0,0 +1,256 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// POSIX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// C++
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+// ADAQAcquisition
+#include "AAEventSpool.hh"
+
+
+// The spool file is allocated in chunks as it grows
+const Long64_t SpoolChunkSize = 64 * 1024 * 1024;
+
+
+AAEventSpool::AAEventSpool()
+  : FileName(""), FileDescriptor(-1),
+    SpoolMap(NULL), MapSize(0), FileSize(0),
+    WrittenBytes(0), SyncedBytes(0),
+    SyncPeriod(1000), SyncThreadEnable(false), SpoolError(false),
+    SyncThread(NULL)
+{;}
+
+
+AAEventSpool::~AAEventSpool()
+{
+  Close(false);
+}
+
+
+Bool_t AAEventSpool::Open(string Name,
+			  RawFileHeaderStruct Header,
+			  const char *Settings,
+			  UInt_t SettingsSize,
+			  Int_t Period)
+{
+  if(SpoolMap)
+    return false;
+  
+  FileName = Name;
+  
+  FileDescriptor = open(FileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(FileDescriptor < 0){
+    cout << "\nError! AAEventSpool::Open() could not create the event spool\n"
+	 <<   "       '" << FileName << "'!\n"
+	 << endl;
+    return false;
+  }
+  
+  // Only address space is reserved here: a single mapping far larger
+  // than any practical spool (smaller on 32-bit hosts) is never
+  // remapped as the file grows. A spool that exceeds it is stopped
+  MapSize = (sizeof(void *) == 8) ? ((Long64_t)64 << 30) : ((Long64_t)1 << 30);
+  
+  void *Map = mmap(NULL, MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileDescriptor, 0);
+  if(Map == MAP_FAILED){
+    cout << "\nError! AAEventSpool::Open() could not map the event spool\n"
+	 <<   "       '" << FileName << "' into memory!\n"
+	 << endl;
+    close(FileDescriptor);
+    unlink(FileName.c_str());
+    FileDescriptor = -1;
+    return false;
+  }
+  
+  SpoolMap = (char *)Map;
+  FileSize = 0;
+  
+  memcpy(Header.Magic, SpoolFileMagic, sizeof(Header.Magic));
+  Header.Version = SpoolFileVersion;
+  Header.SettingsSize = SettingsSize;
+  
+  Long64_t HeaderBytes = (sizeof(Header) + SettingsSize + 7) & ~(Long64_t)7;
+  if(!Reserve(HeaderBytes)){
+    cout << "\nError! AAEventSpool::Open() could not allocate the event spool\n"
+	 <<   "       '" << FileName << "'!\n"
+	 << endl;
+    Close(true);
+    return false;
+  }
+  
+  memcpy(SpoolMap, &Header, sizeof(Header));
+  memcpy(SpoolMap + sizeof(Header), Settings, SettingsSize);
+  
+  WrittenBytes = HeaderBytes;
+  SyncedBytes = 0;
+  SpoolError = false;
+  
+  SyncPeriod = (Period > 0) ? Period : 1000;
+  SyncThreadEnable = true;
+  SyncThread = new boost::thread(&AAEventSpool::RunSyncThread, this);
+  
+  return true;
+}
+
+
+void AAEventSpool::Close(Bool_t Remove)
+{
+  if(SpoolMap == NULL)
+    return;
+
+  // The sync thread syncs the final records before exiting
+  if(SyncThread){
+    {
+      boost::lock_guard<boost::mutex> Lock(SyncMutex);
+      SyncThreadEnable = false;
+    }
+    SyncWake.notify_one();
+    
+    SyncThread->join();
+    delete SyncThread;
+    SyncThread = NULL;
+  }
+  
+  munmap(SpoolMap, MapSize);
+  SpoolMap = NULL;
+  
+  // A retained spool is trimmed to the records actually written
+  if(!Remove)
+    ftruncate(FileDescriptor, WrittenBytes);
+  
+  close(FileDescriptor);
+  FileDescriptor = -1;
+  
+  if(Remove)
+    unlink(FileName.c_str());
+}
+
+
+void AAEventSpool::Append(StorageRecord &Record)
+{
+  if(SpoolMap == NULL or SpoolError)
+    return;
+  
+  Int_t NumSamples = (Record.StoreWaveform) ? Record.Waveform.size() : 0;
+  
+  UInt_t Size = ((sizeof(SpoolRecordHeaderStruct) + NumSamples * sizeof(uint16_t) + 7) 
+		 & ~(UInt_t)7);
+  
+  // Report only the first failure (e.g. a full disk) rather than one
+  // per event; the ADAQ file itself is unaffected
+  if(!Reserve(WrittenBytes + Size)){
+    cout << "\nError! AAEventSpool::Append() could not extend the event spool\n"
+	 <<   "       '" << FileName << "'! Spooling is stopped for this file.\n"
+	 << endl;
+    SpoolError = true;
+    return;
+  }
+
+  // The record is written in place; the bytes of newly allocated
+  // chunks are zero such that the padding needs no initialization
+  
+  SpoolRecordHeaderStruct *Header = (SpoolRecordHeaderStruct *)(SpoolMap + WrittenBytes);
+  
+  Header->Size = Size;
+  Header->Channel = Record.Channel;
+  Header->BoardID = Record.Data.GetBoardID();
+  Header->NumSamples = NumSamples;
+  Header->TimeStamp = Record.Data.GetTimeStamp();
+  Header->Baseline = Record.Data.GetBaseline();
+  Header->PulseHeight = Record.Data.GetPulseHeight();
+  Header->PulseArea = Record.Data.GetPulseArea();
+  Header->PSDTotal = Record.Data.GetPSDTotalIntegral();
+  Header->PSDTail = Record.Data.GetPSDTailIntegral();
+  
+  if(NumSamples > 0)
+    memcpy(Header + 1, &Record.Waveform[0], NumSamples * sizeof(uint16_t));
+  
+  Header->Checksum = Checksum(Header);
+  Header->Magic = SpoolRecordMagic;
+
+  boost::lock_guard<boost::mutex> Lock(SyncMutex);
+  WrittenBytes += Size;
+}
+
+
+UInt_t AAEventSpool::Checksum(const SpoolRecordHeaderStruct *Record)
+{
+  const UInt_t *Words = &Record->Size;
+  UInt_t NumWords = (Record->Size - 2 * sizeof(UInt_t)) / sizeof(UInt_t);
+  
+  ULong64_t Sum = 0;
+  for(UInt_t w=0; w<NumWords; w++)
+    Sum += Words[w];
+  
+  return (UInt_t)(Sum ^ (Sum >> 32));
+}
+
+
+Bool_t AAEventSpool::Reserve(Long64_t Bytes)
+{
+  if(Bytes <= FileSize)
+    return true;
+  
+  if(Bytes > MapSize)
+    return false;
+
+  Long64_t NewSize = (Bytes + SpoolChunkSize - 1) / SpoolChunkSize * SpoolChunkSize;
+  if(NewSize > MapSize)
+    NewSize = MapSize;
+  
+  // The disk blocks are allocated up front since writing to a mapped
+  // page that cannot be backed by the disk is fatal (SIGBUS)
+  if(posix_fallocate(FileDescriptor, FileSize, NewSize - FileSize) != 0)
+    return false;
+  
+  FileSize = NewSize;
+  return true;
+}
+
+
+void AAEventSpool::RunSyncThread()
+{
+  const Long64_t PageSize = sysconf(_SC_PAGESIZE);
+  
+  while(true){
+    
+    Long64_t Bytes = 0;
+    Bool_t Enable = true;
+    
+    {
+      boost::unique_lock<boost::mutex> Lock(SyncMutex);
+      if(SyncThreadEnable)
+	SyncWake.timed_wait(Lock, boost::posix_time::milliseconds(SyncPeriod));
+      
+      Bytes = WrittenBytes;
+      Enable = SyncThreadEnable;
+    }
+
+    // Only the records appended since the previous sync are written
+    // out, starting from the page containing the first of them
+    if(Bytes > SyncedBytes){
+      Long64_t Start = SyncedBytes - SyncedBytes % PageSize;
+      msync(SpoolMap + Start, Bytes - Start, MS_SYNC);
+      SyncedBytes = Bytes;
+    }
+    
+    if(!Enable)
+      break;
+  }
+}
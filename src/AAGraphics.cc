@@ -16,6 +16,8 @@
 #include <TFrame.h>
 #include <TPaletteAxis.h>
 #include <TH1F.h>
+#include <TMath.h>
+#include <TSystem.h>
 
 // Boost
 #include <boost/assign/std/vector.hpp>
@@ -24,7 +26,6 @@ using namespace boost::assign;
 // C++
 #include <iostream>
 #include <sstream>
-#include <numeric>
 #include <cmath>
 #include <list>
 
@@ -37,6 +38,12 @@ using namespace boost::assign;
 
 AAGraphics *AAGraphics::TheGraphicsManager = 0;
 
+// One waveform hit of a persistence density cell in 16-bit fixed
+// point; cells saturate at 2**32 hits, which also keeps the product
+// of a cell and the 16-bit decay factor within 64 bits
+static const ULong64_t PersistenceOne = 1 << 16;
+static const ULong64_t PersistenceMaxCell = (ULong64_t)0xffffffff << 16;
+
 
 AAGraphics *AAGraphics::GetInstance()
 { return TheGraphicsManager; }
@@ -46,7 +53,10 @@ AAGraphics::AAGraphics()
   : MaxWaveformLength(0), WaveformWidth(2), SpectrumWidth(2), MaxRateSize(0),
     XMin(0.), XMax(1.), YMin(0.), YMax(1.),
     BaselineStart(0), BaselineStop(1),
-    WaveformGraphAxes_H(new TH1F), RateGraphAxes_H(new TH1F)
+    WaveformGraphAxes_H(new TH1F), RateGraphAxes_H(new TH1F),
+    PersistenceTimeBins(0), PersistenceValueBins(0), PersistenceShift(0),
+    PersistenceTime(0), Persistence_H(NULL),
+    TileNext(0), TileCost(0)
 {
   if(TheGraphicsManager)
     cout << "\nError! The GraphicsManager was constructed twice!\n" << endl;
@@ -227,10 +237,6 @@ void AAGraphics::SetupWaveformGraphics(vector<Int_t> &WaveformLength)
     }
   }
 
-  Time.clear();
-  for(int t=0; t<MaxWaveformLength; t++)
-    Time.push_back(t);
-  
   if(TheSettings->DisplayTitlesEnable){
     Title = TheSettings->DisplayTitle;
     XTitle = TheSettings->DisplayXTitle;
@@ -307,6 +313,128 @@ void AAGraphics::SetupWaveformGraphics(vector<Int_t> &WaveformLength)
   WaveformGraphAxes_H->GetYaxis()->SetLabelSize(YSize);
 
   WaveformGraphAxes_H->SetStats(false);
+
+  // Setup the persistence density: at most 1024 time bins across the
+  // longest record and at most 256 value bins (i.e. the ADC value is
+  // shifted down to 8 bits), zeroed at the start of each acquisition
+  
+  Int_t ADCBits = DGManager->GetNumADCBits();
+  PersistenceShift = (ADCBits > 8) ? ADCBits - 8 : 0;
+  PersistenceValueBins = ((DGManager->GetMaxADCBit() + 1) >> PersistenceShift);
+  if(PersistenceValueBins < 1) PersistenceValueBins = 1;
+  
+  PersistenceTimeBins = (MaxWaveformLength < 1024) ? MaxWaveformLength : 1024;
+  if(PersistenceTimeBins < 1) PersistenceTimeBins = 1;
+  
+  PersistenceOffset.resize(MaxWaveformLength);
+  for(Int_t s=0; s<MaxWaveformLength; s++)
+    PersistenceOffset[s] = (Int_t)((Long64_t)s * PersistenceTimeBins / MaxWaveformLength) * PersistenceValueBins;
+  
+  PersistenceDensity.assign(PersistenceTimeBins * PersistenceValueBins, 0);
+  PersistenceTime = (Long64_t)gSystem->Now();
+  
+  delete Persistence_H;
+  Persistence_H = new TH2D("Persistence_H",
+			   "The persistence display of all waveforms",
+			   PersistenceTimeBins, 0, MaxWaveformLength,
+			   PersistenceValueBins, 0, PersistenceValueBins << PersistenceShift);
+  Persistence_H->SetDirectory(0);
+  Persistence_H->SetStats(false);
+  
+  Persistence_H->SetTitle(Title.c_str());
+  
+  Persistence_H->GetXaxis()->SetTitle(XTitle.c_str());
+  Persistence_H->GetXaxis()->SetTitleSize(XSize);
+  Persistence_H->GetXaxis()->SetTitleOffset(XOffset);
+  Persistence_H->GetXaxis()->SetLabelSize(XSize);
+  
+  Persistence_H->GetYaxis()->SetTitle(YTitle.c_str());
+  Persistence_H->GetYaxis()->SetTitleSize(YSize);
+  Persistence_H->GetYaxis()->SetTitleOffset(YOffset);
+  Persistence_H->GetYaxis()->SetLabelSize(YSize);
+}
+
+
+// Add every sample of a waveform to the persistence density. This is
+// called for each waveform on the acquisition side and therefore does
+// only one lookup and one (saturating) integer increment per sample
+void AAGraphics::AccumulatePersistence(vector<uint16_t> &Waveform, Int_t Length)
+{
+  if(Length > (Int_t)Waveform.size())
+    Length = Waveform.size();
+  if(Length > (Int_t)PersistenceOffset.size())
+    Length = PersistenceOffset.size();
+  
+  ULong64_t *Density = &PersistenceDensity[0];
+  const Int_t *Offset = &PersistenceOffset[0];
+  const uint16_t *Sample = &Waveform[0];
+  const Int_t Shift = PersistenceShift;
+  const Int_t MaxValue = PersistenceValueBins - 1;
+  
+  for(Int_t s=0; s<Length; s++){
+    Int_t Value = Sample[s] >> Shift;
+    if(Value > MaxValue) Value = MaxValue;
+    ULong64_t &Cell = Density[Offset[s] + Value];
+    if(Cell < PersistenceMaxCell) Cell += PersistenceOne;
+  }
+}
+
+
+// Draw the persistence density and decay it by the time since the
+// last frame. Each cell is copied into the histogram's bin array
+// before it is decayed by exp(-dt/tau), such that every waveform is
+// drawn at full weight at least once, in a single pass over the
+// density per frame. The fractional counts of the fixed point cells
+// decay smoothly rather than being truncated to zero
+void AAGraphics::PlotPersistence()
+{
+  if(!Persistence_H or PersistenceDensity.empty())
+    return;
+  
+  Long64_t Now = (Long64_t)gSystem->Now();
+  Double_t Elapsed = (Now - PersistenceTime) / 1000.;
+  PersistenceTime = Now;
+  
+  ULong64_t Factor = 65536;
+  if(TheSettings->WaveformPersistenceDecay > 0.)
+    Factor = (ULong64_t)(65536. * exp(-Elapsed / TheSettings->WaveformPersistenceDecay));
+  
+  // The histogram's array includes the under/overflow bins
+  Double_t *Bins = Persistence_H->GetArray();
+  const Int_t Stride = PersistenceTimeBins + 2;
+  
+  const Double_t Scale = 1. / PersistenceOne;
+  
+  for(Int_t t=0; t<PersistenceTimeBins; t++){
+    ULong64_t *Density = &PersistenceDensity[t * PersistenceValueBins];
+    for(Int_t v=0; v<PersistenceValueBins; v++){
+      Bins[(t+1) + Stride*(v+1)] = Density[v] * Scale;
+      if(Factor < 65536)
+	Density[v] = (Density[v] * Factor) >> 16;
+    }
+  }
+  Persistence_H->SetEntries(1);
+  
+  XMin = MaxWaveformLength * TheSettings->HorizontalSliderMin;
+  XMax = MaxWaveformLength * TheSettings->HorizontalSliderMax;
+  Persistence_H->GetXaxis()->SetRangeUser(XMin, XMax);
+  
+  (TheSettings->DisplayXAxisInLog) ? 
+    gPad->SetLogx(true) : gPad->SetLogx(false);
+  
+  Int_t AbsoluteMax = AAVMEManager::GetInstance()->GetDGManager()->GetMaxADCBit();
+  YMin = AbsoluteMax * TheSettings->VerticalSliderMin;
+  YMax = AbsoluteMax * TheSettings->VerticalSliderMax;
+  Persistence_H->GetYaxis()->SetRangeUser(YMin, YMax);
+  
+  // The logarithmic option colors the density rather than the Y axis
+  (TheSettings->DisplayYAxisInLog) ? 
+    gPad->SetLogz(true) : gPad->SetLogz(false);
+  gPad->SetLogy(false);
+  
+  Persistence_H->Draw("COLZ");
+  
+  (TheSettings->DisplayGrid) ? gPad->SetGrid(true, true) : gPad->SetGrid(false, false);
 }
 
 
@@ -322,23 +450,14 @@ void AAGraphics::PlotWaveforms(vector<vector<uint16_t> > &Waveforms,
     if(!TheSettings->ChEnable[ch])
       continue;
     
-    // Efficienctly allocate the channel voltage into a vector<int>
-    vector<Int_t> Voltage (Waveforms[ch].begin(), Waveforms[ch].end());
-
-    // Zero length encoding waveform: a vector representing time (the
-    // X-axis) must be created dynamically to account for the variable
-    // time nature of the ZLE waveform. Do this efficiently with
-    // std::iota methods
-
-    if(TheSettings->ZeroSuppressionEnable){
-      WaveformLength[ch] = Voltage.size();
-      Time.resize(WaveformLength[ch]);
-      iota(begin(Time), end(Time), 0);
-    }
+    // Zero length encoding waveform: the waveform length varies
+    // between events and is given by the decoded waveform itself
+    if(TheSettings->ZeroSuppressionEnable)
+      WaveformLength[ch] = Waveforms[ch].size();
     
     // Prevent plotting if there is no waveform values to plot
-    if(Voltage.size() == 0)
-      return;
+    if(Waveforms[ch].size() == 0)
+      continue;
     
     // Set the horiz. and vert. min/max ranges of the waveform.  Note
     // the max value is the max digitizer bit value in units of ADC
@@ -391,11 +510,12 @@ void AAGraphics::PlotWaveforms(vector<vector<uint16_t> > &Waveforms,
     else
       DrawOptions += "PL";
 
-    // Draw the graph with the new time/voltage values
-    WaveformGraphs[ch]->DrawGraph(WaveformLength[ch], 
-				  &Time[0], 
-				  &Voltage[0],
-				  DrawOptions);
+    // Update the channel's graph in place with the visible part of
+    // the waveform and draw it; the graph is owned here and is only
+    // removed, not deleted, when the pad is cleared on the next draw
+    Int_t Length = TMath::Min(WaveformLength[ch], (Int_t)Waveforms[ch].size());
+    DecimateWaveform(ch, Waveforms[ch], Length);
+    WaveformGraphs[ch]->Draw(DrawOptions);
     
     NumGraphs++;
   }
@@ -407,6 +527,67 @@ void AAGraphics::PlotWaveforms(vector<vector<uint16_t> > &Waveforms,
 }
 
 
+// Fill the channel's waveform graph with the samples of the waveform
+// that are within the horizontal slider range. When there are more
+// visible samples than twice the pixel width of the pad's frame, the
+// samples of each pixel column are decimated to their minimum and
+// maximum (in time order) such that the drawn waveform is identical
+// to the full waveform at a bounded number of points. The points are
+// written directly into the persistent graph, which only reallocates
+// when the number of points changes (i.e. on zoom or resize)
+void AAGraphics::DecimateWaveform(Int_t Channel, vector<uint16_t> &Waveform, Int_t Length)
+{
+  Int_t First = TMath::Max((Int_t)XMin, 0);
+  Int_t Last = TMath::Min((Int_t)ceil(XMax), Length - 1);
+  Int_t Samples = Last - First + 1;
+  
+  TGraph *Graph = WaveformGraphs[Channel];
+  
+  if(Samples <= 0){
+    Graph->Set(0);
+    return;
+  }
+  
+  Int_t Pixels = TMath::Nint(gPad->GetWw() * gPad->GetAbsWNDC() *
+			     (1. - gPad->GetLeftMargin() - gPad->GetRightMargin()));
+  
+  // Pixel columns are not linear in samples on a log axis
+  if(Pixels < 1 or Samples <= 2*Pixels or TheSettings->DisplayXAxisInLog){
+    Graph->Set(Samples);
+    Double_t *X = Graph->GetX();
+    Double_t *Y = Graph->GetY();
+    for(Int_t s=0; s<Samples; s++){
+      X[s] = First + s;
+      Y[s] = Waveform[First + s];
+    }
+    return;
+  }
+  
+  Graph->Set(2*Pixels);
+  Double_t *X = Graph->GetX();
+  Double_t *Y = Graph->GetY();
+  
+  for(Int_t p=0; p<Pixels; p++){
+    Int_t Start = First + (Int_t)((Long64_t)Samples * p / Pixels);
+    Int_t Stop = First + (Int_t)((Long64_t)Samples * (p+1) / Pixels);
+    
+    Int_t MinSample = Start, MaxSample = Start;
+    for(Int_t s=Start+1; s<Stop; s++){
+      if(Waveform[s] < Waveform[MinSample]) MinSample = s;
+      if(Waveform[s] > Waveform[MaxSample]) MaxSample = s;
+    }
+    
+    Int_t Earlier = TMath::Min(MinSample, MaxSample);
+    Int_t Later = TMath::Max(MinSample, MaxSample);
+    
+    X[2*p] = Earlier;
+    Y[2*p] = Waveform[Earlier];
+    X[2*p+1] = Later;
+    Y[2*p+1] = Waveform[Later];
+  }
+}
+
+
 void AAGraphics::DrawWaveformGraphics(vector<double> &BaselineValue,
 				      vector<Int_t> &PeakPosition,
 				      vector<int> &PSDTotalAbsStart,
@@ -532,8 +713,27 @@ void AAGraphics::SetupSpectrumGraphics()
 
 void AAGraphics::PlotSpectrum(TH1F *Spectrum_H)
 {
-  Int_t Channel = TheSettings->SpectrumChannel;
+  DrawSpectrum(Spectrum_H, TheSettings->SpectrumChannel);
+  
+  // If calibration is enabled the draw a vertical line corresponding
+  // to the current pulse value selected by the triple slider pointer
 
+  if(TheSettings->SpectrumCalibrationEnable){
+    Double_t PulseValue = TheSettings->SpectrumMaxBin *
+      TheSettings->HorizontalSliderPtr;
+    
+    SpectrumCalibration_L->DrawLine(PulseValue,
+				    YMin,
+				    PulseValue,
+				    YMax);
+  }
+  TheCanvas_C->Update();
+}
+
+
+// Draw a channel's spectrum into the current pad
+void AAGraphics::DrawSpectrum(TH1F *Spectrum_H, Int_t Channel)
+{
   Spectrum_H->SetLineColor(ChColor[Channel]);
   Spectrum_H->SetLineWidth(SpectrumWidth);
   Spectrum_H->SetMarkerStyle(24);
@@ -589,20 +789,6 @@ void AAGraphics::PlotSpectrum(TH1F *Spectrum_H)
 
   (TheSettings->DisplayLegend) ? Spectrum_H->SetStats(true) : Spectrum_H->SetStats(false);
   (TheSettings->DisplayGrid) ? gPad->SetGrid(true, true) : gPad->SetGrid(false, false);
-  
-  // If calibration is enabled the draw a vertical line corresponding
-  // to the current pulse value selected by the triple slider pointer
-
-  if(TheSettings->SpectrumCalibrationEnable){
-    Double_t PulseValue = TheSettings->SpectrumMaxBin *
-      TheSettings->HorizontalSliderPtr;
-    
-    SpectrumCalibration_L->DrawLine(PulseValue,
-				    YMin,
-				    PulseValue,
-				    YMax);
-  }
-  TheCanvas_C->Update();
 }
 
 
@@ -635,15 +821,23 @@ void AAGraphics::SetupPSDHistogramGraphics()
 
 void AAGraphics::PlotPSDHistogram(TH2F *PSDHistogram_H)
 {
-  Int_t Channel = TheSettings->PSDChannel;
+  DrawPSDHistogram(PSDHistogram_H, TheSettings->PSDChannel);
   
+  TheCanvas_C->Update();
+}
+
+
+// Draw a channel's PSD histogram into the current pad
+void AAGraphics::DrawPSDHistogram(TH2F *PSDHistogram_H, Int_t Channel)
+{
   // Draw the PSDHistogram and prevent the user from inducing segfaults
   // upon moving the color axis
   PSDHistogram_H->Draw("COLZ");
   gPad->Update();
   TPaletteAxis *palette = (TPaletteAxis*)
     PSDHistogram_H->GetListOfFunctions()->FindObject("palette");
-  palette->SetBit(TBox::kCannotMove);
+  if(palette)
+    palette->SetBit(TBox::kCannotMove);
   
   XMin = TheSettings->PSDTotalMaxBin * TheSettings->HorizontalSliderMin;
   XMax = TheSettings->PSDTotalMaxBin * TheSettings->HorizontalSliderMax;
@@ -677,11 +871,145 @@ void AAGraphics::PlotPSDHistogram(TH2F *PSDHistogram_H)
 
   (TheSettings->DisplayLegend) ? PSDHistogram_H->SetStats(true) : PSDHistogram_H->SetStats(false);
   (TheSettings->DisplayGrid) ? gPad->SetGrid(true, true) : gPad->SetGrid(false, false);
+}
 
+
+void AAGraphics::SetupTiles()
+{
+  Bool_t Tiled = (TheSettings->DisplayTiled and
+		  (TheSettings->SpectrumMode or TheSettings->PSDMode));
+  
+  if(!Tiled and TilePads.empty())
+    return;
+  
+  // Clearing the canvas deletes the pads of any previous tiling
+  TheCanvas_C->Clear();
+  TilePads.clear();
+  for(size_t t=0; t<TileHistograms.size(); t++)
+    delete TileHistograms[t];
+  TileHistograms.clear();
+  TileChannel.clear();
+  TileView.clear();
+  TileNext = 0;
+  TileCost = 0;
+  
+  if(Tiled){
+    Int_t NumDGChannels = AAVMEManager::GetInstance()->GetDGManager()->GetNumChannels();
+    for(Int_t ch=0; ch<NumDGChannels; ch++)
+      if(TheSettings->ChEnable[ch])
+	TileChannel.push_back(ch);
+    
+    Int_t NumTiles = TileChannel.size();
+    if(NumTiles > 0){
+      Int_t Columns = (Int_t)ceil(sqrt((Double_t)NumTiles));
+      Int_t Rows = (NumTiles + Columns - 1) / Columns;
+      TheCanvas_C->Divide(Columns, Rows, 0.001, 0.001);
+      
+      for(Int_t t=0; t<NumTiles; t++)
+	TilePads.push_back((TPad *)TheCanvas_C->GetPad(t+1));
+    }
+    TileEntries.assign(NumTiles, -1.);
+    TileHistograms.assign(NumTiles, (TH1 *)NULL);
+  }
+  
+  TheCanvas_C->cd();
   TheCanvas_C->Update();
 }
 
 
+void AAGraphics::PlotSpectrumTiles(vector<TH1F *> &Spectra)
+{
+  vector<TH1 *> Histograms(Spectra.begin(), Spectra.end());
+  PlotTiles(Histograms, false);
+}
+
+
+void AAGraphics::PlotPSDHistogramTiles(vector<TH2F *> &PSDHistograms)
+{
+  vector<TH1 *> Histograms(PSDHistograms.begin(), PSDHistograms.end());
+  PlotTiles(Histograms, true);
+}
+
+
+// Redraw the tiles whose histograms have changed since they were last
+// drawn. Each pad is painted individually as it is redrawn, such that
+// the pads of unchanged tiles are never repainted and the time spent
+// per tile is known; no further tile is redrawn in this frame once
+// the next would exceed the redraw budget, though at least one tile
+// is always redrawn such that every tile is eventually refreshed
+void AAGraphics::PlotTiles(vector<TH1 *> &Histograms, Bool_t PSD)
+{
+  Int_t NumTiles = TilePads.size();
+  if(NumTiles == 0)
+    return;
+  
+  // Any change to how the histograms are viewed requires all tiles
+  // to be redrawn
+  Double_t View[] = {TheSettings->HorizontalSliderMin, TheSettings->HorizontalSliderMax,
+		     TheSettings->VerticalSliderMin, TheSettings->VerticalSliderMax,
+		     (Double_t)TheSettings->DisplayXAxisInLog, (Double_t)TheSettings->DisplayYAxisInLog,
+		     (Double_t)TheSettings->DisplayLegend, (Double_t)TheSettings->DisplayGrid,
+		     (Double_t)TheSettings->SpectrumWithLine, (Double_t)TheSettings->SpectrumWithMarkers};
+  vector<Double_t> CurrentView(View, View + sizeof(View)/sizeof(Double_t));
+  
+  if(CurrentView != TileView){
+    TileView = CurrentView;
+    TileEntries.assign(NumTiles, -1.);
+  }
+  
+  Long64_t Start = (Long64_t)gSystem->Now();
+  Int_t First = TileNext;
+  Int_t Redrawn = 0;
+  
+  for(Int_t n=0; n<NumTiles; n++){
+    Int_t t = (First + n) % NumTiles;
+    Int_t Channel = TileChannel[t];
+    TH1 *Histogram = Histograms[Channel];
+    
+    if(Histogram->GetEntries() == TileEntries[t])
+      continue;
+    
+    Long64_t Elapsed = (Long64_t)gSystem->Now() - Start;
+    if(Redrawn > 0 and Elapsed + TileCost > TheSettings->DisplayTileBudget){
+      TileNext = t;
+      break;
+    }
+    
+    Long64_t TileStart = (Long64_t)gSystem->Now();
+    
+    // The tile's copy rather than the histogram itself, which is
+    // shared with the single histogram display, takes the channel
+    // into its title
+    if(!TileHistograms[t] or TileHistograms[t]->IsA() != Histogram->IsA()){
+      delete TileHistograms[t];
+      TileHistograms[t] = (TH1 *)Histogram->Clone();
+    }
+    else
+      Histogram->Copy(*TileHistograms[t]);
+    TileHistograms[t]->SetDirectory(0);
+    
+    TilePads[t]->cd();
+    if(PSD)
+      DrawPSDHistogram((TH2F *)TileHistograms[t], Channel);
+    else
+      DrawSpectrum((TH1F *)TileHistograms[t], Channel);
+    
+    stringstream SS;
+    SS << Title << " : Ch[" << Channel << "]";
+    TileHistograms[t]->SetTitle(SS.str().c_str());
+    
+    TilePads[t]->Modified();
+    TheCanvas_C->Update();
+    
+    TileCost = (Long64_t)gSystem->Now() - TileStart;
+    TileEntries[t] = Histogram->GetEntries();
+    Redrawn++;
+  }
+  
+  TheCanvas_C->cd();
+}
+
+
 void AAGraphics::PlotCalibration(int Channel)
 {
   TGraph *CalibrationCurve = AAAcquisitionManager::GetInstance()->
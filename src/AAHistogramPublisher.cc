@@ -0,0 +1,106 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TArrayF.h>
+
+// C++
+#include <cstring>
+
+// ADAQAcquisition
+#include "AAHistogramPublisher.hh"
+
+// The Handoff value is the buffer index with the Fresh bit
+static const Int_t IndexMask = 0x3;
+static const Int_t Fresh = 0x4;
+
+
+AAHistogramPublisher::AAHistogramPublisher()
+  : Back(0), Front(1), Handoff(2)
+{;}
+
+
+AAHistogramPublisher::~AAHistogramPublisher()
+{
+  Clear();
+}
+
+
+void AAHistogramPublisher::Clear()
+{
+  for(Int_t b=0; b<3; b++){
+    for(size_t h=0; h<Buffers[b].size(); h++)
+      delete Buffers[b][h];
+    Buffers[b].clear();
+  }
+  Live.clear();
+}
+
+
+void AAHistogramPublisher::Setup(vector<TH1 *> &Histograms)
+{
+  Clear();
+  
+  Live = Histograms;
+  
+  for(Int_t b=0; b<3; b++){
+    for(size_t h=0; h<Live.size(); h++){
+      TH1 *Copy = (TH1 *)Live[h]->Clone();
+      Copy->SetDirectory(0);
+      Buffers[b].push_back(Copy);
+    }
+  }
+  
+  Back = 0;
+  Front = 1;
+  Handoff.store(2, boost::memory_order_release);
+}
+
+
+void AAHistogramPublisher::Publish()
+{
+  vector<TH1 *> &Snapshot = Buffers[Back];
+  Double_t Stats[TH1::kNstat];
+  
+  // The TH1F and TH2F bin contents (including under/overflow bins)
+  // are held in their TArrayF base, which is copied directly since
+  // the copies always have the binning of the live histograms
+  for(size_t h=0; h<Live.size(); h++){
+    TArrayF *Source = dynamic_cast<TArrayF *>(Live[h]);
+    TArrayF *Destination = dynamic_cast<TArrayF *>(Snapshot[h]);
+    if(!Source or !Destination)
+      continue;
+    
+    memcpy(Destination->GetArray(), Source->GetArray(), Source->GetSize() * sizeof(Float_t));
+    
+    Live[h]->GetStats(Stats);
+    Snapshot[h]->PutStats(Stats);
+    Snapshot[h]->SetEntries(Live[h]->GetEntries());
+  }
+  
+  // Swap the back buffer for the handoff buffer; if the handoff
+  // buffer was still fresh the display never took it and it becomes
+  // the next back buffer to be overwritten
+  Back = Handoff.exchange(Back | Fresh, boost::memory_order_acq_rel) & IndexMask;
+}
+
+
+Bool_t AAHistogramPublisher::Acquire()
+{
+  if(!(Handoff.load(boost::memory_order_acquire) & Fresh))
+    return false;
+  
+  // Only the acquisition side can set the Fresh bit, so the handoff
+  // buffer cannot become stale between the load and the exchange
+  Front = Handoff.exchange(Front, boost::memory_order_acq_rel) & IndexMask;
+  return true;
+}
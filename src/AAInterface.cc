@@ -55,6 +55,7 @@ using namespace boost::assign;
 #include "AAVMEManager.hh"
 #include "AAAcquisitionManager.hh"
 #include "AAGraphics.hh"
+#include "AAPeakFitter.hh"
 
 
 AAInterface::AAInterface(Bool_t ALS, string SFN)
@@ -79,6 +80,29 @@ AAInterface::AAInterface(Bool_t ALS, string SFN)
   DisplaySlots = new AADisplaySlots(this);
   SubtabSlots = new AASubtabSlots(this);
   TabSlots = new AATabSlots(this);
+
+  // Create the live spectrum peak fitter; the timer is started only
+  // when the user enables peak fitting from the spectrum subtab
+  PeakFitter = new AAPeakFitter;
+  PeakFitTimer = new TTimer(1000);
+  PeakFitTimer->Connect("Timeout()", "AASubtabSlots", SubtabSlots, "HandlePeakFitTimer()");
+
+  // Create the storage monitor timer; it is started when an ADAQ file
+  // is created and turns itself off once the file is closed
+  StorageMonitorTimer = new TTimer(1000);
+  StorageMonitorTimer->Connect("Timeout()", "AASubtabSlots", SubtabSlots, "HandleStorageMonitorTimer()");
+
+  // Create the display timer; it is started with acquisition and
+  // redraws the display at the user-specified frame rate such that
+  // the rendering cost is independent of the trigger rate
+  DisplayTimer = new TTimer(100);
+  DisplayTimer->Connect("Timeout()", "AASubtabSlots", SubtabSlots, "HandleDisplayTimer()");
+
+  // Create the HV monitor timer; it is started with HV monitoring and
+  // updates the monitor widgets from the samples of the HV monitoring
+  // thread (see AAVMEManager::StartHVMonitoring())
+  HVMonitorTimer = new TTimer(500);
+  HVMonitorTimer->Connect("Timeout()", "AATabSlots", TabSlots, "HandleHVMonitorTimer()");
   
   // Pass a pointer to this class instance to the acquisition manager
   // so that the GUI can be accessed from there
@@ -109,6 +133,15 @@ AAInterface::AAInterface(Bool_t ALS, string SFN)
 
 AAInterface::~AAInterface()
 {
+  PeakFitTimer->TurnOff();
+  delete PeakFitTimer;
+  StorageMonitorTimer->TurnOff();
+  delete StorageMonitorTimer;
+  DisplayTimer->TurnOff();
+  delete DisplayTimer;
+  HVMonitorTimer->TurnOff();
+  delete HVMonitorTimer;
+  delete PeakFitter;
   delete TabSlots;
   delete SubtabSlots;
   delete DisplaySlots;
@@ -316,6 +349,119 @@ void AAInterface::FillSettingsFrame()
 								    "Auto save settings during session",
 								    AutoSaveSettings_CB_ID),
 			    new TGLayoutHints(kLHintsNormal, 10,5,5,0));
+
+
+  // Settings applied to the ADAQ file when it is created
+
+  TGGroupFrame *StorageSettings_GF = new TGGroupFrame(SettingsFrame, "ADAQ file storage", kVerticalFrame);
+  StorageSettings_GF->SetTitlePos(TGGroupFrame::kCenter);
+  SettingsFrame->AddFrame(StorageSettings_GF, new TGLayoutHints(kLHintsLeft, 5,5,5,5));
+  
+  StorageSettings_GF->AddFrame(StorageCompressionAlgorithm_CBL = new ADAQComboBoxWithLabel(StorageSettings_GF, "Compression algorithm", StorageCompressionAlgorithm_CBL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  StorageCompressionAlgorithm_CBL->GetComboBox()->Resize(100,20);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->AddEntry("None", 0);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->AddEntry("ZLIB", 1);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->AddEntry("LZMA", 2);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->AddEntry("LZ4", 4);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->AddEntry("ZSTD", 5);
+  StorageCompressionAlgorithm_CBL->GetComboBox()->Select(1);
+
+  StorageSettings_GF->AddFrame(StorageCompressionLevel_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Compression level (0-9)", StorageCompressionLevel_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  StorageCompressionLevel_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageCompressionLevel_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageCompressionLevel_NEL->GetEntry()->SetLimits(TGNumberFormat::kNELLimitMinMax, 0, 9);
+  StorageCompressionLevel_NEL->GetEntry()->SetNumber(1);
+
+  // Baskets are compressed in parallel by ROOT's implicit
+  // multithreading with the specified number of threads
+  StorageSettings_GF->AddFrame(StorageThreads_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Compression threads (0 = off)", StorageThreads_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageThreads_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageThreads_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageThreads_NEL->GetEntry()->SetLimits(TGNumberFormat::kNELLimitMinMax, 0, 64);
+  StorageThreads_NEL->GetEntry()->SetNumber(0);
+
+  StorageSettings_GF->AddFrame(StorageBasketSize_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Basket size [kB]", StorageBasketSize_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageBasketSize_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageBasketSize_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  StorageBasketSize_NEL->GetEntry()->SetNumber(32);
+
+  StorageSettings_GF->AddFrame(StorageAutoFlush_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Auto-flush [events] (0 = off)", StorageAutoFlush_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageAutoFlush_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageAutoFlush_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageAutoFlush_NEL->GetEntry()->SetNumber(0);
+
+  StorageSettings_GF->AddFrame(StorageAutoSave_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Auto-save [MB] (0 = off)", StorageAutoSave_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageAutoSave_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageAutoSave_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageAutoSave_NEL->GetEntry()->SetNumber(300);
+
+  // Automatic rollover of long runs into a sequence of ADAQ files
+  
+  StorageSettings_GF->AddFrame(StorageRotate_CB = new TGCheckButton(StorageSettings_GF, "Rotate ADAQ files", StorageRotate_CB_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,10,0));
+
+  StorageSettings_GF->AddFrame(StorageRotateSize_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Rotate after [MB] (0 = off)", StorageRotateSize_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  StorageRotateSize_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageRotateSize_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageRotateSize_NEL->GetEntry()->SetNumber(2000);
+
+  StorageSettings_GF->AddFrame(StorageRotateTime_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Rotate after [min] (0 = off)", StorageRotateTime_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageRotateTime_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageRotateTime_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageRotateTime_NEL->GetEntry()->SetNumber(0);
+
+  StorageSettings_GF->AddFrame(StorageRotateEvents_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Rotate after [events] (0 = off)", StorageRotateEvents_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  StorageRotateEvents_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageRotateEvents_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  StorageRotateEvents_NEL->GetEntry()->SetNumber(0);
+
+  // Crash-safe copy of the stored events until each file is written
+  
+  StorageSettings_GF->AddFrame(StorageSpool_CB = new TGCheckButton(StorageSettings_GF, "Crash-safe event spool", StorageSpool_CB_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,10,0));
+
+  StorageSettings_GF->AddFrame(StorageSpoolSync_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Spool sync period [ms]", StorageSpoolSync_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  StorageSpoolSync_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  StorageSpoolSync_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  StorageSpoolSync_NEL->GetEntry()->SetNumber(1000);
+
+  // Periodic snapshots of the spectra/PSD histograms during a run
+  
+  StorageSettings_GF->AddFrame(SpectrumSnapshots_CB = new TGCheckButton(StorageSettings_GF, "Spectrum snapshots", SpectrumSnapshots_CB_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,10,0));
+
+  StorageSettings_GF->AddFrame(SpectrumSnapshotPeriod_NEL = new ADAQNumberEntryWithLabel(StorageSettings_GF, "Snapshot period [s]", SpectrumSnapshotPeriod_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  SpectrumSnapshotPeriod_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  SpectrumSnapshotPeriod_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  SpectrumSnapshotPeriod_NEL->GetEntry()->SetNumber(60);
+
+  StorageSettings_GF->AddFrame(SpectrumSnapshotCumulative_CB = new TGCheckButton(StorageSettings_GF, "Cumulative snapshots (else deltas)", SpectrumSnapshotCumulative_CB_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+  SpectrumSnapshotCumulative_CB->SetState(kButtonDown);
+
+  StorageSettings_GF->AddFrame(StorageBenchmark_TB = new TGTextButton(StorageSettings_GF,
+								      "Benchmark compression",
+								      StorageBenchmark_TB_ID),
+			       new TGLayoutHints(kLHintsNormal, 5,5,10,0));
+  StorageBenchmark_TB->Resize(210, 30);
+  StorageBenchmark_TB->ChangeOptions(StorageBenchmark_TB->GetOptions() | kFixedSize);
+  StorageBenchmark_TB->Connect("Clicked()", "AATabSlots", TabSlots, "HandleSettingsTextButtons()");
+
+  // A text view to display the benchmark results
+  StorageSettings_GF->AddFrame(StorageBenchmark_TV = new TGTextView(StorageSettings_GF, 400, 120, -1),
+			       new TGLayoutHints(kLHintsNormal, 5,5,5,5));
+  StorageBenchmark_TV->SetBackground(ColorManager->Number2Pixel(18));
 }
 
 
@@ -932,6 +1078,14 @@ void AAInterface::FillVoltageFrame()
 			    new TGLayoutHints(kLHintsNormal, 5,5,5,5));
   HVMonitorEnable_CB->Connect("Clicked()", "AATabSlots", TabSlots, "HandleCheckButtons()");
   HVMonitorEnable_CB->SetState(kButtonUp);
+
+  HVAllChannel_GF->AddFrame(HVMonitorPeriod_NEL = new ADAQNumberEntryWithLabel(HVAllChannel_GF, "Period (ms)", -1),
+			    new TGLayoutHints(kLHintsNormal, 5,5,5,5));
+  HVMonitorPeriod_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  HVMonitorPeriod_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  HVMonitorPeriod_NEL->GetEntry()->SetLimits(TGNumberFormat::kNELLimitMinMax, 100, 60000);
+  HVMonitorPeriod_NEL->GetEntry()->Resize(60,20);
+  HVMonitorPeriod_NEL->GetEntry()->SetNumber(500);
   
   VoltageFrame->AddFrame(HVChannelControls_VF, new TGLayoutHints(kLHintsTop | kLHintsCenterX, 5, 5, 5, 5));
 
@@ -1533,6 +1687,47 @@ void AAInterface::FillAcquisitionFrame()
       DGChGateOffset_NEL[ch]->GetEntry()->SetNumber(10);
       DGChGateOffset_NEL[ch]->GetEntry()->Connect("ValueSet(Long_t)", "AAChannelSlots", ChannelSlots, "HandleNumberEntries()");
     }
+
+    
+    ///////////////////////////////////////////////
+    // Firmware-agnostic channel storage policies //
+    ///////////////////////////////////////////////
+
+    // The storage policies determine which of the channel's raw
+    // waveforms are written to the ADAQ file; the energy/PSD data of
+    // every event is always written. The policies are applied in the
+    // acquisition loop and may be changed during acquisition
+    
+    DGChannelControl_GF->AddFrame(new TGLabel(DGChannelControl_GF, "Raw waveform storage policy"),
+				  new TGLayoutHints(kLHintsLeft,0,0,10,5));
+
+    // ADAQ number entry to store only every Nth raw waveform
+    DGChannelControl_GF->AddFrame(DGChStoragePrescale_NEL[ch] = new ADAQNumberEntryWithLabel(DGChannelControl_GF, "Prescale (every Nth)", -1),
+				  new TGLayoutHints(kLHintsNormal, 10,0,0,0));
+    DGChStoragePrescale_NEL[ch]->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+    DGChStoragePrescale_NEL[ch]->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+    DGChStoragePrescale_NEL[ch]->GetEntry()->SetNumber(1);
+    DGChStoragePrescale_NEL[ch]->GetEntry()->Resize(55,20);
+    DGChStoragePrescale_NEL[ch]->GetEntry()->Connect("ValueSet(Long_t)", "AAChannelSlots", ChannelSlots, "HandleNumberEntries()");
+
+    // ADAQ number entry to store only raw waveforms whose pulse
+    // height/area (the spectrum quantity) is above a threshold
+    DGChannelControl_GF->AddFrame(DGChStorageThreshold_NEL[ch] = new ADAQNumberEntryWithLabel(DGChannelControl_GF, "Energy threshold (0 = off)", -1),
+				  new TGLayoutHints(kLHintsNormal, 10,0,0,0));
+    DGChStorageThreshold_NEL[ch]->GetEntry()->SetNumStyle(TGNumberFormat::kNESRealOne);
+    DGChStorageThreshold_NEL[ch]->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+    DGChStorageThreshold_NEL[ch]->GetEntry()->SetNumber(0.);
+    DGChStorageThreshold_NEL[ch]->GetEntry()->Resize(55,20);
+    DGChStorageThreshold_NEL[ch]->GetEntry()->Connect("ValueSet(Long_t)", "AAChannelSlots", ChannelSlots, "HandleNumberEntries()");
+
+    // ADAQ number entry to cap the rate of raw waveform data
+    DGChannelControl_GF->AddFrame(DGChStorageRateCap_NEL[ch] = new ADAQNumberEntryWithLabel(DGChannelControl_GF, "Max. rate (kB/s, 0 = off)", -1),
+				  new TGLayoutHints(kLHintsNormal, 10,0,0,0));
+    DGChStorageRateCap_NEL[ch]->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+    DGChStorageRateCap_NEL[ch]->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+    DGChStorageRateCap_NEL[ch]->GetEntry()->SetNumber(0);
+    DGChStorageRateCap_NEL[ch]->GetEntry()->Resize(55,20);
+    DGChStorageRateCap_NEL[ch]->GetEntry()->Connect("ValueSet(Long_t)", "AAChannelSlots", ChannelSlots, "HandleNumberEntries()");
   }
   
 
@@ -1882,7 +2077,21 @@ void AAInterface::FillAcquisitionFrame()
   AQDataReductionFactor_NEL->GetEntry()->SetNumber(1);
 
   DGScopeReadoutControls_GF->AddFrame(DGZLEEnable_CB = new TGCheckButton(DGScopeReadoutControls_GF, "Enable ZLE zero-suppression", DGZLEEnable_CB_ID),
+				      new TGLayoutHints(kLHintsNormal, 5,5,0,0));
+
+  DGScopeReadoutControls_GF->AddFrame(DGZLEPulsePerSegment_CB = new TGCheckButton(DGScopeReadoutControls_GF, "Analyze each ZLE segment as a pulse", DGZLEPulsePerSegment_CB_ID),
+				      new TGLayoutHints(kLHintsNormal, 5,5,0,5));
+
+  // The analysis plan is determined at the start of acquisition and
+  // displays the waveform analysis stages that will be computed
+  DGScopeReadoutControls_GF->AddFrame(AQAnalysisPlan_L = new TGLabel(DGScopeReadoutControls_GF, "Analysis : not yet determined"),
+				      new TGLayoutHints(kLHintsNormal, 5,5,5,0));
+  AQAnalysisPlan_L->SetTextJustify(kTextLeft);
+  
+  DGScopeReadoutControls_GF->AddFrame(AQAnalysisCost_NEFL = new ADAQNumberEntryFieldWithLabel(DGScopeReadoutControls_GF, "Analysis cost [ops/event]", -1),
 				      new TGLayoutHints(kLHintsNormal, 5,5,0,5));
+  AQAnalysisCost_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESInteger);
+  AQAnalysisCost_NEFL->GetEntry()->SetState(false);
 
 
   ///////////////////////
@@ -2111,6 +2320,63 @@ void AAInterface::FillAcquisitionFrame()
   SpectrumCalibrationWrite_TB->SetState(kButtonDisabled);
 
 
+  ///////////////
+  // Peak fitting
+
+  TGGroupFrame *SpectrumPeakFit_GF = new TGGroupFrame(SpectrumSubframe, "Peak fitting", kVerticalFrame);
+  SpectrumPeakFit_GF->SetTitlePos(TGGroupFrame::kCenter);
+  SpectrumSubframe->AddFrame(SpectrumPeakFit_GF, new TGLayoutHints(kLHintsNormal,0,5,0,0));
+
+  // Enable fitting of a Gaussian-plus-line to the region of interest
+  // (ROI) of the displayed spectrum in a background thread
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitEnable_CB = new TGCheckButton(SpectrumPeakFit_GF, "Live peak fit", SpectrumPeakFitEnable_CB_ID),
+			       new TGLayoutHints(kLHintsNormal,0,0,5,0));
+  SpectrumPeakFitEnable_CB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleCheckButtons()");
+  
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitMin_NEL = new ADAQNumberEntryWithLabel(SpectrumPeakFit_GF, "ROI min.", SpectrumPeakFitMin_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal,0,0,5,0));
+  SpectrumPeakFitMin_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESReal);
+  SpectrumPeakFitMin_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  SpectrumPeakFitMin_NEL->GetEntry()->SetNumber(0.);
+  
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitMax_NEL = new ADAQNumberEntryWithLabel(SpectrumPeakFit_GF, "ROI max.", SpectrumPeakFitMax_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal,0,0,0,0));
+  SpectrumPeakFitMax_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESReal);
+  SpectrumPeakFitMax_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  SpectrumPeakFitMax_NEL->GetEntry()->SetNumber(30000.);
+
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitPeriod_NEL = new ADAQNumberEntryWithLabel(SpectrumPeakFit_GF, "Fit period [s]", SpectrumPeakFitPeriod_NEL_ID),
+			       new TGLayoutHints(kLHintsNormal,0,0,0,5));
+  SpectrumPeakFitPeriod_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESReal);
+  SpectrumPeakFitPeriod_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  SpectrumPeakFitPeriod_NEL->GetEntry()->SetNumber(2.);
+  SpectrumPeakFitPeriod_NEL->GetEntry()->Connect("ValueSet(long)", "AASubtabSlots", SubtabSlots, "HandleNumberEntries()");
+
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitCentroid_NEFL = new ADAQNumberEntryFieldWithLabel(SpectrumPeakFit_GF, "Centroid", -1),
+			       new TGLayoutHints(kLHintsNormal,0,0,0,0));
+  SpectrumPeakFitCentroid_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESRealTwo);
+  SpectrumPeakFitCentroid_NEFL->GetEntry()->SetState(false);
+  
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitFWHM_NEFL = new ADAQNumberEntryFieldWithLabel(SpectrumPeakFit_GF, "FWHM", -1),
+			       new TGLayoutHints(kLHintsNormal,0,0,0,0));
+  SpectrumPeakFitFWHM_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESRealTwo);
+  SpectrumPeakFitFWHM_NEFL->GetEntry()->SetState(false);
+  
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitResolution_NEFL = new ADAQNumberEntryFieldWithLabel(SpectrumPeakFit_GF, "Resolution [%]", -1),
+			       new TGLayoutHints(kLHintsNormal,0,0,0,5));
+  SpectrumPeakFitResolution_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESRealTwo);
+  SpectrumPeakFitResolution_NEFL->GetEntry()->SetState(false);
+
+  // Send the fitted centroid to the calibration widgets and set the
+  // calibration point with the energy entered by the user
+  SpectrumPeakFit_GF->AddFrame(SpectrumPeakFitToCalibration_TB = new TGTextButton(SpectrumPeakFit_GF, "Centroid to cal. pt.", SpectrumPeakFitToCalibration_TB_ID),
+			       new TGLayoutHints(kLHintsNormal,5,5,5,0));
+  SpectrumPeakFitToCalibration_TB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleTextButtons()");
+  SpectrumPeakFitToCalibration_TB->Resize(130,25);
+  SpectrumPeakFitToCalibration_TB->ChangeOptions(SpectrumPeakFitToCalibration_TB->GetOptions() | kFixedSize);
+  SpectrumPeakFitToCalibration_TB->SetState(kButtonDisabled);
+
+
   //////////////////////////
   // Pulse discrimination //
   //////////////////////////
@@ -2260,6 +2526,25 @@ void AAInterface::FillAcquisitionFrame()
   WaveformStorage_GF->AddFrame(WaveformStorePSDData_CB = new TGCheckButton(WaveformStorage_GF,"Store PSD data",WaveformStorePSDData_CB_ID),
 			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
 
+  // Write the digitizer readout buffers undecoded to an ".adaq.raw"
+  // file for offline conversion with ADAQRawConvert
+  WaveformStorage_GF->AddFrame(WaveformStoreReadoutBuffers_CB = new TGCheckButton(WaveformStorage_GF,"Store raw readout buffers",WaveformStoreReadoutBuffers_CB_ID),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
+
+  // Store energy/PSD data in the compact column-wise "ListMode" tree
+  // rather than the waveform tree when waveforms are not stored
+  WaveformStorage_GF->AddFrame(WaveformStoreListMode_CB = new TGCheckButton(WaveformStorage_GF,"Compact list-mode storage",WaveformStoreListMode_CB_ID),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
+
+  // Store raw waveforms with the digitizer bit depth per sample
+  WaveformStorage_GF->AddFrame(WaveformStorePacked_CB = new TGCheckButton(WaveformStorage_GF,"Bit-pack stored waveforms",WaveformStorePacked_CB_ID),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
+
+  // Store raw waveforms with the lossless delta codec, which takes
+  // precedence over bit packing
+  WaveformStorage_GF->AddFrame(WaveformStoreDeltaCoded_CB = new TGCheckButton(WaveformStorage_GF,"Delta-encode stored waveforms",WaveformStoreDeltaCoded_CB_ID),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
+
 
   TGHorizontalFrame *WaveformCreateClose_HF = new TGHorizontalFrame(WaveformStorage_GF);
   WaveformStorage_GF->AddFrame(WaveformCreateClose_HF, new TGLayoutHints(kLHintsNormal,0,0,5,0));
@@ -2292,6 +2577,23 @@ void AAInterface::FillAcquisitionFrame()
   WaveformStorageEnable_CB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleCheckButtons()");
   WaveformStorageEnable_CB->SetState(kButtonDisabled);
 
+  // Status of the storage writer thread that writes events to disk
+  
+  WaveformStorage_GF->AddFrame(WaveformStorageQueue_NEFL = new ADAQNumberEntryFieldWithLabel(WaveformStorage_GF, "Queued events", -1),
+			       new TGLayoutHints(kLHintsNormal,5,5,5,0));
+  WaveformStorageQueue_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESInteger);
+  WaveformStorageQueue_NEFL->GetEntry()->SetState(false);
+  
+  WaveformStorage_GF->AddFrame(WaveformStorageRate_NEFL = new ADAQNumberEntryFieldWithLabel(WaveformStorage_GF, "Write rate [MB/s]", -1),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,0));
+  WaveformStorageRate_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESRealTwo);
+  WaveformStorageRate_NEFL->GetEntry()->SetState(false);
+
+  WaveformStorage_GF->AddFrame(WaveformStorageBackpressure_NEFL = new ADAQNumberEntryFieldWithLabel(WaveformStorage_GF, "Backpressure events", -1),
+			       new TGLayoutHints(kLHintsNormal,5,5,0,5));
+  WaveformStorageBackpressure_NEFL->GetEntry()->SetFormat(TGNumberFormat::kNESInteger);
+  WaveformStorageBackpressure_NEFL->GetEntry()->SetState(false);
+
   
   DGDisplayAndControls_VF->AddFrame(Display_VF, new TGLayoutHints(kLHintsCenterX,5,5,5,5));
   DGDisplayAndControls_VF->AddFrame(SubtabFrame, new TGLayoutHints(kLHintsCenterX,5,5,5,5));
@@ -2528,6 +2830,23 @@ void AAInterface::FillAcquisitionFrame()
 									       DrawWaveformWithBoth_RB_ID),
 				   new TGLayoutHints(kLHintsNormal, 0,3,3,-2));
   DrawWaveformWithBoth_RB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleRadioButtons()");
+
+  // The persistence display draws the decaying density of all
+  // waveforms rather than the most recent waveform
+  TGHorizontalFrame *WaveformPersistence_HF = new TGHorizontalFrame(DisplaySettings_GF);
+  DisplaySettings_GF->AddFrame(WaveformPersistence_HF, new TGLayoutHints(kLHintsNormal, 0,0,5,0));
+
+  WaveformPersistence_HF->AddFrame(WaveformPersistence_CB = new TGCheckButton(WaveformPersistence_HF, "Persistence", -1),
+				   new TGLayoutHints(kLHintsNormal, 0,10,2,0));
+  WaveformPersistence_CB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleCheckButtons()");
+
+  WaveformPersistence_HF->AddFrame(WaveformPersistenceDecay_NEL = new ADAQNumberEntryWithLabel(WaveformPersistence_HF, "Decay [s]", -1),
+				   new TGLayoutHints(kLHintsNormal, 0,0,0,0));
+  WaveformPersistenceDecay_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESRealOne);
+  WaveformPersistenceDecay_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEANonNegative);
+  WaveformPersistenceDecay_NEL->GetEntry()->SetNumber(2.0);
+  WaveformPersistenceDecay_NEL->GetEntry()->Resize(50,20);
+  WaveformPersistenceDecay_NEL->GetEntry()->Connect("ValueSet(Long_t)", "AASubtabSlots", SubtabSlots, "HandleNumberEntries()");
   
   
   TGGroupFrame *SpectrumDrawOptions_GF = new TGGroupFrame(DisplaySettings_GF, "Spectrum options", kHorizontalFrame);
@@ -2559,12 +2878,26 @@ void AAInterface::FillAcquisitionFrame()
   DisplayControl_GF->SetTitlePos(TGGroupFrame::kCenter);
   GraphicsSubframe->AddFrame(DisplayControl_GF, new TGLayoutHints(kLHintsNormal,5,5,5,5));
   
-  DisplayControl_GF->AddFrame(SpectrumRefreshRate_NEL = new ADAQNumberEntryWithLabel(DisplayControl_GF, "Display update freq.", -1),
+  DisplayControl_GF->AddFrame(DisplayFrameRate_NEL = new ADAQNumberEntryWithLabel(DisplayControl_GF, "Display rate (frames/s)", -1),
 			      new TGLayoutHints(kLHintsNormal, 0,0,10,0));
-  SpectrumRefreshRate_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
-  SpectrumRefreshRate_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
-  SpectrumRefreshRate_NEL->GetEntry()->Resize(50,20);
-  SpectrumRefreshRate_NEL->GetEntry()->SetNumber(100);
+  DisplayFrameRate_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  DisplayFrameRate_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  DisplayFrameRate_NEL->GetEntry()->SetLimits(TGNumberFormat::kNELLimitMinMax, 1, 60);
+  DisplayFrameRate_NEL->GetEntry()->Resize(50,20);
+  DisplayFrameRate_NEL->GetEntry()->SetNumber(10);
+
+  DisplayControl_GF->AddFrame(DisplayTiled_CB = new TGCheckButton(DisplayControl_GF, "Tile all enabled channels", -1),
+			      new TGLayoutHints(kLHintsNormal, 0,0,5,0));
+  DisplayTiled_CB->Connect("Clicked()", "AASubtabSlots", SubtabSlots, "HandleCheckButtons()");
+  
+  DisplayControl_GF->AddFrame(DisplayTileBudget_NEL = new ADAQNumberEntryWithLabel(DisplayControl_GF, "Tile redraw budget (ms)", -1),
+			      new TGLayoutHints(kLHintsNormal, 0,0,5,0));
+  DisplayTileBudget_NEL->GetEntry()->SetNumStyle(TGNumberFormat::kNESInteger);
+  DisplayTileBudget_NEL->GetEntry()->SetNumAttr(TGNumberFormat::kNEAPositive);
+  DisplayTileBudget_NEL->GetEntry()->SetLimits(TGNumberFormat::kNELLimitMinMax, 1, 1000);
+  DisplayTileBudget_NEL->GetEntry()->Resize(50,20);
+  DisplayTileBudget_NEL->GetEntry()->SetNumber(40);
+  DisplayTileBudget_NEL->GetEntry()->Connect("ValueSet(Long_t)", "AASubtabSlots", SubtabSlots, "HandleNumberEntries()");
 
   TGButtonGroup *DisplayControl_BG = new TGButtonGroup(DisplayControl_GF, "");
   DisplayControl_BG->SetBorderDrawn(false);
@@ -2673,6 +3006,11 @@ void AAInterface::FillAcquisitionFrame()
 // AAInterface software from the VME boards
 void AAInterface::HandleDisconnectAndTerminate(bool Terminate)
 {
+  // Stop any background threads before disconnecting
+  PeakFitTimer->TurnOff();
+  DisplayTimer->TurnOff();
+  PeakFitter->StopFitThread();
+  
   AAVMEManager::GetInstance()->SafelyDisconnectVMEBoards();
   
   if(Terminate)
@@ -2707,6 +3045,7 @@ void AAInterface::SetVoltageWidgetState(bool WidgetState, EButtonState ButtonSta
     HVChPower_TB[ch]->SetState(ButtonState);
   }
   HVMonitorEnable_CB->SetState(ButtonState);
+  HVMonitorPeriod_NEL->GetEntry()->SetState(WidgetState);
 }
 
 
@@ -2787,6 +3126,7 @@ void AAInterface::SetAcquisitionWidgetState(bool WidgetState, EButtonState Butto
   AQDataReductionEnable_CB->SetState(ButtonState);
   AQDataReductionFactor_NEL->GetEntry()->SetState(WidgetState);
   DGZLEEnable_CB->SetState(ButtonState);
+  DGZLEPulsePerSegment_CB->SetState(ButtonState);
 
 
   //////////////////////////
@@ -2804,7 +3144,8 @@ void AAInterface::SetAcquisitionWidgetState(bool WidgetState, EButtonState Butto
   SpectrumLDTrigger_CB->SetState(ButtonState);
   SpectrumLDTriggerChannel_CBL->GetComboBox()->SetEnabled(WidgetState);
 
-  SpectrumRefreshRate_NEL->GetEntry()->SetState(WidgetState);
+  DisplayFrameRate_NEL->GetEntry()->SetState(WidgetState);
+  DisplayTiled_CB->SetState(ButtonState);
   DisplayContinuous_RB->SetEnabled(WidgetState);
   DisplayUpdateable_RB->SetEnabled(WidgetState);
   DisplayNonUpdateable_RB->SetEnabled(WidgetState);
@@ -2923,6 +3264,25 @@ void AAInterface::SaveSettings()
   
   TheSettings->SettingsFileName = SettingsFileName_TEL->GetEntry()->GetText();
   TheSettings->AutoSaveSettings = AutoSaveSettings_CB->IsDown();
+
+  TheSettings->StorageCompressionAlgorithm = StorageCompressionAlgorithm_CBL->GetComboBox()->GetSelected();
+  TheSettings->StorageCompressionLevel = StorageCompressionLevel_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageThreads = StorageThreads_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageBasketSize = StorageBasketSize_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageAutoFlush = StorageAutoFlush_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageAutoSave = StorageAutoSave_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->StorageRotate = StorageRotate_CB->IsDown();
+  TheSettings->StorageRotateSize = StorageRotateSize_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageRotateTime = StorageRotateTime_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageRotateEvents = StorageRotateEvents_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->StorageSpool = StorageSpool_CB->IsDown();
+  TheSettings->StorageSpoolSync = StorageSpoolSync_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->SpectrumSnapshots = SpectrumSnapshots_CB->IsDown();
+  TheSettings->SpectrumSnapshotPeriod = SpectrumSnapshotPeriod_NEL->GetEntry()->GetIntNumber();
+  TheSettings->SpectrumSnapshotCumulative = SpectrumSnapshotCumulative_CB->IsDown();
   
   ////////////////////////
   // VME connection tab //
@@ -2969,6 +3329,7 @@ void AAInterface::SaveSettings()
       TheSettings->HVChVoltage[ch] = HVChVoltage_NEL[ch]->GetEntry()->GetIntNumber();
       TheSettings->HVChCurrent[ch] = HVChCurrent_NEL[ch]->GetEntry()->GetIntNumber();
     }
+    TheSettings->HVMonitorPeriod = HVMonitorPeriod_NEL->GetEntry()->GetIntNumber();
   }
   
   
@@ -3019,6 +3380,9 @@ void AAInterface::SaveSettings()
 	TheSettings->ChPreTrigger[ch] = DGChPreTrigger_NEL[ch]->GetEntry()->GetIntNumber();
 	TheSettings->ChGateOffset[ch] = DGChGateOffset_NEL[ch]->GetEntry()->GetIntNumber();
       }
+      TheSettings->ChStoragePrescale[ch] = DGChStoragePrescale_NEL[ch]->GetEntry()->GetIntNumber();
+      TheSettings->ChStorageThreshold[ch] = DGChStorageThreshold_NEL[ch]->GetEntry()->GetNumber();
+      TheSettings->ChStorageRateCap[ch] = DGChStorageRateCap_NEL[ch]->GetEntry()->GetIntNumber();
     }
   
     TheSettings->HorizontalSliderPtr = DisplayHorizontalScale_THS->GetPointerPosition();
@@ -3077,6 +3441,7 @@ void AAInterface::SaveSettings()
     TheSettings->DataReductionEnable = AQDataReductionEnable_CB->IsDown();
     TheSettings->DataReductionFactor = AQDataReductionFactor_NEL->GetEntry()->GetIntNumber();
     TheSettings->ZeroSuppressionEnable = DGZLEEnable_CB->IsDown();
+    TheSettings->ZLEPulsePerSegment = DGZLEPulsePerSegment_CB->IsDown();
 
 
     ///////////////////////
@@ -3101,6 +3466,11 @@ void AAInterface::SaveSettings()
     TheSettings->SpectrumCalibrationUseSlider = SpectrumUseCalibrationSlider_CB->IsDown();
     TheSettings->SpectrumCalibrationUnit = SpectrumCalibrationUnit_CBL->GetComboBox()->GetSelectedEntry()->GetTitle();
 
+    TheSettings->SpectrumPeakFitEnable = SpectrumPeakFitEnable_CB->IsDown();
+    TheSettings->SpectrumPeakFitMin = SpectrumPeakFitMin_NEL->GetEntry()->GetNumber();
+    TheSettings->SpectrumPeakFitMax = SpectrumPeakFitMax_NEL->GetEntry()->GetNumber();
+    TheSettings->SpectrumPeakFitPeriod = SpectrumPeakFitPeriod_NEL->GetEntry()->GetNumber();
+
 
     //////////////////////////////
     // Pulse discrimination subtab 
@@ -3126,6 +3496,10 @@ void AAInterface::SaveSettings()
     TheSettings->WaveformStoreRaw = WaveformStoreRaw_CB->IsDown();
     TheSettings->WaveformStoreEnergyData = WaveformStoreEnergyData_CB->IsDown();
     TheSettings->WaveformStorePSDData= WaveformStorePSDData_CB->IsDown();
+    TheSettings->WaveformStoreReadoutBuffers = WaveformStoreReadoutBuffers_CB->IsDown();
+    TheSettings->WaveformStoreListMode = WaveformStoreListMode_CB->IsDown();
+    TheSettings->WaveformStorePacked = WaveformStorePacked_CB->IsDown();
+    TheSettings->WaveformStoreDeltaCoded = WaveformStoreDeltaCoded_CB->IsDown();
 
     TheSettings->ObjectSaveWithTimeExtension = ObjectSaveWithTimeExtension_CB->IsDown();
     TheSettings->CanvasSaveWithTimeExtension = CanvasSaveWithTimeExtension_CB->IsDown();
@@ -3158,6 +3532,8 @@ void AAInterface::SaveSettings()
     TheSettings->WaveformWithLine = DrawWaveformWithLine_RB->IsDown();
     TheSettings->WaveformWithMarkers = DrawWaveformWithMarkers_RB->IsDown();
     TheSettings->WaveformWithBoth = DrawWaveformWithBoth_RB->IsDown();
+    TheSettings->WaveformPersistence = WaveformPersistence_CB->IsDown();
+    TheSettings->WaveformPersistenceDecay = WaveformPersistenceDecay_NEL->GetEntry()->GetNumber();
   
     TheSettings->SpectrumWithLine = DrawSpectrumWithLine_RB->IsDown();
     TheSettings->SpectrumWithMarkers = DrawSpectrumWithMarkers_RB->IsDown();
@@ -3167,7 +3543,9 @@ void AAInterface::SaveSettings()
     TheSettings->RateIntegrationPeriod = RatePlotPeriod_NEL->GetEntry()->GetNumber();
     TheSettings->RateDisplayPeriod = RatePlotDisp_NEL->GetEntry()->GetNumber();
 
-    TheSettings->SpectrumRefreshRate = SpectrumRefreshRate_NEL->GetEntry()->GetIntNumber();
+    TheSettings->DisplayFrameRate = DisplayFrameRate_NEL->GetEntry()->GetIntNumber();
+    TheSettings->DisplayTiled = DisplayTiled_CB->IsDown();
+    TheSettings->DisplayTileBudget = DisplayTileBudget_NEL->GetEntry()->GetIntNumber();
 
     TheSettings->DisplayContinuous = DisplayContinuous_RB->IsDown();
     TheSettings->DisplayUpdateable = DisplayUpdateable_RB->IsDown();
@@ -3225,6 +3603,7 @@ void AAInterface::SaveSettings()
       
       TheSettings->DataReductionEnable = AQDataReductionEnable_CB->IsDisabledAndSelected();
       TheSettings->ZeroSuppressionEnable = DGZLEEnable_CB->IsDisabledAndSelected();
+      TheSettings->ZLEPulsePerSegment = DGZLEPulsePerSegment_CB->IsDisabledAndSelected();
 
       TheSettings->SpectrumPulseHeight = SpectrumPulseHeight_RB->IsDisabledAndSelected();
       TheSettings->SpectrumPulseArea = SpectrumPulseArea_RB->IsDisabledAndSelected();
@@ -3237,6 +3616,10 @@ void AAInterface::SaveSettings()
       TheSettings->WaveformStoreRaw = WaveformStoreRaw_CB->IsDisabledAndSelected();
       TheSettings->WaveformStoreEnergyData = WaveformStoreEnergyData_CB->IsDisabledAndSelected();
       TheSettings->WaveformStorePSDData = WaveformStorePSDData_CB->IsDisabledAndSelected();
+      TheSettings->WaveformStoreReadoutBuffers = WaveformStoreReadoutBuffers_CB->IsDisabledAndSelected();
+      TheSettings->WaveformStoreListMode = WaveformStoreListMode_CB->IsDisabledAndSelected();
+      TheSettings->WaveformStorePacked = WaveformStorePacked_CB->IsDisabledAndSelected();
+      TheSettings->WaveformStoreDeltaCoded = WaveformStoreDeltaCoded_CB->IsDisabledAndSelected();
 
       TheSettings->DisplayContinuous = DisplayContinuous_RB->IsDisabledAndSelected();
       TheSettings->DisplayUpdateable = DisplayUpdateable_RB->IsDisabledAndSelected();
@@ -3249,6 +3632,11 @@ void AAInterface::SaveSettings()
   
   if(TheSettings->ChannelLockToZero)
     UpdateChannelSettingsToChannelZero();
+
+  // Settings that remain active during acquisition (storage, LD) may
+  // change which waveform analysis stages are required
+  if(AAAcquisitionManager::GetInstance()->GetAcquisitionEnable())
+    AAAcquisitionManager::GetInstance()->BuildAnalysisPlan();
 }
 
 
@@ -3259,6 +3647,33 @@ void AAInterface::SaveActiveSettings()
   TheSettings->WaveformStoreRaw = WaveformStoreRaw_CB->IsDown();
   TheSettings->WaveformStoreEnergyData = WaveformStoreEnergyData_CB->IsDown();
   TheSettings->WaveformStorePSDData= WaveformStorePSDData_CB->IsDown();
+  TheSettings->WaveformStoreReadoutBuffers = WaveformStoreReadoutBuffers_CB->IsDown();
+  TheSettings->WaveformStoreListMode = WaveformStoreListMode_CB->IsDown();
+  TheSettings->WaveformStorePacked = WaveformStorePacked_CB->IsDown();
+  TheSettings->WaveformStoreDeltaCoded = WaveformStoreDeltaCoded_CB->IsDown();
+
+  // The ADAQ file storage settings remain active during acquisition
+  TheSettings->StorageCompressionAlgorithm = StorageCompressionAlgorithm_CBL->GetComboBox()->GetSelected();
+  TheSettings->StorageCompressionLevel = StorageCompressionLevel_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageThreads = StorageThreads_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageBasketSize = StorageBasketSize_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageAutoFlush = StorageAutoFlush_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageAutoSave = StorageAutoSave_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->StorageRotate = StorageRotate_CB->IsDown();
+  TheSettings->StorageRotateSize = StorageRotateSize_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageRotateTime = StorageRotateTime_NEL->GetEntry()->GetIntNumber();
+  TheSettings->StorageRotateEvents = StorageRotateEvents_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->StorageSpool = StorageSpool_CB->IsDown();
+  TheSettings->StorageSpoolSync = StorageSpoolSync_NEL->GetEntry()->GetIntNumber();
+
+  TheSettings->SpectrumSnapshots = SpectrumSnapshots_CB->IsDown();
+  TheSettings->SpectrumSnapshotPeriod = SpectrumSnapshotPeriod_NEL->GetEntry()->GetIntNumber();
+  TheSettings->SpectrumSnapshotCumulative = SpectrumSnapshotCumulative_CB->IsDown();
+
+  if(AAAcquisitionManager::GetInstance()->GetAcquisitionEnable())
+    AAAcquisitionManager::GetInstance()->BuildAnalysisPlan();
 }
 
 
@@ -3310,6 +3725,47 @@ void AAInterface::LoadSettingsFromFile()
     AutoSaveSettings_CB->SetState(kButtonDown);
   else
     AutoSaveSettings_CB->SetState(kButtonUp);
+
+  // Settings files predating the storage settings have a zero basket
+  // size, in which case the widget defaults are retained
+  if(TheSettings->StorageBasketSize > 0){
+    StorageCompressionAlgorithm_CBL->GetComboBox()->Select(TheSettings->StorageCompressionAlgorithm);
+    StorageCompressionLevel_NEL->GetEntry()->SetIntNumber(TheSettings->StorageCompressionLevel);
+    StorageThreads_NEL->GetEntry()->SetIntNumber(TheSettings->StorageThreads);
+    StorageBasketSize_NEL->GetEntry()->SetIntNumber(TheSettings->StorageBasketSize);
+    StorageAutoFlush_NEL->GetEntry()->SetIntNumber(TheSettings->StorageAutoFlush);
+    StorageAutoSave_NEL->GetEntry()->SetIntNumber(TheSettings->StorageAutoSave);
+
+    if(TheSettings->StorageRotate)
+      StorageRotate_CB->SetState(kButtonDown);
+    else
+      StorageRotate_CB->SetState(kButtonUp);
+    
+    StorageRotateSize_NEL->GetEntry()->SetIntNumber(TheSettings->StorageRotateSize);
+    StorageRotateTime_NEL->GetEntry()->SetIntNumber(TheSettings->StorageRotateTime);
+    StorageRotateEvents_NEL->GetEntry()->SetIntNumber(TheSettings->StorageRotateEvents);
+
+    if(TheSettings->StorageSpool)
+      StorageSpool_CB->SetState(kButtonDown);
+    else
+      StorageSpool_CB->SetState(kButtonUp);
+
+    if(TheSettings->StorageSpoolSync > 0)
+      StorageSpoolSync_NEL->GetEntry()->SetIntNumber(TheSettings->StorageSpoolSync);
+
+    if(TheSettings->SpectrumSnapshots)
+      SpectrumSnapshots_CB->SetState(kButtonDown);
+    else
+      SpectrumSnapshots_CB->SetState(kButtonUp);
+
+    if(TheSettings->SpectrumSnapshotPeriod > 0)
+      SpectrumSnapshotPeriod_NEL->GetEntry()->SetIntNumber(TheSettings->SpectrumSnapshotPeriod);
+
+    if(TheSettings->SpectrumSnapshotCumulative)
+      SpectrumSnapshotCumulative_CB->SetState(kButtonDown);
+    else
+      SpectrumSnapshotCumulative_CB->SetState(kButtonUp);
+  }
   
   
   ////////////////////
@@ -3361,6 +3817,10 @@ void AAInterface::LoadSettingsFromFile()
       HVChVoltage_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->HVChVoltage[ch]);
       HVChCurrent_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->HVChCurrent[ch]);
     }
+    
+    // Settings files predating the HV monitor period hold none
+    if(TheSettings->HVMonitorPeriod > 0)
+      HVMonitorPeriod_NEL->GetEntry()->SetIntNumber(TheSettings->HVMonitorPeriod);
   }
   
   
@@ -3438,6 +3898,14 @@ void AAInterface::LoadSettingsFromFile()
 	DGChPreTrigger_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->ChPreTrigger[ch]);
 	DGChGateOffset_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->ChGateOffset[ch]);
       }
+
+      // Settings saved before the storage policies existed hold none
+      if(TheSettings->ChStoragePrescale.size() > (size_t)ch){
+	if(TheSettings->ChStoragePrescale[ch] > 0)
+	  DGChStoragePrescale_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->ChStoragePrescale[ch]);
+	DGChStorageThreshold_NEL[ch]->GetEntry()->SetNumber(TheSettings->ChStorageThreshold[ch]);
+	DGChStorageRateCap_NEL[ch]->GetEntry()->SetIntNumber(TheSettings->ChStorageRateCap[ch]);
+      }
     }
   
     // Acquisition display type
@@ -3524,6 +3992,11 @@ void AAInterface::LoadSettingsFromFile()
     else
       DGZLEEnable_CB->SetState(kButtonUp);
 
+    if(TheSettings->ZLEPulsePerSegment)
+      DGZLEPulsePerSegment_CB->SetState(kButtonDown);
+    else
+      DGZLEPulsePerSegment_CB->SetState(kButtonUp);
+
     ////////////////
     // Pulse spectra
 
@@ -3569,6 +4042,31 @@ void AAInterface::LoadSettingsFromFile()
 
     // TheSettings->SpectrumCalibrationUnit = SpectrumCalibrationUnit_CBL->GetComboBox()->GetSelectedEntry()->GetTitle();
 
+    // Settings files that predate peak fitting have these values
+    // zeroed; keep the widget defaults in that case
+    if(TheSettings->SpectrumPeakFitMax > TheSettings->SpectrumPeakFitMin){
+      SpectrumPeakFitMin_NEL->GetEntry()->SetNumber(TheSettings->SpectrumPeakFitMin);
+      SpectrumPeakFitMax_NEL->GetEntry()->SetNumber(TheSettings->SpectrumPeakFitMax);
+    }
+    if(TheSettings->SpectrumPeakFitPeriod > 0.)
+      SpectrumPeakFitPeriod_NEL->GetEntry()->SetNumber(TheSettings->SpectrumPeakFitPeriod);
+
+    // Setting the check button state does not emit a signal so the
+    // peak fitting must be explicitly (re)started here
+    if(TheSettings->SpectrumPeakFitEnable){
+      SpectrumPeakFitEnable_CB->SetState(kButtonDown);
+      SpectrumPeakFitToCalibration_TB->SetState(kButtonUp);
+      PeakFitter->Reset();
+      PeakFitter->StartFitThread();
+      PeakFitTimer->Start((Long_t)(SpectrumPeakFitPeriod_NEL->GetEntry()->GetNumber() * 1000), kFALSE);
+    }
+    else{
+      SpectrumPeakFitEnable_CB->SetState(kButtonUp);
+      SpectrumPeakFitToCalibration_TB->SetState(kButtonDisabled);
+      PeakFitTimer->TurnOff();
+      PeakFitter->StopFitThread();
+    }
+
 
     ///////////////////////
     // Pulse discrimination
@@ -3617,6 +4115,26 @@ void AAInterface::LoadSettingsFromFile()
     else
       WaveformStorePSDData_CB->SetState(kButtonUp);
 
+    if(TheSettings->WaveformStoreReadoutBuffers)
+      WaveformStoreReadoutBuffers_CB->SetState(kButtonDown);
+    else
+      WaveformStoreReadoutBuffers_CB->SetState(kButtonUp);
+
+    if(TheSettings->WaveformStoreListMode)
+      WaveformStoreListMode_CB->SetState(kButtonDown);
+    else
+      WaveformStoreListMode_CB->SetState(kButtonUp);
+
+    if(TheSettings->WaveformStorePacked)
+      WaveformStorePacked_CB->SetState(kButtonDown);
+    else
+      WaveformStorePacked_CB->SetState(kButtonUp);
+
+    if(TheSettings->WaveformStoreDeltaCoded)
+      WaveformStoreDeltaCoded_CB->SetState(kButtonDown);
+    else
+      WaveformStoreDeltaCoded_CB->SetState(kButtonUp);
+
     if(TheSettings->ObjectSaveWithTimeExtension)
       ObjectSaveWithTimeExtension_CB->SetState(kButtonDown);
     else
@@ -3701,6 +4219,13 @@ void AAInterface::LoadSettingsFromFile()
       DrawWaveformWithBoth_RB->SetState(kButtonDown);
     }
 
+    if(TheSettings->WaveformPersistence)
+      WaveformPersistence_CB->SetState(kButtonDown);
+    else
+      WaveformPersistence_CB->SetState(kButtonUp);
+    
+    WaveformPersistenceDecay_NEL->GetEntry()->SetNumber(TheSettings->WaveformPersistenceDecay);
+
     if(TheSettings->SpectrumWithLine){
       DrawSpectrumWithLine_RB->SetState(kButtonDown);
       DrawSpectrumWithMarkers_RB->SetState(kButtonUp);
@@ -3717,7 +4242,17 @@ void AAInterface::LoadSettingsFromFile()
       DrawSpectrumWithBars_RB->SetState(kButtonDown);
     }
 
-    SpectrumRefreshRate_NEL->GetEntry()->SetIntNumber(TheSettings->SpectrumRefreshRate);
+    // Settings files predating the display frame rate hold none
+    if(TheSettings->DisplayFrameRate > 0)
+      DisplayFrameRate_NEL->GetEntry()->SetIntNumber(TheSettings->DisplayFrameRate);
+
+    if(TheSettings->DisplayTiled)
+      DisplayTiled_CB->SetState(kButtonDown);
+    else
+      DisplayTiled_CB->SetState(kButtonUp);
+    
+    if(TheSettings->DisplayTileBudget > 0)
+      DisplayTileBudget_NEL->GetEntry()->SetIntNumber(TheSettings->DisplayTileBudget);
 
     if(TheSettings->DisplayContinuous){
       DisplayContinuous_RB->SetState(kButtonDown);
@@ -3787,6 +4322,26 @@ void AAInterface::UpdateAfterAQTimerStopped(bool ROOTFileOpen)
       WaveformStorePSDData_CB->SetState(kButtonDown);
     else
       WaveformStorePSDData_CB->SetState(kButtonUp);
+
+    if(WaveformStoreReadoutBuffers_CB->IsDisabledAndSelected())
+      WaveformStoreReadoutBuffers_CB->SetState(kButtonDown);
+    else
+      WaveformStoreReadoutBuffers_CB->SetState(kButtonUp);
+
+    if(WaveformStoreListMode_CB->IsDisabledAndSelected())
+      WaveformStoreListMode_CB->SetState(kButtonDown);
+    else
+      WaveformStoreListMode_CB->SetState(kButtonUp);
+
+    if(WaveformStorePacked_CB->IsDisabledAndSelected())
+      WaveformStorePacked_CB->SetState(kButtonDown);
+    else
+      WaveformStorePacked_CB->SetState(kButtonUp);
+
+    if(WaveformStoreDeltaCoded_CB->IsDisabledAndSelected())
+      WaveformStoreDeltaCoded_CB->SetState(kButtonDown);
+    else
+      WaveformStoreDeltaCoded_CB->SetState(kButtonUp);
   }
   
   WaveformCreateFile_TB->SetState(kButtonDisabled);
@@ -3823,6 +4378,25 @@ void AAInterface::UpdateHVMonitors(int Channel, int HV, int I)
 }
 
 
+void AAInterface::UpdateAnalysisPlan(AnalysisPlanStruct Plan)
+{
+  string Stages;
+  if(Plan.Baseline) Stages += " baseline";
+  if(Plan.PulseAnalysis) Stages += " pulse";
+  if(Plan.PSDIntegrals) Stages += " PSD";
+  if(Plan.ZLESegments) Stages += " ZLE-segments";
+  if(Plan.Calibration) Stages += " calibration";
+  if(Plan.Display) Stages += " display";
+  if(Stages.empty()) Stages = " none";
+  
+  AQAnalysisPlan_L->SetText(("Analysis :" + Stages).c_str());
+  AQAnalysisCost_NEFL->GetEntry()->SetNumber(Plan.Cost);
+
+  // The label may have grown so the group frame must be laid out
+  AQAnalysisPlan_L->GetParent()->Layout();
+}
+
+
 void AAInterface::UpdateChannelSettingsToChannelZero()
 {
   AAVMEManager *TheVMEManager = AAVMEManager::GetInstance();
@@ -3863,6 +4437,10 @@ void AAInterface::UpdateChannelSettingsToChannelZero()
       DGChPreTrigger_NEL[ch]->GetEntry()->SetIntNumber(DGChPreTrigger_NEL[0]->GetEntry()->GetIntNumber());
       DGChGateOffset_NEL[ch]->GetEntry()->SetIntNumber(DGChGateOffset_NEL[0]->GetEntry()->GetIntNumber());
     }
+
+    DGChStoragePrescale_NEL[ch]->GetEntry()->SetIntNumber(DGChStoragePrescale_NEL[0]->GetEntry()->GetIntNumber());
+    DGChStorageThreshold_NEL[ch]->GetEntry()->SetNumber(DGChStorageThreshold_NEL[0]->GetEntry()->GetNumber());
+    DGChStorageRateCap_NEL[ch]->GetEntry()->SetIntNumber(DGChStorageRateCap_NEL[0]->GetEntry()->GetIntNumber());
   }
 }
 
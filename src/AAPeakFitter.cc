@@ -0,0 +1,411 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //      
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// C++
+#include <iostream>
+#include <cmath>
+
+// ADAQAcquisition
+#include "AAPeakFitter.hh"
+
+
+AAPeakFitter::AAPeakFitter()
+  : FitThread(NULL),
+    FitThreadEnable(false), SnapshotPending(false), ResultPending(false),
+    SnapshotChannel(-1), SnapshotMin(0.), SnapshotMax(0.),
+    ParametersValid(false), FitChannel(-1), FitMin(0.), FitMax(0.), FitCounts(0.)
+{
+  for(Int_t p=0; p<5; p++)
+    Parameters[p] = 0.;
+  
+  FitResult.Valid = false;
+  FitResult.Channel = -1;
+  FitResult.Centroid = FitResult.FWHM = FitResult.Resolution = 0.;
+  FitResult.Counts = FitResult.ChiSquareNDF = 0.;
+}
+
+
+AAPeakFitter::~AAPeakFitter()
+{
+  StopFitThread();
+}
+
+
+void AAPeakFitter::StartFitThread()
+{
+  if(FitThread)
+    return;
+  
+  FitThreadEnable = true;
+  FitThread = new boost::thread(&AAPeakFitter::RunFitThread, this);
+}
+
+
+void AAPeakFitter::StopFitThread()
+{
+  if(!FitThread)
+    return;
+
+  {
+    boost::lock_guard<boost::mutex> Lock(FitMutex);
+    FitThreadEnable = false;
+  }
+  FitCondition.notify_one();
+
+  FitThread->join();
+  delete FitThread;
+  FitThread = NULL;
+}
+
+
+Bool_t AAPeakFitter::SubmitSnapshot(TH1F *Spectrum_H, Int_t Channel,
+				    Double_t Min, Double_t Max)
+{
+  if(!FitThread or Spectrum_H == NULL or Max <= Min)
+    return false;
+
+  Int_t MinBin = Spectrum_H->FindFixBin(Min);
+  Int_t MaxBin = Spectrum_H->FindFixBin(Max);
+
+  // Keep the ROI within the histogram (ignore under/overflow bins)
+  if(MinBin < 1)
+    MinBin = 1;
+  if(MaxBin > Spectrum_H->GetNbinsX())
+    MaxBin = Spectrum_H->GetNbinsX();
+  
+  // A Gaussian-plus-line has five free parameters; require a
+  // reasonable number of bins more than that to attempt a fit
+  if(MaxBin - MinBin + 1 < 10)
+    return false;
+
+  boost::lock_guard<boost::mutex> Lock(FitMutex);
+
+  // Snapshots are not queued: if the fitting thread has not yet
+  // picked up the previous snapshot then it is simply replaced
+  SnapshotX.clear();
+  SnapshotY.clear();
+  for(Int_t bin=MinBin; bin<=MaxBin; bin++){
+    SnapshotX.push_back(Spectrum_H->GetBinCenter(bin));
+    SnapshotY.push_back(Spectrum_H->GetBinContent(bin));
+  }
+  SnapshotChannel = Channel;
+  SnapshotMin = Min;
+  SnapshotMax = Max;
+  SnapshotPending = true;
+
+  FitCondition.notify_one();
+
+  return true;
+}
+
+
+Bool_t AAPeakFitter::GetLatestResult(PeakFitResultStruct &Result)
+{
+  boost::lock_guard<boost::mutex> Lock(FitMutex);
+  
+  if(!ResultPending)
+    return false;
+  
+  Result = FitResult;
+  ResultPending = false;
+  
+  return true;
+}
+
+
+void AAPeakFitter::Reset()
+{
+  boost::lock_guard<boost::mutex> Lock(FitMutex);
+
+  SnapshotPending = ResultPending = false;
+  ParametersValid = false;
+  FitChannel = -1;
+  FitCounts = 0.;
+  FitResult.Valid = false;
+}
+
+
+void AAPeakFitter::RunFitThread()
+{
+  vector<Double_t> X, Y;
+  
+  while(true){
+    
+    Int_t Channel;
+    Double_t Min, Max;
+    Double_t P[5];
+    Bool_t WarmStart;
+    
+    {
+      boost::unique_lock<boost::mutex> Lock(FitMutex);
+      
+      while(!SnapshotPending and FitThreadEnable)
+	FitCondition.wait(Lock);
+      
+      if(!FitThreadEnable)
+	break;
+      
+      X.swap(SnapshotX);
+      Y.swap(SnapshotY);
+      Channel = SnapshotChannel;
+      Min = SnapshotMin;
+      Max = SnapshotMax;
+      SnapshotPending = false;
+
+      // Reuse the previous fit parameters as the starting point only
+      // if the channel and ROI are unchanged since the last fit
+      WarmStart = (ParametersValid and Channel == FitChannel and
+		   Min == FitMin and Max == FitMax);
+      
+      for(Int_t p=0; p<5; p++)
+	P[p] = Parameters[p];
+
+      // No new counts in the ROI means there is nothing new to fit
+      Double_t Counts = 0.;
+      for(size_t i=0; i<Y.size(); i++)
+	Counts += Y[i];
+      
+      if(WarmStart and Counts == FitCounts)
+	continue;
+      
+      FitCounts = Counts;
+    }
+    
+    Bool_t Success = FitGaussianPlusLine(X, Y, P, WarmStart);
+    
+    // If the warm-started fit wandered off then retry from scratch
+    if(!Success and WarmStart)
+      Success = FitGaussianPlusLine(X, Y, P, false);
+    
+    boost::lock_guard<boost::mutex> Lock(FitMutex);
+    
+    FitChannel = Channel;
+    FitMin = Min;
+    FitMax = Max;
+    
+    ParametersValid = Success;
+    for(Int_t p=0; p<5; p++)
+      Parameters[p] = P[p];
+
+    FitResult.Valid = Success;
+    FitResult.Channel = Channel;
+    FitResult.Counts = FitCounts;
+    
+    if(Success){
+      FitResult.Centroid = P[1];
+      FitResult.FWHM = 2. * sqrt(2. * log(2.)) * fabs(P[2]);
+      FitResult.Resolution = (P[1] > 0. ? 100. * FitResult.FWHM / P[1] : 0.);
+      
+      Int_t NDF = X.size() - 5;
+      FitResult.ChiSquareNDF = ComputeChiSquare(X, Y, P) / NDF;
+    }
+    
+    ResultPending = true;
+  }
+}
+
+
+// The model is a Gaussian on a linear background:
+//
+//   f(x) = P[0] * exp(-0.5 * ((x - P[1]) / P[2])**2) + P[3] + P[4] * (x - xc)
+//
+// where xc is the center of the ROI, which keeps the background
+// parameters well conditioned. The fit minimizes the chi-square with
+// Poisson weights using the Levenberg-Marquardt method. No ROOT
+// objects are used since the fit runs outside of the ROOT GUI thread
+
+Double_t AAPeakFitter::ComputeChiSquare(vector<Double_t> &X,
+					vector<Double_t> &Y,
+					Double_t *P)
+{
+  Double_t XC = 0.5 * (X.front() + X.back());
+  Double_t ChiSquare = 0.;
+  
+  for(size_t i=0; i<X.size(); i++){
+    Double_t Arg = (X[i] - P[1]) / P[2];
+    Double_t F = P[0] * exp(-0.5 * Arg * Arg) + P[3] + P[4] * (X[i] - XC);
+    Double_t W = (Y[i] > 1. ? 1. / Y[i] : 1.);
+    ChiSquare += W * (Y[i] - F) * (Y[i] - F);
+  }
+  return ChiSquare;
+}
+
+
+Bool_t AAPeakFitter::FitGaussianPlusLine(vector<Double_t> &X,
+					 vector<Double_t> &Y,
+					 Double_t *P,
+					 Bool_t UseInitialParameters)
+{
+  const Int_t NP = 5;
+  const Int_t N = X.size();
+  
+  Double_t XC = 0.5 * (X.front() + X.back());
+
+  ////////////////////////////////
+  // Initial parameter estimation
+
+  if(!UseInitialParameters){
+
+    // Estimate the background from the average of the outermost
+    // three bins on each edge of the ROI
+    Double_t YL = (Y[0] + Y[1] + Y[2]) / 3.;
+    Double_t YR = (Y[N-1] + Y[N-2] + Y[N-3]) / 3.;
+    Double_t XL = X[1], XR = X[N-2];
+
+    P[4] = (YR - YL) / (XR - XL);
+    P[3] = YL + P[4] * (XC - XL);
+
+    // Estimate the peak from the moments of the background
+    // subtracted counts
+    Double_t Sum = 0., SumX = 0., SumXX = 0., Peak = 0.;
+    for(Int_t i=0; i<N; i++){
+      Double_t Net = Y[i] - (P[3] + P[4] * (X[i] - XC));
+      if(Net <= 0.)
+	continue;
+      Sum += Net;
+      SumX += Net * X[i];
+      SumXX += Net * X[i] * X[i];
+      if(Net > Peak)
+	Peak = Net;
+    }
+
+    if(Sum <= 0.)
+      return false;
+    
+    P[0] = Peak;
+    P[1] = SumX / Sum;
+    P[2] = sqrt(fabs(SumXX / Sum - P[1] * P[1]));
+    
+    if(P[2] <= 0.)
+      P[2] = (X.back() - X.front()) / 6.;
+  }
+
+  //////////////////////////////
+  // Levenberg-Marquardt fitting
+  
+  Double_t Lambda = 1e-3;
+  Double_t ChiSquare = ComputeChiSquare(X, Y, P);
+  
+  for(Int_t Iteration=0; Iteration<100; Iteration++){
+    
+    Double_t Alpha[NP][NP] = {{0.}};
+    Double_t Beta[NP] = {0.};
+    
+    for(Int_t i=0; i<N; i++){
+      Double_t Arg = (X[i] - P[1]) / P[2];
+      Double_t G = exp(-0.5 * Arg * Arg);
+      Double_t F = P[0] * G + P[3] + P[4] * (X[i] - XC);
+      Double_t W = (Y[i] > 1. ? 1. / Y[i] : 1.);
+      
+      // Partial derivatives of the model with respect to parameters
+      Double_t D[NP];
+      D[0] = G;
+      D[1] = P[0] * G * Arg / P[2];
+      D[2] = P[0] * G * Arg * Arg / P[2];
+      D[3] = 1.;
+      D[4] = X[i] - XC;
+
+      for(Int_t j=0; j<NP; j++){
+	Beta[j] += W * (Y[i] - F) * D[j];
+	for(Int_t k=0; k<=j; k++)
+	  Alpha[j][k] += W * D[j] * D[k];
+      }
+    }
+    
+    for(Int_t j=0; j<NP; j++)
+      for(Int_t k=0; k<j; k++)
+	Alpha[k][j] = Alpha[j][k];
+
+    // Solve (Alpha + Lambda * diag(Alpha)) * Delta = Beta via
+    // Gaussian elimination with partial pivoting
+    
+    Double_t M[NP][NP+1];
+    for(Int_t j=0; j<NP; j++){
+      for(Int_t k=0; k<NP; k++)
+	M[j][k] = Alpha[j][k];
+      M[j][j] *= (1. + Lambda);
+      M[j][NP] = Beta[j];
+    }
+
+    Bool_t Singular = false;
+    for(Int_t c=0; c<NP; c++){
+      Int_t Pivot = c;
+      for(Int_t r=c+1; r<NP; r++)
+	if(fabs(M[r][c]) > fabs(M[Pivot][c]))
+	  Pivot = r;
+      
+      if(fabs(M[Pivot][c]) < 1e-300){
+	Singular = true;
+	break;
+      }
+      
+      for(Int_t k=0; k<=NP; k++)
+	swap(M[c][k], M[Pivot][k]);
+      
+      for(Int_t r=c+1; r<NP; r++){
+	Double_t Factor = M[r][c] / M[c][c];
+	for(Int_t k=c; k<=NP; k++)
+	  M[r][k] -= Factor * M[c][k];
+      }
+    }
+    
+    if(Singular)
+      return false;
+
+    Double_t Delta[NP];
+    for(Int_t r=NP-1; r>=0; r--){
+      Double_t Sum = M[r][NP];
+      for(Int_t k=r+1; k<NP; k++)
+	Sum -= M[r][k] * Delta[k];
+      Delta[r] = Sum / M[r][r];
+    }
+
+    Double_t Trial[NP];
+    for(Int_t j=0; j<NP; j++)
+      Trial[j] = P[j] + Delta[j];
+
+    if(Trial[2] == 0.){
+      Lambda *= 10.;
+      continue;
+    }
+    
+    Double_t TrialChiSquare = ComputeChiSquare(X, Y, Trial);
+    
+    if(TrialChiSquare < ChiSquare){
+      for(Int_t j=0; j<NP; j++)
+	P[j] = Trial[j];
+
+      Bool_t Converged = (ChiSquare - TrialChiSquare) < 1e-6 * ChiSquare;
+
+      ChiSquare = TrialChiSquare;
+      Lambda /= 10.;
+
+      if(Converged)
+	break;
+    }
+    else{
+      Lambda *= 10.;
+      if(Lambda > 1e10)
+	break;
+    }
+  }
+
+  P[2] = fabs(P[2]);
+
+  // Reject unphysical results: the peak must be positive and lie
+  // within the ROI with a width smaller than the ROI itself
+  if(P[0] <= 0. or P[1] < X.front() or P[1] > X.back() or
+     P[2] > (X.back() - X.front()))
+    return false;
+  
+  return true;
+}
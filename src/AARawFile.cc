@@ -0,0 +1,295 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TMemFile.h>
+#include <TFile.h>
+
+// ADAQAcquisition
+#include "AARawFile.hh"
+
+
+AARawFile::AARawFile()
+  : ReadoutManager(NULL), WaveformTree(NULL), IndexTree(NULL),
+    IndexChannel(0), IndexEntry(0)
+{;}
+
+
+AARawFile::~AARawFile()
+{
+  for(size_t ch=0; ch<WaveformData.size(); ch++)
+    delete WaveformData[ch];
+
+  if(ReadoutManager)
+    delete ReadoutManager;
+}
+
+
+Bool_t AARawFile::WriteSettings(AASettings *TheSettings, vector<char> &Block)
+{
+  Block.clear();
+
+  // Writing the in-memory file writes its StreamerInfo record and
+  // header such that the copied image is a complete ROOT file
+  TMemFile SettingsFile("AARawFileSettings.root", "RECREATE");
+  if(SettingsFile.IsZombie())
+    return false;
+
+  SettingsFile.WriteTObject(TheSettings, "AASettings");
+  SettingsFile.Write();
+
+  Block.resize(SettingsFile.GetSize());
+  Long64_t Size = SettingsFile.CopyTo(&Block[0], Block.size());
+  Block.resize(Size);
+
+  return (Size > 0);
+}
+
+
+AASettings *AARawFile::ReadSettings(vector<char> &Block)
+{
+  if(Block.empty())
+    return NULL;
+
+  TMemFile SettingsFile("AARawFileSettings.root", &Block[0], Block.size(), "READ");
+  if(SettingsFile.IsZombie())
+    return NULL;
+
+  AASettings *TheSettings = NULL;
+  SettingsFile.GetObject("AASettings", TheSettings);
+
+  return TheSettings;
+}
+
+
+void AARawFile::CreateADAQFile(string FileName,
+			       RawFileHeaderStruct &Header,
+			       AASettings *TheSettings)
+{
+  ReadoutManager = new ADAQReadoutManager;
+  ReadoutManager->CreateFile(FileName);
+
+  WaveformTree = ReadoutManager->GetWaveformTree();
+
+  // Apply the compression used by ADAQAcquisition for the settings
+  // to the file before creating the branches since ROOT branches
+  // take the file settings on creation
+  Int_t Compression = 0;
+  if(TheSettings->StorageCompressionAlgorithm > 0 and TheSettings->StorageCompressionLevel > 0)
+    Compression = (TheSettings->StorageCompressionAlgorithm * 100 +
+		   TheSettings->StorageCompressionLevel);
+  WaveformTree->GetCurrentFile()->SetCompressionSettings(Compression);
+
+  Int_t DGChannels = Header.DGNumChannels;
+
+  Waveforms.assign(DGChannels, vector<uint16_t>());
+  WaveformData.assign(DGChannels, (ADAQWaveformData *)NULL);
+  ChannelBranches.assign(DGChannels, vector<TBranch *>());
+  ChannelEntries.assign(DGChannels, 0);
+
+  for(Int_t ch=0; ch<DGChannels; ch++){
+    WaveformData[ch] = new ADAQWaveformData;
+
+    Int_t FirstBranch = WaveformTree->GetListOfBranches()->GetEntriesFast();
+
+    ReadoutManager->CreateWaveformTreeBranches(ch, &Waveforms[ch], WaveformData[ch]);
+
+    TObjArray *Branches = WaveformTree->GetListOfBranches();
+    for(Int_t b=FirstBranch; b<Branches->GetEntriesFast(); b++){
+      TBranch *Branch = (TBranch *)Branches->At(b);
+      Branch->SetCompressionSettings(Compression);
+      ChannelBranches[ch].push_back(Branch);
+    }
+  }
+
+  if(TheSettings->StorageBasketSize > 0)
+    WaveformTree->SetBasketSize("*", TheSettings->StorageBasketSize * 1024);
+
+  IndexTree = new TTree("WaveformIndex", "Channel and branch entry of each stored event");
+  IndexTree->SetDirectory(WaveformTree->GetDirectory());
+  IndexTree->Branch("Channel", &IndexChannel, "Channel/I");
+  IndexTree->Branch("Entry", &IndexEntry, "Entry/L");
+
+  FillReadoutInformation(Header, TheSettings);
+}
+
+
+void AARawFile::FillEvent(Int_t Channel)
+{
+  for(size_t b=0; b<ChannelBranches[Channel].size(); b++)
+    ChannelBranches[Channel][b]->Fill();
+
+  IndexChannel = Channel;
+  IndexEntry = ChannelEntries[Channel]++;
+  IndexTree->Fill();
+}
+
+
+void AARawFile::CloseADAQFile()
+{
+  if(!ReadoutManager)
+    return;
+
+  WaveformTree->SetEntries(-1);
+  IndexTree->Write("", TObject::kOverwrite);
+  ReadoutManager->WriteFile();
+}
+
+
+// Fill the readout information as in
+// AAAcquisitionManager::PrepareADAQFile(). The baseline and DPP-PSD
+// integral regions, which ADAQAcquisition computes from the settings
+// and the digitizer in AAAcquisitionManager::PrepareAcquisition(),
+// are recomputed here from the settings and the digitizer model
+void AARawFile::FillReadoutInformation(RawFileHeaderStruct &Header,
+				       AASettings *TheSettings)
+{
+  ADAQReadoutInformation *ARI = ReadoutManager->GetReadoutInformation();
+
+  Int_t DGChannels = Header.DGNumChannels;
+  string ModelName = Header.DGModelName;
+
+  // Set physical information about the digitizer device
+
+  ARI->SetDGModelName      (Header.DGModelName);
+  ARI->SetDGSerialNumber   (Header.DGSerialNumber);
+  ARI->SetDGNumChannels    (Header.DGNumChannels);
+  ARI->SetDGBitDepth       (Header.DGBitDepth);
+  ARI->SetDGSamplingRate   (Header.DGSamplingRate);
+  if(TheSettings->STDFirmware)
+    ARI->SetDGFWType       ("Standard");
+  else if(TheSettings->PSDFirmware)
+    ARI->SetDGFWType       ("DPP-PSD");
+
+  // Fill global acquisition settings
+
+  ARI->SetTriggerType          (TheSettings->TriggerTypeName);
+  ARI->SetTriggerEdge          (TheSettings->TriggerEdgeName);
+  ARI->SetAcquisitionType      (TheSettings->AcquisitionControlName);
+  ARI->SetDataReductionMode    (TheSettings->DataReductionEnable);
+  ARI->SetZeroSuppressionMode  (TheSettings->ZeroSuppressionEnable);
+  ARI->SetCoincidenceLevel     (TheSettings->TriggerCoincidenceLevel);
+
+  // Fill firmware-agnostic channel-specific settings
+
+  ARI->SetChannelEnable    (TheSettings->ChEnable);
+  ARI->SetDCOffset         (TheSettings->ChDCOffset);
+  ARI->SetTrigger          (TheSettings->ChTriggerThreshold);
+
+  if(TheSettings->STDFirmware){
+    ARI->SetBaselineCalcMin  (TheSettings->ChBaselineCalcMin);
+    ARI->SetBaselineCalcMax  (TheSettings->ChBaselineCalcMax);
+    ARI->SetPSDTotalStart    (TheSettings->ChPSDTotalStart);
+    ARI->SetPSDTotalStop     (TheSettings->ChPSDTotalStop);
+    ARI->SetPSDTailStart     (TheSettings->ChPSDTailStart);
+    ARI->SetPSDTailStop      (TheSettings->ChPSDTailStop);
+  }
+  else if(TheSettings->PSDFirmware){
+
+    // The baseline is a fixed number of samples before the gate; the
+    // number of samples of each selection depends on the digitizer
+    Bool_t Is720 = (ModelName.find("1720") != string::npos or
+		    ModelName.find("5720") != string::npos or
+		    ModelName.find("5790") != string::npos);
+    Bool_t Is725 = (ModelName.find("1725") != string::npos or
+		    ModelName.find("5730") != string::npos);
+
+    vector<Int_t> BaselineStart(DGChannels), BaselineStop(DGChannels);
+    vector<Int_t> PSDTotalStart(DGChannels), PSDTotalStop(DGChannels);
+    vector<Int_t> PSDTailStart(DGChannels), PSDTailStop(DGChannels);
+
+    for(Int_t ch=0; ch<DGChannels; ch++){
+      Int_t BaselineSamples = 0;
+      Int_t BaselineSelection = TheSettings->ChBaselineSamples[ch];
+
+      if(Is720){
+	switch(BaselineSelection){
+	case 1:
+	  BaselineSamples = 8;
+	  break;
+	case 2:
+	  BaselineSamples = 32;
+	  break;
+	case 3:
+	  BaselineSamples = 128;
+	  break;
+	default:
+	  break;
+	}
+      }
+      else if(Is725){
+	switch(BaselineSelection){
+	case 1:
+	  BaselineSamples = 16;
+	  break;
+	case 2:
+	  BaselineSamples = 64;
+	  break;
+	case 3:
+	  BaselineSamples = 256;
+	  break;
+	case 4:
+	  BaselineSamples = 1024;
+	  break;
+	default:
+	  break;
+	}
+      }
+
+      BaselineStop[ch] = TheSettings->ChPreTrigger[ch] - TheSettings->ChGateOffset[ch] - 1;
+      BaselineStart[ch] = BaselineStop[ch] - BaselineSamples;
+
+      Int_t GateStart = TheSettings->ChPreTrigger[ch] - TheSettings->ChGateOffset[ch];
+      PSDTotalStart[ch] = PSDTailStart[ch] = GateStart;
+      PSDTotalStop[ch] = GateStart + TheSettings->ChLongGate[ch];
+      PSDTailStop[ch] = GateStart + TheSettings->ChShortGate[ch];
+    }
+
+    ARI->SetBaselineCalcMin  (BaselineStart);
+    ARI->SetBaselineCalcMax  (BaselineStop);
+    ARI->SetPSDTotalStart    (PSDTotalStart);
+    ARI->SetPSDTotalStop     (PSDTotalStop);
+    ARI->SetPSDTailStart     (PSDTailStart);
+    ARI->SetPSDTailStop      (PSDTailStop);
+  }
+
+  // Fill CAEN standard firmware specific settings
+
+  if(TheSettings->STDFirmware){
+    ARI->SetRecordLength     (TheSettings->RecordLength);
+    ARI->SetPostTrigger      (TheSettings->PostTrigger);
+
+    ARI->SetZLEFwd           (TheSettings->ChZLEForward);
+    ARI->SetZLEBck           (TheSettings->ChZLEBackward);
+    ARI->SetZLEThreshold     (TheSettings->ChZLEThreshold);
+  }
+
+  // Fill CAEN DPP-PSD firmware specific settings
+
+  else if(TheSettings->PSDFirmware){
+    ARI->SetChRecordLength       (TheSettings->ChRecordLength);
+    ARI->SetChChargeSensitivity  (TheSettings->ChChargeSensitivity);
+    ARI->SetChPSDCut             (TheSettings->ChPSDCut);
+    ARI->SetChTriggerConfig      (TheSettings->ChTriggerConfig);
+    ARI->SetChTriggerValidation  (TheSettings->ChTriggerValidation);
+    ARI->SetChShortGate          (TheSettings->ChShortGate);
+    ARI->SetChLongGate           (TheSettings->ChLongGate);
+    ARI->SetChPreTrigger         (TheSettings->ChPreTrigger);
+    ARI->SetChGateOffset         (TheSettings->ChGateOffset);
+  }
+
+  // Fill information regarding waveform acquisition
+
+  ARI->SetStoreRawWaveforms  (TheSettings->WaveformStoreRaw);
+  ARI->SetStoreEnergyData    (TheSettings->WaveformStoreEnergyData);
+  ARI->SetStorePSDData       (TheSettings->WaveformStorePSDData);
+}
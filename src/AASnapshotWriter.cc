@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TParameter.h>
+
+// C++
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+// ADAQAcquisition
+#include "AASnapshotWriter.hh"
+
+
+AASnapshotWriter::AASnapshotWriter()
+  : FileName(""), Cumulative(true), WriterThreadEnable(false),
+    WriterThread(NULL)
+{;}
+
+
+AASnapshotWriter::~AASnapshotWriter()
+{
+  StopWriterThread();
+}
+
+
+void AASnapshotWriter::StartWriterThread(string Name, Bool_t CumulativeSnapshots)
+{
+  if(WriterThread)
+    return;
+
+  FileName = Name;
+  Cumulative = CumulativeSnapshots;
+
+  WriterThreadEnable = true;
+  WriterThread = new boost::thread(&AASnapshotWriter::RunWriterThread, this);
+}
+
+
+void AASnapshotWriter::StopWriterThread()
+{
+  if(!WriterThread)
+    return;
+
+  {
+    boost::lock_guard<boost::mutex> Lock(QueueMutex);
+    WriterThreadEnable = false;
+  }
+  SnapshotQueued.notify_one();
+
+  WriterThread->join();
+  delete WriterThread;
+  WriterThread = NULL;
+}
+
+
+void AASnapshotWriter::SubmitSnapshot(SpectrumSnapshot *Snapshot)
+{
+  {
+    boost::lock_guard<boost::mutex> Lock(QueueMutex);
+    Snapshots.push_back(Snapshot);
+  }
+  SnapshotQueued.notify_one();
+}
+
+
+void AASnapshotWriter::RunWriterThread()
+{
+  // The file is created, written, and closed only by this thread
+  TFile *SnapshotFile = new TFile(FileName.c_str(), "recreate");
+
+  if(!SnapshotFile->IsOpen())
+    cout << "\nError! AASnapshotWriter::RunWriterThread() could not create the snapshot\n"
+	 <<   "       file '" << FileName << "'! Snapshots will not be written.\n"
+	 << endl;
+  else{
+    TParameter<Int_t> Cumulative_P("Cumulative", Cumulative);
+    SnapshotFile->WriteTObject(&Cumulative_P);
+  }
+
+  while(true){
+
+    SpectrumSnapshot *Snapshot = NULL;
+
+    {
+      boost::unique_lock<boost::mutex> Lock(QueueMutex);
+
+      while(Snapshots.empty() and WriterThreadEnable)
+	SnapshotQueued.wait(Lock);
+
+      // Exit only once all submitted snapshots are written
+      if(Snapshots.empty() and !WriterThreadEnable)
+	break;
+
+      Snapshot = Snapshots.front();
+      Snapshots.pop_front();
+    }
+
+    if(SnapshotFile->IsOpen()){
+      stringstream SS;
+      SS << "Snapshot" << setw(4) << setfill('0') << Snapshot->Sequence;
+
+      TDirectory *SnapshotDirectory = SnapshotFile->mkdir(SS.str().c_str());
+
+      TParameter<Double_t> Time_P("Time", Snapshot->Time);
+      SnapshotDirectory->WriteTObject(&Time_P);
+
+      for(size_t h=0; h<Snapshot->Histograms.size(); h++){
+	TH1 *Histogram = Snapshot->Histograms[h];
+	string Name = Histogram->GetName();
+
+	if(Cumulative)
+	  SnapshotDirectory->WriteTObject(Histogram);
+
+	// A delta snapshot is the difference of the cumulative
+	// histogram and that of the previous snapshot
+	else{
+	  TH1 *Delta = (TH1 *)Histogram->Clone();
+	  Delta->SetDirectory(0);
+	  if(Previous.count(Name))
+	    Delta->Add(Previous[Name], -1.);
+	  SnapshotDirectory->WriteTObject(Delta);
+	  delete Delta;
+	}
+      }
+    }
+
+    // The histograms of the last snapshot are kept for the deltas
+    for(size_t h=0; h<Snapshot->Histograms.size(); h++){
+      string Name = Snapshot->Histograms[h]->GetName();
+      delete Previous[Name];
+      Previous[Name] = Snapshot->Histograms[h];
+    }
+    delete Snapshot;
+  }
+
+  SnapshotFile->Close();
+  delete SnapshotFile;
+
+  map<string, TH1 *>::iterator It = Previous.begin();
+  for(; It!=Previous.end(); It++)
+    delete It->second;
+  Previous.clear();
+}
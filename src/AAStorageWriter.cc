@@ -0,0 +1,195 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+// ROOT
+#include <TSystem.h>
+
+// C++
+#include <iostream>
+
+// ADAQAcquisition
+#include "AAStorageWriter.hh"
+#include "AAAcquisitionManager.hh"
+
+
+AAStorageWriter::AAStorageWriter()
+  : WriterThread(NULL),
+    QueueCapacity(0), QueueHead(0), QueueTail(0), QueueCount(0),
+    WriterThreadEnable(false), WriterBusy(false),
+    BackpressureEvents(0), EventsWritten(0),
+    BytesWritten(0), BytesAtLastStatus(0), TimeAtLastStatus(0.)
+{;}
+
+
+AAStorageWriter::~AAStorageWriter()
+{
+  StopWriterThread();
+}
+
+
+void AAStorageWriter::StartWriterThread(Int_t Capacity, Int_t RecordLength)
+{
+  if(WriterThread)
+    return;
+
+  if(Capacity < 1)
+    Capacity = 1;
+
+  // Preallocate all records up front such that the acquisition loop
+  // never allocates memory when handing an event to the writer
+  Records.resize(Capacity);
+  for(Int_t r=0; r<Capacity; r++)
+    Records[r].Waveform.reserve(RecordLength);
+
+  QueueCapacity = Capacity;
+  QueueHead = QueueTail = QueueCount = 0;
+  WriterBusy = false;
+
+  BackpressureEvents = EventsWritten = 0;
+  BytesWritten = BytesAtLastStatus = 0;
+  TimeAtLastStatus = (Long64_t)gSystem->Now() / 1000.;
+
+  WriterThreadEnable = true;
+  WriterThread = new boost::thread(&AAStorageWriter::RunWriterThread, this);
+}
+
+
+void AAStorageWriter::StopWriterThread()
+{
+  if(!WriterThread)
+    return;
+
+  Drain();
+
+  {
+    boost::lock_guard<boost::mutex> Lock(QueueMutex);
+    WriterThreadEnable = false;
+  }
+  RecordQueued.notify_one();
+
+  WriterThread->join();
+  delete WriterThread;
+  WriterThread = NULL;
+}
+
+
+void AAStorageWriter::Drain()
+{
+  if(!WriterThread)
+    return;
+
+  boost::unique_lock<boost::mutex> Lock(QueueMutex);
+  while(QueueCount > 0 or WriterBusy)
+    RecordWritten.wait(Lock);
+}
+
+
+void AAStorageWriter::SubmitEvent(Int_t Channel,
+				  vector<uint16_t> *Waveform,
+				  ADAQWaveformData *Data)
+{
+  Int_t Slot = 0;
+
+  {
+    boost::unique_lock<boost::mutex> Lock(QueueMutex);
+
+    if(QueueCount == QueueCapacity){
+      BackpressureEvents++;
+      while(QueueCount == QueueCapacity)
+	RecordWritten.wait(Lock);
+    }
+
+    Slot = QueueTail;
+  }
+
+  // The tail record is not visible to the writer until the queue
+  // count is incremented so it may be filled without the lock
+
+  StorageRecord &Record = Records[Slot];
+  Record.Channel = Channel;
+  Record.StoreWaveform = (Waveform != NULL);
+  if(Waveform)
+    Record.Waveform.assign(Waveform->begin(), Waveform->end());
+  else
+    Record.Waveform.clear();
+  Record.Data = *Data;
+
+  {
+    boost::lock_guard<boost::mutex> Lock(QueueMutex);
+    QueueTail = (QueueTail + 1) % QueueCapacity;
+    QueueCount++;
+  }
+  RecordQueued.notify_one();
+}
+
+
+StorageWriterStatusStruct AAStorageWriter::GetStatus()
+{
+  StorageWriterStatusStruct Status;
+
+  Double_t Now = (Long64_t)gSystem->Now() / 1000.;
+
+  boost::lock_guard<boost::mutex> Lock(QueueMutex);
+
+  Status.QueueDepth = QueueCount;
+  Status.QueueCapacity = QueueCapacity;
+  Status.BackpressureEvents = BackpressureEvents;
+  Status.EventsWritten = EventsWritten;
+
+  // The rate is computed over the period since the previous call
+  Double_t Period = Now - TimeAtLastStatus;
+  Status.BytesPerSecond = (Period > 0.) ? (BytesWritten - BytesAtLastStatus) / Period : 0.;
+
+  BytesAtLastStatus = BytesWritten;
+  TimeAtLastStatus = Now;
+
+  return Status;
+}
+
+
+void AAStorageWriter::RunWriterThread()
+{
+  AAAcquisitionManager *TheACQManager = AAAcquisitionManager::GetInstance();
+
+  while(true){
+
+    Int_t Slot = 0;
+
+    {
+      boost::unique_lock<boost::mutex> Lock(QueueMutex);
+
+      while(QueueCount == 0 and WriterThreadEnable)
+	RecordQueued.wait(Lock);
+
+      // Exit only once the queue is empty such that the tail of the
+      // run is never lost when the thread is stopped
+      if(QueueCount == 0 and !WriterThreadEnable)
+	break;
+
+      Slot = QueueHead;
+      WriterBusy = true;
+    }
+
+    // The head record belongs to the writer until it is released
+    Int_t Bytes = TheACQManager->WriteStorageRecord(Records[Slot]);
+
+    {
+      boost::lock_guard<boost::mutex> Lock(QueueMutex);
+      QueueHead = (QueueHead + 1) % QueueCapacity;
+      QueueCount--;
+      WriterBusy = false;
+      BytesWritten += Bytes;
+      EventsWritten++;
+    }
+    RecordWritten.notify_all();
+  }
+}
@@ -25,6 +25,7 @@
 #include "AAAcquisitionManager.hh"
 #include "AAGraphics.hh"
 #include "AAEditor.hh"
+#include "AAPeakFitter.hh"
 
 AASubtabSlots::AASubtabSlots(AAInterface *TheInterface)
   : TI(TheInterface),
@@ -69,6 +70,20 @@ void AASubtabSlots::HandleCheckButtons()
       TI->SetCalibrationWidgetState(false, kButtonDisabled);
     break;
     
+  case SpectrumPeakFitEnable_CB_ID:
+    if(ActiveButton->IsDown()){
+      TI->PeakFitter->Reset();
+      TI->PeakFitter->StartFitThread();
+      TI->PeakFitTimer->Start((Long_t)(TI->TheSettings->SpectrumPeakFitPeriod * 1000), kFALSE);
+      TI->SpectrumPeakFitToCalibration_TB->SetState(kButtonUp);
+    }
+    else{
+      TI->PeakFitTimer->TurnOff();
+      TI->PeakFitter->StopFitThread();
+      TI->SpectrumPeakFitToCalibration_TB->SetState(kButtonDisabled);
+    }
+    break;
+    
   case WaveformStorageEnable_CB_ID:
     break;
     
@@ -210,6 +225,12 @@ void AASubtabSlots::HandleNumberEntries()
   case SpectrumCalibrationEnergy_NEL_ID:
     break;
 
+  case SpectrumPeakFitPeriod_NEL_ID:
+    // Restart the peak fit timer with the new period if running
+    if(TI->SpectrumPeakFitEnable_CB->IsDown())
+      TI->PeakFitTimer->Start((Long_t)(TI->TheSettings->SpectrumPeakFitPeriod * 1000), kFALSE);
+    break;
+
   case SpectrumCalibrationPulseUnit_NEL_ID:{
     Double_t Value = 0.;
     if(ActiveID == SpectrumCalibrationEnergy_NEL_ID)
@@ -292,13 +313,18 @@ void AASubtabSlots::HandleTextButtons()
     for(int ch=0; ch<DGChannels; ch++)
       BufferStatus[ch] = false;
     
-    TheVMEManager->GetDGManager()->GetChannelBufferStatus(BufferStatus);
-
     Double_t BufferLevel = 0.;
-    if(TI->TheSettings->STDFirmware)
-      TheVMEManager->GetDGManager()->GetSTDBufferLevel(BufferLevel);
-    else if(TI->TheSettings->PSDFirmware)
-      TheVMEManager->GetDGManager()->GetPSDBufferLevel(BufferLevel);
+    {
+      // The digitizer's link is shared with the monitored HV board
+      boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
+      
+      TheVMEManager->GetDGManager()->GetChannelBufferStatus(BufferStatus);
+      
+      if(TI->TheSettings->STDFirmware)
+	TheVMEManager->GetDGManager()->GetSTDBufferLevel(BufferLevel);
+      else if(TI->TheSettings->PSDFirmware)
+	TheVMEManager->GetDGManager()->GetPSDBufferLevel(BufferLevel);
+    }
     
     TI->DGBufferStatus_PB->Reset();
     TI->DGBufferStatus_PB->Increment(BufferLevel*100);
@@ -453,6 +479,32 @@ void AASubtabSlots::HandleTextButtons()
   }
 
 
+  case SpectrumPeakFitToCalibration_TB_ID:{
+    
+    // Calibration points can only be set when calibration is enabled
+    if(!TI->SpectrumCalibration_CB->IsDown()){
+      cout << "\nAASubtabSlots::HandleTextButtons() : Spectrum calibration must be enabled\n"
+	   <<   "  (\"Make it so\") in order to set a calibration point from the peak fit!\n"
+	   << endl;
+      break;
+    }
+    
+    Double_t Centroid = TI->SpectrumPeakFitCentroid_NEFL->GetEntry()->GetNumber();
+    
+    if(Centroid <= 0.)
+      break;
+    
+    // Set the pulse unit of the present calibration point to the
+    // fitted centroid, update the slider pointer to match, and then
+    // set the calibration point using the user-entered energy
+    TI->SpectrumCalibrationPulseUnit_NEL->GetEntry()->SetNumber(Centroid);
+    TI->DisplayHorizontalScale_THS->SetPointerPosition(Centroid / TI->SpectrumMaxBin_NEL->GetEntry()->GetNumber());
+    
+    TI->SpectrumCalibrationSetPoint_TB->Clicked();
+    break;
+  }
+    
+
   case WaveformFileName_TB_ID:{
     
     const char *FileTypes[] = {"ADAQ ROOT file","*.adaq.root",
@@ -505,6 +557,12 @@ void AASubtabSlots::HandleTextButtons()
     TI->WaveformStoreRaw_CB->SetState(kButtonDisabled);
     TI->WaveformStoreEnergyData_CB->SetState(kButtonDisabled);
     TI->WaveformStorePSDData_CB->SetState(kButtonDisabled);
+    TI->WaveformStoreReadoutBuffers_CB->SetState(kButtonDisabled);
+    TI->WaveformStoreListMode_CB->SetState(kButtonDisabled);
+    TI->WaveformStorePacked_CB->SetState(kButtonDisabled);
+    TI->WaveformStoreDeltaCoded_CB->SetState(kButtonDisabled);
+
+    TI->StorageMonitorTimer->Start(1000, kFALSE);
     break;
   }
 
@@ -558,6 +616,10 @@ void AASubtabSlots::HandleTextButtons()
       TI->WaveformStoreRaw_CB->SetState(kButtonUp);
       TI->WaveformStoreEnergyData_CB->SetState(kButtonUp);
       TI->WaveformStorePSDData_CB->SetState(kButtonUp);
+      TI->WaveformStoreReadoutBuffers_CB->SetState(kButtonUp);
+      TI->WaveformStoreListMode_CB->SetState(kButtonUp);
+      TI->WaveformStorePacked_CB->SetState(kButtonUp);
+      TI->WaveformStoreDeltaCoded_CB->SetState(kButtonUp);
     }
     
     break;
@@ -762,3 +824,78 @@ void AASubtabSlots::HandleRadioButtons()
   }
   TI->SaveSettings();
 }
+
+
+void AASubtabSlots::HandlePeakFitTimer()
+{
+  // Called periodically by the peak fit timer. Note that the settings
+  // are deliberately not saved here since this is not a widget signal
+  
+  if(!TI->SpectrumPeakFitEnable_CB->IsDown())
+    return;
+
+  // Display the most recent fit result from the fitting thread (if
+  // a new one is available) ...
+  
+  PeakFitResultStruct Result;
+  if(TI->PeakFitter->GetLatestResult(Result)){
+    if(Result.Valid){
+      TI->SpectrumPeakFitCentroid_NEFL->GetEntry()->SetNumber(Result.Centroid);
+      TI->SpectrumPeakFitFWHM_NEFL->GetEntry()->SetNumber(Result.FWHM);
+      TI->SpectrumPeakFitResolution_NEFL->GetEntry()->SetNumber(Result.Resolution);
+    }
+    else{
+      TI->SpectrumPeakFitCentroid_NEFL->GetEntry()->SetNumber(0.);
+      TI->SpectrumPeakFitFWHM_NEFL->GetEntry()->SetNumber(0.);
+      TI->SpectrumPeakFitResolution_NEFL->GetEntry()->SetNumber(0.);
+    }
+  }
+  
+  // ... and then hand a snapshot of the displayed spectrum's ROI to
+  // the fitting thread for the next fit
+
+  Int_t Channel = TI->SpectrumChannel_CBL->GetComboBox()->GetSelected();
+  Double_t Min = TI->SpectrumPeakFitMin_NEL->GetEntry()->GetNumber();
+  Double_t Max = TI->SpectrumPeakFitMax_NEL->GetEntry()->GetNumber();
+
+  TH1F *Spectrum_H = AAAcquisitionManager::GetInstance()->GetSpectrum(Channel);
+  
+  TI->PeakFitter->SubmitSnapshot(Spectrum_H, Channel, Min, Max);
+}
+
+
+void AASubtabSlots::HandleDisplayTimer()
+{
+  // Called periodically by the display timer, which turns itself off
+  // once acquisition has stopped
+
+  AAAcquisitionManager *TheACQManager = AAAcquisitionManager::GetInstance();
+  
+  if(!TheACQManager->GetAcquisitionEnable()){
+    TI->DisplayTimer->TurnOff();
+    return;
+  }
+  
+  TheACQManager->RefreshDisplay();
+}
+
+
+void AASubtabSlots::HandleStorageMonitorTimer()
+{
+  AAAcquisitionManager *TheACQManager = AAAcquisitionManager::GetInstance();
+
+  // The writer thread is stopped when the ADAQ file is closed, which
+  // may occur outside of the GUI (e.g. the acquisition timer expiring)
+  if(!TheACQManager->GetStorageWriterActive()){
+    TI->StorageMonitorTimer->TurnOff();
+    TI->WaveformStorageQueue_NEFL->GetEntry()->SetNumber(0);
+    TI->WaveformStorageRate_NEFL->GetEntry()->SetNumber(0.);
+    return;
+  }
+  
+  StorageWriterStatusStruct Status = TheACQManager->GetStorageWriterStatus();
+  
+  TI->WaveformStorageQueue_NEFL->GetEntry()->SetNumber(Status.QueueDepth);
+  TI->WaveformStorageRate_NEFL->GetEntry()->SetNumber(Status.BytesPerSecond / 1.e6);
+  TI->WaveformStorageBackpressure_NEFL->GetEntry()->SetNumber(Status.BackpressureEvents);
+}
@@ -16,6 +16,7 @@
 // C++
 #include <iostream>
 #include <sstream>
+#include <iomanip>
 #include <bitset>
 
 // ADAQ
@@ -103,6 +104,53 @@ void AATabSlots::HandleSettingsTextButtons()
       TI->LoadSettingsFromFile_TB->SetBackgroundColor(TI->ColorManager->Number2Pixel(TI->ButtonBackColorOn));
     }
     break;
+
+  case StorageBenchmark_TB_ID:{
+    AAAcquisitionManager *TheACQManager = AAAcquisitionManager::GetInstance();
+
+    if(TheACQManager->GetAcquisitionEnable()){
+      cout << "\nError! The storage benchmark cannot be run during acquisition!\n"
+	   <<   "       Stop acquisition and then run the benchmark.\n"
+	   << endl;
+      break;
+    }
+
+    TI->SaveSettings();
+
+    // The first press arms the capture of waveforms during the next
+    // acquisition; the following press runs the benchmark on them
+    vector<StorageBenchmarkStruct> Results;
+    if(!TheACQManager->BenchmarkStorage(Results)){
+      TheACQManager->ArmStorageBenchmark();
+      cout << "\nAATabSlots::HandleSettingsTextButtons() : Waveform capture for the storage\n"
+	   <<   "   benchmark is armed! Acquire data (in any mode) and then run the benchmark again.\n"
+	   << endl;
+      break;
+    }
+    
+    const char *Names[] = {"None", "ZLIB", "LZMA", "", "LZ4", "ZSTD"};
+    
+    TI->StorageBenchmark_TV->Clear();
+    TI->StorageBenchmark_TV->AddLine("Encoding  Algorithm  Level  Write [MB/s]  Ratio");
+    for(size_t r=0; r<Results.size(); r++){
+      stringstream Encoding;
+      if(Results[r].Encoding == AAWaveformPacking::DeltaEncoding)
+	Encoding << "Delta";
+      else if(Results[r].Encoding == AAWaveformPacking::UnpackedEncoding)
+	Encoding << "16-bit";
+      else
+	Encoding << Results[r].Encoding << "-bit";
+      
+      stringstream SS;
+      SS << setw(10) << left << Encoding.str()
+	 << setw(9) << left << Names[Results[r].Algorithm]
+	 << setw(7) << right << Results[r].Level
+	 << setw(14) << fixed << setprecision(1) << Results[r].WriteRate
+	 << setw(7) << setprecision(2) << Results[r].CompressionRatio;
+      TI->StorageBenchmark_TV->AddLine(SS.str().c_str());
+    }
+    break;
+  }
     
   default:
     break;
@@ -266,8 +314,11 @@ void AATabSlots::HandleConnectionTextButtons()
     break;
 
   case DGCalibrateADCs_TB_ID:
-    if(TheVMEManager->GetDGLinkOpen())
+    if(TheVMEManager->GetDGLinkOpen()){
+      boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
       TheVMEManager->GetDGManager()->Calibrate();
+      TheVMEManager->InvalidateDGShadow();
+    }
     break;
     
   case BRBoardEnable_TB_ID:
@@ -330,6 +381,9 @@ void AATabSlots::HandlePulserTextButtons()
   POS.LEDPolarity = TI->V1718PulserLEDPolarity_CBL[Pulser]->GetComboBox()->GetSelected();
   POS.Source = TI->V1718PulserSource_CBL[Pulser]->GetComboBox()->GetSelected();
 
+  // The bridge is shared with the HV board while it is monitored
+  boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
+
   TheVMEManager->GetBRManager()->SetPulserSettings(&PS);
   TheVMEManager->GetBRManager()->SetPulserOutputSettings(&POS);
 
@@ -414,6 +468,10 @@ void AATabSlots::HandleRegisterTextButtons()
     break;
   }
 
+  // All boards share a link (the VME bridge or the digitizer's USB
+  // link) with the HV board while it is monitored
+  boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
+
   ///////////////////////////////////////////////
   // Perform a register read of the desired board
 
@@ -458,8 +516,10 @@ void AATabSlots::HandleRegisterTextButtons()
     if(Board == V1718 and TheVMEManager->GetBREnable())
       TheVMEManager->GetBRManager()->SetRegisterValue(Addr32, Data32);
     
-    if(Board == V1720 and TheVMEManager->GetDGEnable())
+    if(Board == V1720 and TheVMEManager->GetDGEnable()){
       TheVMEManager->GetDGManager()->SetRegisterValue(Addr32, Data32);
+      TheVMEManager->InvalidateDGShadow();
+    }
     
     else if(Board == V6534 and TheVMEManager->GetHVEnable())
       TheVMEManager->GetHVManager()->SetRegisterValue(Addr32, Data32);
@@ -505,11 +565,14 @@ void AATabSlots::HandleVoltageTextButtons()
       int HVRampRateValue = TI->HVChRampRate_NEL[HVChannel]->GetEntry()->GetIntNumber();
 
       // Set the voltage, current, and ramp rate then turn the HV channel on
-      TheVMEManager->GetHVManager()->SetVoltage(HVChannel, HVVoltageValue); 
-      TheVMEManager->GetHVManager()->SetCurrent(HVChannel, HVCurrentValue);
-      TheVMEManager->GetHVManager()->SetRampUpRate(HVChannel, HVRampRateValue);
-      TheVMEManager->GetHVManager()->SetRampDownRate(HVChannel, HVRampRateValue);
-      TheVMEManager->GetHVManager()->SetPowerOn(HVChannel);
+      {
+	boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
+	TheVMEManager->GetHVManager()->SetVoltage(HVChannel, HVVoltageValue); 
+	TheVMEManager->GetHVManager()->SetCurrent(HVChannel, HVCurrentValue);
+	TheVMEManager->GetHVManager()->SetRampUpRate(HVChannel, HVRampRateValue);
+	TheVMEManager->GetHVManager()->SetRampDownRate(HVChannel, HVRampRateValue);
+	TheVMEManager->GetHVManager()->SetPowerOn(HVChannel);
+      }
       
       TI->SetVoltageChannelWidgetState(HVChannel, true);
     }
@@ -521,7 +584,10 @@ void AATabSlots::HandleVoltageTextButtons()
       TextButton->SetText("OFF");
 
       // Turn the HV channel off
-      TheVMEManager->GetHVManager()->SetPowerOff(HVChannel);
+      {
+	boost::lock_guard<boost::mutex> Lock(TheVMEManager->GetHVLinkMutex());
+	TheVMEManager->GetHVManager()->SetPowerOff(HVChannel);
+      }
       
       // Reenable the widget status such that voltage and maximum
       // current can be modified
@@ -595,13 +661,19 @@ void AATabSlots::HandleCheckButtons()
 	TI->HVChVoltageMonitor_NEFL[ch]->GetEntry()->SetState(true);
 	TI->HVChCurrentMonitor_NEFL[ch]->GetEntry()->SetState(true);
       }
-      TheVMEManager->StartHVMonitoring(TI);
+      TI->HVMonitorPeriod_NEL->GetEntry()->SetState(false);
+      
+      TheVMEManager->StartHVMonitoring(TI->TheSettings->HVMonitorPeriod);
+      TI->HVMonitorTimer->Start(TI->TheSettings->HVMonitorPeriod, kFALSE);
     }
     else{
       for(int ch=0; ch<HVChannels; ch++){
 	TI->HVChVoltageMonitor_NEFL[ch]->GetEntry()->SetState(false);
 	TI->HVChCurrentMonitor_NEFL[ch]->GetEntry()->SetState(false);
       }
+      TI->HVMonitorPeriod_NEL->GetEntry()->SetState(true);
+      
+      TI->HVMonitorTimer->TurnOff();
       TheVMEManager->StopHVMonitoring();
       break;
     }
@@ -630,3 +702,19 @@ void AATabSlots::HandleRadioButtons()
 }
 
 
+void AATabSlots::HandleHVMonitorTimer()
+{
+  AAVMEManager *TheVMEManager = AAVMEManager::GetInstance();
+
+  if(!TheVMEManager->GetHVMonitorActive()){
+    TI->HVMonitorTimer->TurnOff();
+    return;
+  }
+  
+  const int HVChannels = TheVMEManager->GetHVManager()->GetNumChannels();
+  
+  HVMonitorSampleStruct Sample;
+  for(int ch=0; ch<HVChannels; ch++)
+    if(TheVMEManager->GetHVMonitorSample(ch, Sample))
+      TI->UpdateHVMonitors(ch, Sample.Voltage, Sample.Current);
+}
@@ -18,6 +18,10 @@
 
 #include "AAVMEManager.hh"
 #include <iostream>
+#include <sstream>
+
+// The number of samples per channel in the HV monitor history
+static const Int_t HVMonitorHistoryLength = 1200;
 
 
 AAVMEManager *AAVMEManager::TheVMEManager = 0;
@@ -33,7 +37,8 @@ AAVMEManager::AAVMEManager()
     DGLinkNumber(0), DGCONETNode(0), DGLinkOpen(false),
     HVEnable(false), HVIdentifier(0), HVAddress(0x00000000),
     HVLinkNumber(0), HVLinkOpen(false),
-    VMEConnectionEstablished(false)
+    VMEConnectionEstablished(false), HVMonitorEnable(false), HVMonitorPaused(false),
+    DGShadowValid(false), HVMonitorPeriod(500), HVMonitorThread(NULL)
 {
   if(TheVMEManager)
     cout << "\nError! The VMEManager was constructed twice!\n" << endl;
@@ -42,7 +47,9 @@ AAVMEManager::AAVMEManager()
 
 
 AAVMEManager::~AAVMEManager()
-{;}
+{
+  StopHVMonitoring();
+}
 
 
 Int_t AAVMEManager::InitializeBridge()
@@ -80,6 +87,9 @@ Int_t AAVMEManager::InitializeDigitizer()
   
   DGMgr->SetVerbose(true);
   
+  // The new digitizer has not been programmed by this session
+  InvalidateDGShadow();
+  
   Int_t Status = DGMgr->OpenLink();
 
   if(DGMgr->GetLinkEstablished())
@@ -120,9 +130,58 @@ Int_t AAVMEManager::InitializeHighVoltage()
 }
 
 
+// Record the value of a digitizer setting (of a channel, or of the
+// board if the channel is negative) in the shadow of the programmed
+// settings, returning true if the value differs from that which was
+// last programmed, i.e. the setting must be written
+Bool_t AAVMEManager::DGSettingChanged(string Setting, Int_t Channel, Long64_t Value)
+{
+  stringstream SS;
+  SS << Setting;
+  if(Channel >= 0)
+    SS << "[" << Channel << "]";
+  
+  map<string, Long64_t>::iterator It = DGShadow.find(SS.str());
+  if(It != DGShadow.end() and It->second == Value)
+    return false;
+  
+  DGShadow[SS.str()] = Value;
+  return true;
+}
+
+
+void AAVMEManager::InvalidateDGShadow()
+{
+  DGShadow.clear();
+  DGShadowValid = false;
+}
+
+
+// Program the digitizer from the current settings. The digitizer is
+// only reset, and all settings written, when it is programmed for the
+// first time, when the firmware or board type has changed, or when
+// its registers may have been written by other means (see
+// InvalidateDGShadow()); otherwise, only the settings that differ
+// from the shadow of those last programmed are written
 bool AAVMEManager::ProgramDigitizers()
 {
-  DGMgr->Reset();
+  // Coincidence triggering is only ever enabled; disabling it
+  // requires the reset to restore the default trigger logic
+  Bool_t CoincidenceDisabled = (DGShadow.count("TriggerCoincidenceEnable") and
+				DGShadow["TriggerCoincidenceEnable"] and
+				!TheSettings->TriggerCoincidenceEnable);
+  
+  if(!DGShadowValid or CoincidenceDisabled or
+     DGSettingChanged("PSDFirmware", -1, TheSettings->PSDFirmware) or
+     DGSettingChanged("BoardType", -1, DGMgr->GetBoardType())){
+    
+    DGMgr->Reset();
+    
+    DGShadow.clear();
+    DGSettingChanged("PSDFirmware", -1, TheSettings->PSDFirmware);
+    DGSettingChanged("BoardType", -1, DGMgr->GetBoardType());
+    DGShadowValid = true;
+  }
   
   uint32_t DGNumChEnabled = 0;
   uint32_t DGChEnableMask = 0;
@@ -142,22 +201,33 @@ bool AAVMEManager::ProgramDigitizers()
       continue;
 
     if(TheSettings->STDFirmware){
-      DGMgr->SetChannelDCOffset(ch, TheSettings->ChDCOffset[ch]);
-      DGMgr->SetChannelTriggerThreshold(ch, TheSettings->ChTriggerThreshold[ch]);
+      if(DGSettingChanged("DCOffset", ch, TheSettings->ChDCOffset[ch]))
+	DGMgr->SetChannelDCOffset(ch, TheSettings->ChDCOffset[ch]);
       
-      if(TheSettings->ChPosPolarity[ch])
-	DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityPositive);
-      else
-	DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityNegative);
+      if(DGSettingChanged("TriggerThreshold", ch, TheSettings->ChTriggerThreshold[ch]))
+	DGMgr->SetChannelTriggerThreshold(ch, TheSettings->ChTriggerThreshold[ch]);
+      
+      if(DGSettingChanged("PosPolarity", ch, TheSettings->ChPosPolarity[ch])){
+	if(TheSettings->ChPosPolarity[ch])
+	  DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityPositive);
+	else
+	  DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityNegative);
+      }
     
       if(TheSettings->ZeroSuppressionEnable){
-	DGMgr->SetZSMode("ZLE");
+	if(DGSettingChanged("ZSMode", -1, TheSettings->ZeroSuppressionEnable))
+	  DGMgr->SetZSMode("ZLE");
 	
-	DGMgr->SetZLEChannelSettings(ch,
-				     TheSettings->ChZLEThreshold[ch],
-				     TheSettings->ChZLEBackward[ch],
-				     TheSettings->ChZLEForward[ch],
-				     TheSettings->ChZLEPosLogic[ch]);
+	// All four ZLE values are written by a single call
+	if(DGSettingChanged("ZLEThreshold", ch, TheSettings->ChZLEThreshold[ch]) |
+	   DGSettingChanged("ZLEBackward", ch, TheSettings->ChZLEBackward[ch]) |
+	   DGSettingChanged("ZLEForward", ch, TheSettings->ChZLEForward[ch]) |
+	   DGSettingChanged("ZLEPosLogic", ch, TheSettings->ChZLEPosLogic[ch]))
+	  DGMgr->SetZLEChannelSettings(ch,
+				       TheSettings->ChZLEThreshold[ch],
+				       TheSettings->ChZLEBackward[ch],
+				       TheSettings->ChZLEForward[ch],
+				       TheSettings->ChZLEPosLogic[ch]);
 	
 	// Testing for positive ZLE logic
 	if(TheSettings->ChZLEPosLogic[ch]){
@@ -184,7 +254,8 @@ bool AAVMEManager::ProgramDigitizers()
   }
 
   // Set the channel-enable mask
-  DGMgr->SetChannelEnableMask(DGChEnableMask);
+  if(DGSettingChanged("ChEnableMask", -1, DGChEnableMask))
+    DGMgr->SetChannelEnableMask(DGChEnableMask);
   
   // Ensure that at least one channel is enabled in the channel
   // enabled bit mask; if not, alert the user and return without
@@ -193,36 +264,50 @@ bool AAVMEManager::ProgramDigitizers()
   ///////////////////
   // Trigger settings
 
-  // Trigger type
-
-  switch(TheSettings->TriggerType){
+  // Trigger type (the automatic trigger is set per enabled channel)
 
-  case 0: // External (NIM logic)
-    DGMgr->EnableExternalTrigger("NIM");
-    DGMgr->DisableAutoTrigger(DGChEnableMask);
-    DGMgr->DisableSWTrigger();
-    break;
-
-  case 1: // External (TTL logic)
-    DGMgr->EnableExternalTrigger("TTL");
-    DGMgr->DisableAutoTrigger(DGChEnableMask);
-    DGMgr->DisableSWTrigger();
-    break;
-    
-  case 2: // Automatic
-    DGMgr->DisableExternalTrigger();
-    DGMgr->EnableAutoTrigger(DGChEnableMask);
-    DGMgr->DisableSWTrigger();
-    break;
+  uint32_t PrevTriggerMask = (DGShadow.count("TriggerMask") ? 
+			      (uint32_t)DGShadow["TriggerMask"] : 0);
+  
+  if(DGSettingChanged("TriggerType", -1, TheSettings->TriggerType) |
+     DGSettingChanged("TriggerMask", -1, DGChEnableMask)){
+
+    // Without the reset, channels removed from the enable mask would
+    // keep their automatic (self) trigger and continue to trigger
+    // the board, so it is explicitly disabled for them
+    uint32_t RemovedChannels = PrevTriggerMask & ~DGChEnableMask;
+    if(RemovedChannels)
+      DGMgr->DisableAutoTrigger(RemovedChannels);
     
-  case 3: // Software
-    DGMgr->DisableExternalTrigger();
-    DGMgr->DisableAutoTrigger(DGChEnableMask);
-    DGMgr->EnableSWTrigger();
-    break;
-
-  default:
-    break;
+    switch(TheSettings->TriggerType){
+      
+    case 0: // External (NIM logic)
+      DGMgr->EnableExternalTrigger("NIM");
+      DGMgr->DisableAutoTrigger(DGChEnableMask);
+      DGMgr->DisableSWTrigger();
+      break;
+      
+    case 1: // External (TTL logic)
+      DGMgr->EnableExternalTrigger("TTL");
+      DGMgr->DisableAutoTrigger(DGChEnableMask);
+      DGMgr->DisableSWTrigger();
+      break;
+      
+    case 2: // Automatic
+      DGMgr->DisableExternalTrigger();
+      DGMgr->EnableAutoTrigger(DGChEnableMask);
+      DGMgr->DisableSWTrigger();
+      break;
+      
+    case 3: // Software
+      DGMgr->DisableExternalTrigger();
+      DGMgr->DisableAutoTrigger(DGChEnableMask);
+      DGMgr->EnableSWTrigger();
+      break;
+      
+    default:
+      break;
+    }
   }
 
   // Trigger edge (channel-specific but treated as group setting)
@@ -231,6 +316,9 @@ bool AAVMEManager::ProgramDigitizers()
   
     for(int ch=0; ch<DGMgr->GetNumChannels(); ch++){
       
+      if(!DGSettingChanged("TriggerEdge", ch, TheSettings->TriggerEdge))
+	continue;
+      
       switch(TheSettings->TriggerEdge){
 	
       case 0: // Rising edge
@@ -246,8 +334,17 @@ bool AAVMEManager::ProgramDigitizers()
       }
     }
   }
+
+  Bool_t CoincidenceChanged = false;
+  if(TheSettings->TriggerCoincidenceEnable)
+    CoincidenceChanged = (DGSettingChanged("TriggerCoincidenceEnable", -1, true) |
+			  DGSettingChanged("TriggerCoincidenceLevel", -1, TheSettings->TriggerCoincidenceLevel) |
+			  DGSettingChanged("TriggerCoincidenceWindow", -1, TheSettings->TriggerCoincidenceWindow) |
+			  DGSettingChanged("TriggerCoincidenceChannel1", -1, TheSettings->TriggerCoincidenceChannel1) |
+			  DGSettingChanged("TriggerCoincidenceChannel2", -1, TheSettings->TriggerCoincidenceChannel2) |
+			  DGSettingChanged("TriggerCoincidenceNumCh", -1, DGNumChEnabled));
   
-  if(TheSettings->TriggerCoincidenceEnable){
+  if(TheSettings->TriggerCoincidenceEnable and CoincidenceChanged){
     if(TheSettings->TriggerCoincidenceLevel < DGNumChEnabled 
        and TheSettings->TriggerCoincidenceChannel1 != TheSettings->TriggerCoincidenceChannel2)
       {
@@ -265,39 +362,48 @@ bool AAVMEManager::ProgramDigitizers()
   ///////////////////////
   // Acquisition settings
   
-  switch(TheSettings->AcquisitionControl){
-    
-  case 0: // Standard (software controlled)
-    DGMgr->SetAcquisitionControl("Software");
-    break;
+  if(DGSettingChanged("AcquisitionControl", -1, TheSettings->AcquisitionControl)){
     
-  case 1: // Gated (NIM signal on S-IN Lemo 00 front panel)
-    DGMgr->SetAcquisitionControl("Gated (NIM)");
-    break;
-    
-  case 2: // Gated (TTL signal on S-IN Lemo 00 front panel)
-    DGMgr->SetAcquisitionControl("Gated (TTL)");
-    break;
-    
-  default:
-    break;
+    switch(TheSettings->AcquisitionControl){
+      
+    case 0: // Standard (software controlled)
+      DGMgr->SetAcquisitionControl("Software");
+      break;
+      
+    case 1: // Gated (NIM signal on S-IN Lemo 00 front panel)
+      DGMgr->SetAcquisitionControl("Gated (NIM)");
+      break;
+      
+    case 2: // Gated (TTL signal on S-IN Lemo 00 front panel)
+      DGMgr->SetAcquisitionControl("Gated (TTL)");
+      break;
+      
+    default:
+      break;
+    }
   }
 
   if(TheSettings->STDFirmware){
-    DGMgr->SetRecordLength(TheSettings->RecordLength);
-    DGMgr->SetPostTriggerSize(TheSettings->PostTrigger);
+    if(DGSettingChanged("RecordLength", -1, TheSettings->RecordLength))
+      DGMgr->SetRecordLength(TheSettings->RecordLength);
     
-    if(TheSettings->ZeroSuppressionEnable)
-      DGMgr->SetZSMode("ZLE");
-    else
-      DGMgr->SetZSMode("None");
+    if(DGSettingChanged("PostTrigger", -1, TheSettings->PostTrigger))
+      DGMgr->SetPostTriggerSize(TheSettings->PostTrigger);
+    
+    if(DGSettingChanged("ZSMode", -1, TheSettings->ZeroSuppressionEnable)){
+      if(TheSettings->ZeroSuppressionEnable)
+	DGMgr->SetZSMode("ZLE");
+      else
+	DGMgr->SetZSMode("None");
+    }
   }
   
   ///////////////////
   // Readout settings
   
   if(TheSettings->STDFirmware)
-    DGMgr->SetMaxNumEventsBLT(TheSettings->EventsBeforeReadout);
+    if(DGSettingChanged("MaxNumEventsBLT", -1, TheSettings->EventsBeforeReadout))
+      DGMgr->SetMaxNumEventsBLT(TheSettings->EventsBeforeReadout);
   
   if(TheSettings->PSDFirmware){
 
@@ -311,7 +417,11 @@ bool AAVMEManager::ProgramDigitizers()
     // documentation is spotty at best. Future updates will try to
     // make this as clear to the user in the interface.
     
+    // The parameters of all channels are written by a single call,
+    // which is only made if any of the parameters has changed
+    
     CAEN_DGTZ_DPP_PSD_Params_t PSDParameters;
+    Bool_t PSDParametersChanged = false;
     
     for(Int_t ch=0; ch<DGMgr->GetNumChannels(); ch++){
       
@@ -333,6 +443,16 @@ bool AAVMEManager::ProgramDigitizers()
       PSDParameters.sgate[ch] = TheSettings->ChShortGate[ch];
       PSDParameters.lgate[ch] = TheSettings->ChLongGate[ch]; 
       PSDParameters.pgate[ch] = TheSettings->ChGateOffset[ch];
+      
+      PSDParametersChanged |= (DGSettingChanged("PSDBaselineSamples", ch, PSDParameters.nsbl[ch]) |
+			       DGSettingChanged("PSDChargeSensitivity", ch, PSDParameters.csens[ch]) |
+			       DGSettingChanged("PSDSelfTrigger", ch, PSDParameters.selft[ch]) |
+			       DGSettingChanged("PSDTriggerThreshold", ch, PSDParameters.thr[ch]) |
+			       DGSettingChanged("PSDTriggerValidation", ch, PSDParameters.tvaw[ch]) |
+			       DGSettingChanged("PSDTriggerConfig", ch, PSDParameters.trgc[ch]) |
+			       DGSettingChanged("PSDShortGate", ch, PSDParameters.sgate[ch]) |
+			       DGSettingChanged("PSDLongGate", ch, PSDParameters.lgate[ch]) |
+			       DGSettingChanged("PSDGateOffset", ch, PSDParameters.pgate[ch]));
     }
 
     // The trigger holdoff setting *should* be channel-specific (and,
@@ -340,6 +460,8 @@ bool AAVMEManager::ProgramDigitizers()
     // but it is in fact an int16 defined in CAENDigitizerType.h from
     // the CAENDigitzer-2.6.7 library. ZSH (28 Sep 15)
     PSDParameters.trgho = TheSettings->PSDTriggerHoldoff; // Trigger holdoff
+    PSDParametersChanged |= DGSettingChanged("PSDTriggerHoldoff", -1, PSDParameters.trgho);
+    PSDParametersChanged |= DGSettingChanged("PSDParametersMask", -1, DGChEnableMask);
 
     // Pileup rejection settings. These settings are Unimplemented at
     // present but may be used in the future. ZSH (28 Sep 15)
@@ -353,13 +475,14 @@ bool AAVMEManager::ProgramDigitizers()
     //
     // PSDParameters.blthr = 3;     // Baseline threshold  (Depracated?)
     // PSDParameters.bltmo = 100;   // Baseline timeout  (Depracated?)
-    DGMgr->SetDPPParameters(DGChEnableMask, &PSDParameters);
+    if(PSDParametersChanged)
+      DGMgr->SetDPPParameters(DGChEnableMask, &PSDParameters);
     
       // For some ungodly reason DPP-PSD software reuses registers already set
       // by other values, so coincidence must be set on *AFTER* other parameters 
-      // have been set
+      // have been set (and therefore again whenever they have been set)
 
-    if(TheSettings->TriggerCoincidenceEnable){
+    if(TheSettings->TriggerCoincidenceEnable and (CoincidenceChanged or PSDParametersChanged)){
       if(TheSettings->TriggerCoincidenceLevel < DGNumChEnabled 
       and TheSettings->TriggerCoincidenceChannel1 != TheSettings->TriggerCoincidenceChannel2)
     {
@@ -379,33 +502,51 @@ bool AAVMEManager::ProgramDigitizers()
     
     for(Int_t ch=0; ch<DGMgr->GetNumChannels(); ch++){
       
-      DGMgr->SetRecordLength(TheSettings->ChRecordLength[ch], ch);
+      if(DGSettingChanged("RecordLength", ch, TheSettings->ChRecordLength[ch]))
+	DGMgr->SetRecordLength(TheSettings->ChRecordLength[ch], ch);
       
-      DGMgr->SetChannelDCOffset(ch, TheSettings->ChDCOffset[ch]);
+      if(DGSettingChanged("DCOffset", ch, TheSettings->ChDCOffset[ch]))
+	DGMgr->SetChannelDCOffset(ch, TheSettings->ChDCOffset[ch]);
       
-      DGMgr->SetDPPPreTriggerSize(ch, TheSettings->ChPreTrigger[ch]);
+      if(DGSettingChanged("PreTrigger", ch, TheSettings->ChPreTrigger[ch]))
+	DGMgr->SetDPPPreTriggerSize(ch, TheSettings->ChPreTrigger[ch]);
       
-      if(TheSettings->ChPosPolarity[ch])
-	DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityPositive);
-      else if(TheSettings->ChNegPolarity[ch])
-	DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityNegative);
+      if(DGSettingChanged("PosPolarity", ch, TheSettings->ChPosPolarity[ch]) |
+	 DGSettingChanged("NegPolarity", ch, TheSettings->ChNegPolarity[ch])){
+	if(TheSettings->ChPosPolarity[ch])
+	  DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityPositive);
+	else if(TheSettings->ChNegPolarity[ch])
+	  DGMgr->SetChannelPulsePolarity(ch, CAEN_DGTZ_PulsePolarityNegative);
+      }
     }
 
     
     ////////////////////////////////////////////
     // Set global non-PSD structure PSD settings
 
-    DGMgr->SetDPPAcquisitionMode((CAEN_DGTZ_DPP_AcqMode_t)TheSettings->PSDOperationMode,
-				 CAEN_DGTZ_DPP_SAVE_PARAM_EnergyAndTime);
+    if(DGSettingChanged("PSDOperationMode", -1, TheSettings->PSDOperationMode))
+      DGMgr->SetDPPAcquisitionMode((CAEN_DGTZ_DPP_AcqMode_t)TheSettings->PSDOperationMode,
+				   CAEN_DGTZ_DPP_SAVE_PARAM_EnergyAndTime);
 
-    if(TheSettings->TriggerCoincidenceEnable)
-      DGMgr->SetDPPTriggerMode(CAEN_DGTZ_DPP_TriggerMode_Coincidence);
-    else
-      DGMgr->SetDPPTriggerMode(CAEN_DGTZ_DPP_TriggerMode_Normal);
+    if(DGSettingChanged("PSDTriggerMode", -1, TheSettings->TriggerCoincidenceEnable)){
+      if(TheSettings->TriggerCoincidenceEnable)
+	DGMgr->SetDPPTriggerMode(CAEN_DGTZ_DPP_TriggerMode_Coincidence);
+      else
+	DGMgr->SetDPPTriggerMode(CAEN_DGTZ_DPP_TriggerMode_Normal);
+    }
     
-    DGMgr->SetIOLevel(CAEN_DGTZ_IOLevel_TTL);
+    if(DGSettingChanged("PSDEventAggregation", -1, TheSettings->EventsBeforeReadout))
+      DGMgr->SetDPPEventAggregation(TheSettings->EventsBeforeReadout, 0);
+    
+    // The remaining settings are fixed and are therefore only written
+    // after the digitizer has been reset or, since the PSD parameters
+    // share registers with other settings, after the PSD parameters
+    // have been written
     
-    DGMgr->SetDPPEventAggregation(TheSettings->EventsBeforeReadout, 0);
+    if(!DGSettingChanged("PSDFixedSettings", -1, true) and !PSDParametersChanged)
+      return true;
+    
+    DGMgr->SetIOLevel(CAEN_DGTZ_IOLevel_TTL);
     
     DGMgr->SetRunSynchronizationMode(CAEN_DGTZ_RUN_SYNC_Disabled);
 
@@ -453,6 +594,8 @@ void AAVMEManager::SafelyDisconnectVMEBoards()
 {
   if(HVLinkOpen){
     
+    StopHVMonitoring();
+    
     HVMgr->SetToSafeState();
     
     if(HVType == zDT5790M or HVType == zDT5790N or HVType == zDT5790P){
@@ -466,6 +609,7 @@ void AAVMEManager::SafelyDisconnectVMEBoards()
   if(DGLinkOpen){
     DGMgr->CloseLink();
     DGLinkOpen = false;
+    InvalidateDGShadow();
   }
   
   if(BRLinkOpen){
@@ -475,37 +619,130 @@ void AAVMEManager::SafelyDisconnectVMEBoards()
 }
 
 
-void AAVMEManager::StartHVMonitoring(AAInterface *TI)
+void AAVMEManager::StartHVMonitoring(Int_t Period)
 {
+  if(HVMonitorThread)
+    return;
+
+  const Int_t HVChannels = HVMgr->GetNumChannels();
+  
+  HVMonitorHistory.assign(HVChannels, vector<HVMonitorSampleStruct>(HVMonitorHistoryLength));
+  HVMonitorNext.assign(HVChannels, 0);
+  HVMonitorCount.assign(HVChannels, 0);
+  
+  HVMonitorPeriod = (Period > 0) ? Period : 500;
   HVMonitorEnable = true;
+  HVMonitorThread = new boost::thread(&AAVMEManager::RunHVMonitoring, this);
+}
+
+
+void AAVMEManager::StopHVMonitoring()
+{
+  if(!HVMonitorThread)
+    return;
+  
+  {
+    boost::lock_guard<boost::mutex> Lock(HVMonitorMutex);
+    HVMonitorEnable = false;
+  }
+  HVMonitorWake.notify_one();
+  
+  HVMonitorThread->join();
+  delete HVMonitorThread;
+  HVMonitorThread = NULL;
+}
+
 
-  //  vector<uint16_t> Voltage(HVMgr->GetNumChannels(), 0);
-  //  vector<uint16_t> Current(HVMgr->GetNumChannels(), 0);
+// Read the voltage and current of all HV channels once per period
+// into the history until monitoring is stopped. The thread sleeps
+// between readings rather than polling, and the history is only
+// locked while the readings are copied into it such that the GUI
+// never waits on the HV board. No readings are taken while paused
+void AAVMEManager::RunHVMonitoring()
+{
+  const Int_t HVChannels = HVMonitorHistory.size();
+  vector<HVMonitorSampleStruct> Samples(HVChannels);
+  
+  boost::system_time Start = boost::get_system_time();
+  boost::system_time Next = Start;
+  
+  boost::unique_lock<boost::mutex> Lock(HVMonitorMutex);
   
-  // The high voltage and current will be displayed and updated in the
-  // dedicated number entry fields when HVMonitorEnable is true
   while(HVMonitorEnable){
-
-    // Perform action in a separate thread to enable use of other GUI
-    // features while HV monitoring is taking place
-    gSystem->ProcessEvents();
     
-    // Update the voltage and current displays every half-second
-    double delay = clock()+(0.5*CLOCKS_PER_SEC);
-    while(clock()<delay){gSystem->ProcessEvents();}
+    Lock.unlock();
     
-    uint16_t Voltage, Current;
-    const int HVChannels = TheVMEManager->GetHVManager()->GetNumChannels();
-    for(int ch=0; ch<HVChannels; ch++){
-      
-      HVMgr->GetVoltage(ch, &Voltage);
-      HVMgr->GetCurrent(ch, &Current);
+    Bool_t Sampled = false;
+    
+    {
+      // The pause flag is set while holding the link mutex such that
+      // no reading is in progress once PauseHVMonitoring() returns
+      boost::lock_guard<boost::mutex> LinkLock(HVLinkMutex);
       
-      TI->UpdateHVMonitors(ch, Voltage, Current);
+      if(!HVMonitorPaused){
+	Double_t Time = (boost::get_system_time() - Start).total_milliseconds() / 1000.;
+	
+	for(Int_t ch=0; ch<HVChannels; ch++){
+	  uint16_t Voltage = 0, Current = 0;
+	  HVMgr->GetVoltage(ch, &Voltage);
+	  HVMgr->GetCurrent(ch, &Current);
+	  
+	  Samples[ch].Time = Time;
+	  Samples[ch].Voltage = Voltage;
+	  Samples[ch].Current = Current;
+	}
+	Sampled = true;
+      }
     }
+    
+    Lock.lock();
+    
+    if(Sampled){
+      for(Int_t ch=0; ch<HVChannels; ch++){
+	HVMonitorHistory[ch][HVMonitorNext[ch]] = Samples[ch];
+	HVMonitorNext[ch] = (HVMonitorNext[ch] + 1) % HVMonitorHistoryLength;
+	if(HVMonitorCount[ch] < HVMonitorHistoryLength)
+	  HVMonitorCount[ch]++;
+      }
+    }
+    
+    // Sleep until the next period or until monitoring is stopped
+    Next += boost::posix_time::milliseconds(HVMonitorPeriod);
+    while(HVMonitorEnable and HVMonitorWake.timed_wait(Lock, Next));
   }
 }
 
 
-void AAVMEManager::StopHVMonitoring()
-{ HVMonitorEnable = false; }
+void AAVMEManager::PauseHVMonitoring(Bool_t Pause)
+{
+  boost::lock_guard<boost::mutex> LinkLock(HVLinkMutex);
+  HVMonitorPaused = Pause;
+}
+
+
+Bool_t AAVMEManager::GetHVMonitorSample(Int_t Channel, HVMonitorSampleStruct &Sample)
+{
+  boost::lock_guard<boost::mutex> Lock(HVMonitorMutex);
+  
+  if(Channel >= (Int_t)HVMonitorCount.size() or HVMonitorCount[Channel] == 0)
+    return false;
+  
+  Int_t Last = (HVMonitorNext[Channel] + HVMonitorHistoryLength - 1) % HVMonitorHistoryLength;
+  Sample = HVMonitorHistory[Channel][Last];
+  return true;
+}
+
+
+void AAVMEManager::GetHVMonitorHistory(Int_t Channel, vector<HVMonitorSampleStruct> &History)
+{
+  boost::lock_guard<boost::mutex> Lock(HVMonitorMutex);
+  
+  History.clear();
+  
+  if(Channel >= (Int_t)HVMonitorCount.size())
+    return;
+  
+  Int_t First = (HVMonitorNext[Channel] + HVMonitorHistoryLength - HVMonitorCount[Channel]) % HVMonitorHistoryLength;
+  for(Int_t s=0; s<HVMonitorCount[Channel]; s++)
+    History.push_back(HVMonitorHistory[Channel][(First + s) % HVMonitorHistoryLength]);
+}
@@ -24,6 +24,7 @@
 
 // ROOT 
 #include <TApplication.h>
+#include <TROOT.h>
 
 // C++ 
 #include <iostream>
@@ -48,6 +49,10 @@ Int_t main(Int_t argc, char **argv)
     SettingsFileName = (string)argv[1];
   }
   
+  // Events are written to the ADAQ file from a dedicated thread
+  // while the GUI thread fills histograms and graphics
+  ROOT::EnableThreadSafety();
+  
   // Run ROOT in standalone mode
   TApplication *TheApplication = new TApplication("ADAQAcquisition", &argc, argv);
   
@@ -0,0 +1,333 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQRawConvert.cc
+// date: 18 Oct 26
+//
+// desc: Converts raw readout buffer files (".adaq.raw") written by
+//       ADAQAcquisition into standard ADAQ ROOT files (".adaq.root")
+//       containing the digitized waveform and time stamp of each
+//       event. Multiple files are converted in parallel, one file
+//       per thread, with the number of threads set by "-j".
+//
+//       $ ADAQRawConvert [-j <threads>] <file.adaq.raw> [...]
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+
+// ROOT
+#include <TROOT.h>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+
+// C++
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+// ADAQAcquisition
+#include "AATypes.hh"
+#include "AASettings.hh"
+#include "AARawFile.hh"
+
+
+// Input files are handed out to the conversion threads in order
+vector<string> InputFiles;
+size_t NextInputFile = 0;
+boost::mutex InputMutex, OutputMutex;
+Int_t NumFailed = 0;
+
+
+void Report(string Message)
+{
+  boost::lock_guard<boost::mutex> Lock(OutputMutex);
+  cout << Message << endl;
+}
+
+
+Bool_t ConvertRawFile(string InputFileName)
+{
+  FILE *InputFile = fopen(InputFileName.c_str(), "rb");
+  if(InputFile == NULL){
+    Report("\nError! ADAQRawConvert could not open '" + InputFileName + "'!\n");
+    return false;
+  }
+
+  // Verify the file header and recover the acquisition settings
+
+  RawFileHeaderStruct Header;
+  if(fread(&Header, sizeof(Header), 1, InputFile) != 1 or
+     memcmp(Header.Magic, RawFileMagic, sizeof(Header.Magic)) != 0){
+    Report("\nError! '" + InputFileName + "' is not a raw readout buffer file!\n");
+    fclose(InputFile);
+    return false;
+  }
+
+  // Version 1 files hold the bare streamed settings without their
+  // StreamerInfo, which cannot be read by a different AASettings
+  // class version
+  if(Header.Version != RawFileVersion){
+    stringstream SS;
+    SS << "\nError! '" << InputFileName << "' is a version " << Header.Version
+       << " raw file; only version\n"
+       << "       " << RawFileVersion << " raw files can be converted!\n";
+    Report(SS.str());
+    fclose(InputFile);
+    return false;
+  }
+
+  vector<char> SettingsBlob(Header.SettingsSize);
+  if(Header.SettingsSize == 0 or
+     fread(&SettingsBlob[0], 1, Header.SettingsSize, InputFile) != Header.SettingsSize){
+    Report("\nError! The settings of '" + InputFileName + "' could not be read!\n");
+    fclose(InputFile);
+    return false;
+  }
+
+  AASettings *TheSettings = AARawFile::ReadSettings(SettingsBlob);
+
+  if(TheSettings == NULL){
+    Report("\nError! The settings of '" + InputFileName + "' could not be read!\n");
+    fclose(InputFile);
+    return false;
+  }
+
+  // DPP-PSD readout buffers hold the CAEN aggregate format, which is
+  // presently only decoded by the CAEN library with a live digitizer
+  if(Header.DGFirmwareType != 0){
+    Report("\nError! '" + InputFileName + "' was acquired with DPP-PSD firmware. Only\n"
+	   "       standard firmware raw files can presently be converted!\n");
+    delete TheSettings;
+    fclose(InputFile);
+    return false;
+  }
+
+  // The output file takes the name of the input file with the ".raw"
+  // extension replaced by ".root", e.g. "Data.adaq.root"
+
+  string OutputFileName = InputFileName;
+  size_t Found = OutputFileName.rfind(".raw");
+  if(Found != string::npos and Found + 4 == OutputFileName.size())
+    OutputFileName.replace(Found, 4, ".root");
+  else
+    OutputFileName += ".root";
+
+  // Create the ADAQ file and fill its readout information from the
+  // raw file header and the recovered settings
+  
+  AARawFile *OutputFile = new AARawFile;
+  OutputFile->CreateADAQFile(OutputFileName, Header, TheSettings);
+
+  Int_t DGChannels = Header.DGNumChannels;
+
+  // Only the digitized waveforms and time stamps are converted; the
+  // waveform analysis is left to offline analysis (e.g. ADAQAnalysis)
+  ADAQReadoutInformation *ARI = OutputFile->GetReadoutInformation();
+  ARI->SetStoreRawWaveforms  (true);
+  ARI->SetStoreEnergyData    (false);
+  ARI->SetStorePSDData       (false);
+
+  // Time stamp rollover correction as in ADAQAcquisition
+  vector<uint32_t> PrevTimeStamp(DGChannels, 0), TimeStampRollovers(DGChannels, 0);
+
+  vector<char> Buffer;
+  Long64_t NumBlocks = 0, NumEvents = 0;
+  Bool_t Truncated = false;
+
+  RawBlockHeaderStruct Block;
+  while(fread(&Block, sizeof(Block), 1, InputFile) == 1){
+
+    if(Block.Magic != RawBlockMagic){
+      Truncated = true;
+      break;
+    }
+
+    if(Buffer.size() < Block.ReadSize)
+      Buffer.resize(Block.ReadSize);
+
+    if(Block.ReadSize == 0)
+      continue;
+
+    if(fread(&Buffer[0], 1, Block.ReadSize, InputFile) != Block.ReadSize){
+      Truncated = true;
+      break;
+    }
+
+    NumBlocks++;
+
+    // The readout buffer is a sequence of events, each composed of a
+    // 4-word header followed by the data of each enabled channel in
+    // ascending channel order. Without zero suppression each channel
+    // has an equal number of words; with ZLE each channel block
+    // begins with its size in words followed by the control words
+    // and good-data segments (see AAAcquisitionManager)
+
+    uint32_t *Words = (uint32_t *)&Buffer[0];
+    uint32_t BufferWords = Block.ReadSize / sizeof(uint32_t);
+
+    for(uint32_t Index=0; Index+4<=BufferWords;){
+      uint32_t *Event = Words + Index;
+      uint32_t EventSize = Event[0] & 0x0fffffff;
+
+      if((Event[0] >> 28) != 0xa or EventSize < 4 or Index + EventSize > BufferWords)
+	break;
+
+      uint32_t ChannelMask = (Event[1] & 0xff) | (((Event[2] >> 24) & 0xff) << 8);
+      Bool_t ZLE = (Event[1] >> 24) & 0b1;
+      uint32_t RawTimeStamp = (Event[3] >> 1);
+
+      Int_t NumEnabled = 0;
+      for(Int_t ch=0; ch<16; ch++)
+	if(ChannelMask & (1 << ch))
+	  NumEnabled++;
+
+      uint32_t ChannelWords = (NumEnabled > 0) ? (EventSize - 4) / NumEnabled : 0;
+      uint32_t ChannelStart = 4;
+
+      for(Int_t ch=0; ch<16 and ChannelStart<EventSize; ch++){
+	if(!(ChannelMask & (1 << ch)))
+	  continue;
+
+	uint32_t ChannelStop = ChannelStart + ChannelWords;
+	uint32_t DataStart = ChannelStart;
+
+	if(ZLE){
+	  ChannelStop = ChannelStart + (Event[ChannelStart] & 0x0fffffff);
+	  DataStart = ChannelStart + 1;
+	}
+
+	if(ChannelStop > EventSize)
+	  ChannelStop = EventSize;
+
+	if(ch < DGChannels){
+	  vector<uint16_t> &Waveform = OutputFile->GetWaveform(ch);
+	  Waveform.clear();
+
+	  for(uint32_t w=DataStart; w<ChannelStop;){
+
+	    uint32_t NumWords = 1;
+	    if(ZLE){
+	      // Skipped segments carry no data words
+	      uint32_t Control = Event[w++];
+	      if(!(Control >> 31))
+		continue;
+	      NumWords = Control & 0x000fffff;
+	      if(w + NumWords > ChannelStop)
+		NumWords = ChannelStop - w;
+	    }
+
+	    for(uint32_t n=0; n<NumWords; n++, w++){
+	      Waveform.push_back(Event[w] & 0x0000ffff);
+	      Waveform.push_back((Event[w] & 0xffff0000) >> 16);
+	    }
+	  }
+
+	  if(RawTimeStamp < PrevTimeStamp[ch])
+	    TimeStampRollovers[ch]++;
+	  PrevTimeStamp[ch] = RawTimeStamp;
+
+	  ADAQWaveformData *WaveformData = OutputFile->GetWaveformData(ch);
+	  WaveformData->SetChannelID(ch);
+	  WaveformData->SetBoardID(Header.DGBoardID);
+	  WaveformData->SetTimeStamp((ULong64_t)(RawTimeStamp + TimeStampRollovers[ch] *
+						 ((ULong64_t)1 << Header.DGTimeStampSize)));
+
+	  OutputFile->FillEvent(ch);
+
+	  NumEvents++;
+	}
+
+	ChannelStart = ChannelStop;
+      }
+
+      Index += EventSize;
+    }
+  }
+
+  fclose(InputFile);
+
+  OutputFile->CloseADAQFile();
+
+  delete OutputFile;
+  delete TheSettings;
+
+  stringstream SS;
+  SS << "ADAQRawConvert : " << InputFileName << " -> " << OutputFileName
+     << " (" << NumBlocks << " buffers, " << NumEvents << " waveforms)";
+  if(Truncated)
+    SS << "\n  Warning! The file is truncated; the final buffer could not be read.";
+  Report(SS.str());
+
+  return true;
+}
+
+
+void RunConversionThread()
+{
+  while(true){
+    string InputFileName;
+    {
+      boost::lock_guard<boost::mutex> Lock(InputMutex);
+      if(NextInputFile == InputFiles.size())
+	return;
+      InputFileName = InputFiles[NextInputFile++];
+    }
+
+    if(!ConvertRawFile(InputFileName)){
+      boost::lock_guard<boost::mutex> Lock(InputMutex);
+      NumFailed++;
+    }
+  }
+}
+
+
+Int_t main(Int_t argc, char **argv)
+{
+  Int_t NumThreads = boost::thread::hardware_concurrency();
+
+  for(Int_t a=1; a<argc; a++){
+    if(string(argv[a]) == "-j" and a+1 < argc)
+      NumThreads = atoi(argv[++a]);
+    else
+      InputFiles.push_back(argv[a]);
+  }
+
+  if(InputFiles.empty()){
+    cout << "\nUsage: ADAQRawConvert [-j <threads>] <file.adaq.raw> [<file.adaq.raw> ...]\n"
+	 << endl;
+    return 1;
+  }
+
+  if(NumThreads < 1)
+    NumThreads = 1;
+  if(NumThreads > (Int_t)InputFiles.size())
+    NumThreads = InputFiles.size();
+
+  // Each file is converted by a single thread into its own ROOT file
+  ROOT::EnableThreadSafety();
+
+  boost::thread_group Threads;
+  for(Int_t t=0; t<NumThreads; t++)
+    Threads.create_thread(&RunConversionThread);
+  Threads.join_all();
+
+  return (NumFailed > 0) ? 1 : 0;
+}
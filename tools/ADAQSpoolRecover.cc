@@ -0,0 +1,212 @@
+/////////////////////////////////////////////////////////////////////////////////
+//                                                                             //
+//                           Copyright (C) 2012-2016                           //
+//                 Zachary Seth Hartwig : All rights reserved                  //
+//                                                                             //
+//      The ADAQAcquisition source code is licensed under the GNU GPL v3.0.    //
+//      You have the right to modify and/or redistribute this source code      //
+//      under the terms specified in the license, which may be found online    //
+//      at http://www.gnu.org/licenses or at $ADAQACQUISITION/License.txt.     //
+//                                                                             //
+/////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// name: ADAQSpoolRecover.cc
+// date: 18 Oct 26
+//
+// desc: Rebuilds an ADAQ ROOT file from the event spool (".spool")
+//       left behind when ADAQAcquisition crashed or the machine lost
+//       power before the ADAQ file was written. Every complete event
+//       record of the spool is written, with its waveform and
+//       waveform data, into a new ADAQ file named after the original
+//       with ".recovered" inserted before ".root", e.g.
+//       "Data.adaq.root.spool" -> "Data.adaq.recovered.root". A
+//       partially written record at the end of the spool is
+//       discarded.
+//
+//       $ ADAQSpoolRecover <file.adaq.root.spool> [...]
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+
+// ROOT
+#include <TROOT.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// C++
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+// ADAQAcquisition
+#include "AATypes.hh"
+#include "AASettings.hh"
+#include "AAEventSpool.hh"
+#include "AARawFile.hh"
+
+
+Bool_t RecoverSpool(string InputFileName)
+{
+  FILE *InputFile = fopen(InputFileName.c_str(), "rb");
+  if(InputFile == NULL){
+    cout << "\nError! ADAQSpoolRecover could not open '" << InputFileName << "'!\n" << endl;
+    return false;
+  }
+
+  // Verify the spool header and recover the acquisition settings
+
+  RawFileHeaderStruct Header;
+  if(fread(&Header, sizeof(Header), 1, InputFile) != 1 or
+     memcmp(Header.Magic, SpoolFileMagic, sizeof(Header.Magic)) != 0){
+    cout << "\nError! '" << InputFileName << "' is not an event spool!\n" << endl;
+    fclose(InputFile);
+    return false;
+  }
+
+  if(Header.Version != SpoolFileVersion){
+    cout << "\nError! '" << InputFileName << "' is a version " << Header.Version
+	 << " event spool; only version\n"
+	 << "       " << SpoolFileVersion << " event spools can be recovered!\n" << endl;
+    fclose(InputFile);
+    return false;
+  }
+
+  vector<char> SettingsBlob(Header.SettingsSize);
+  if(Header.SettingsSize == 0 or
+     fread(&SettingsBlob[0], 1, Header.SettingsSize, InputFile) != Header.SettingsSize){
+    cout << "\nError! The settings of '" << InputFileName << "' could not be read!\n" << endl;
+    fclose(InputFile);
+    return false;
+  }
+
+  AASettings *TheSettings = AARawFile::ReadSettings(SettingsBlob);
+
+  if(TheSettings == NULL){
+    cout << "\nError! The settings of '" << InputFileName << "' could not be read!\n" << endl;
+    fclose(InputFile);
+    return false;
+  }
+
+  // The records begin at the first 8-byte boundary after the settings
+  long FirstRecord = (sizeof(Header) + Header.SettingsSize + 7) & ~7L;
+  fseek(InputFile, FirstRecord, SEEK_SET);
+
+  // The output file takes the name of the spooled ADAQ file with
+  // ".recovered" inserted before the ".root" extension
+
+  string OutputFileName = InputFileName;
+  size_t Found = OutputFileName.rfind(".spool");
+  if(Found != string::npos and Found + 6 == OutputFileName.size())
+    OutputFileName.erase(Found);
+
+  Found = OutputFileName.rfind(".root");
+  if(Found != string::npos and Found + 5 == OutputFileName.size())
+    OutputFileName.insert(Found, ".recovered");
+  else
+    OutputFileName += ".recovered.root";
+
+  // Create the ADAQ file and fill its readout information from the
+  // spool header and the recovered settings
+  
+  AARawFile *OutputFile = new AARawFile;
+  OutputFile->CreateADAQFile(OutputFileName, Header, TheSettings);
+
+  Int_t DGChannels = Header.DGNumChannels;
+
+  // Read the records until the end of the spool, which is either the
+  // end of the file or, for a spool that was never closed, the
+  // zero-filled space allocated ahead of the records
+
+  vector<char> Record;
+  Long64_t NumEvents = 0;
+  Bool_t Truncated = false;
+
+  const UInt_t HeaderSize = sizeof(SpoolRecordHeaderStruct);
+  SpoolRecordHeaderStruct RecordHeader;
+
+  while(fread(&RecordHeader, HeaderSize, 1, InputFile) == 1){
+
+    if(RecordHeader.Magic == 0)
+      break;
+
+    if(RecordHeader.Magic != SpoolRecordMagic or
+       RecordHeader.Size < HeaderSize or RecordHeader.Size % 8 != 0 or
+       RecordHeader.NumSamples < 0 or
+       HeaderSize + RecordHeader.NumSamples * sizeof(uint16_t) > RecordHeader.Size or
+       RecordHeader.Channel < 0 or RecordHeader.Channel >= DGChannels){
+      Truncated = true;
+      break;
+    }
+
+    if(Record.size() < RecordHeader.Size)
+      Record.resize(RecordHeader.Size);
+
+    memcpy(&Record[0], &RecordHeader, HeaderSize);
+    if(fread(&Record[HeaderSize], 1, RecordHeader.Size - HeaderSize, InputFile) != RecordHeader.Size - HeaderSize){
+      Truncated = true;
+      break;
+    }
+
+    const SpoolRecordHeaderStruct *Event = (const SpoolRecordHeaderStruct *)&Record[0];
+    if(AAEventSpool::Checksum(Event) != Event->Checksum){
+      Truncated = true;
+      break;
+    }
+
+    Int_t ch = Event->Channel;
+
+    const uint16_t *Samples = (const uint16_t *)(Event + 1);
+    OutputFile->GetWaveform(ch).assign(Samples, Samples + Event->NumSamples);
+
+    ADAQWaveformData *WaveformData = OutputFile->GetWaveformData(ch);
+    WaveformData->SetChannelID(ch);
+    WaveformData->SetBoardID(Event->BoardID);
+    WaveformData->SetTimeStamp(Event->TimeStamp);
+    WaveformData->SetBaseline(Event->Baseline);
+    WaveformData->SetPulseHeight(Event->PulseHeight);
+    WaveformData->SetPulseArea(Event->PulseArea);
+    WaveformData->SetPSDTotalIntegral(Event->PSDTotal);
+    WaveformData->SetPSDTailIntegral(Event->PSDTail);
+
+    OutputFile->FillEvent(ch);
+
+    NumEvents++;
+  }
+
+  fclose(InputFile);
+
+  OutputFile->CloseADAQFile();
+
+  delete OutputFile;
+  delete TheSettings;
+
+  cout << "ADAQSpoolRecover : " << InputFileName << " -> " << OutputFileName
+       << " (" << NumEvents << " events)" << endl;
+  if(Truncated)
+    cout << "  Warning! The final, partially written record of the spool was discarded." << endl;
+
+  return true;
+}
+
+
+Int_t main(Int_t argc, char **argv)
+{
+  if(argc < 2){
+    cout << "\nUsage: ADAQSpoolRecover <file.adaq.root.spool> [<file.adaq.root.spool> ...]\n"
+	 << endl;
+    return 1;
+  }
+
+  Int_t NumFailed = 0;
+  for(Int_t a=1; a<argc; a++)
+    if(!RecoverSpool(argv[a]))
+      NumFailed++;
+
+  return (NumFailed > 0) ? 1 : 0;
+}